@@ -0,0 +1,282 @@
+#pragma once
+
+#include <ogl.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// A single keyframe of a scripted benchmark path.
+struct BenchmarkKeyframe
+{
+    glm::vec3 camera_pos;
+    glm::vec3 camera_target;
+    glm::vec3 light_pos;
+    glm::vec3 light_target;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Piecewise-linear camera and light path that is evaluated over a normalized [0.0 - 1.0] time.
+class BenchmarkPath
+{
+public:
+    // Each non-empty, non-comment line of the file holds 12 floats:
+    // camera position, camera target, light position and light target.
+    bool load(const std::string& path)
+    {
+        std::ifstream file(path);
+
+        if (!file.is_open())
+            return false;
+
+        m_keyframes.clear();
+
+        std::string line;
+
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::stringstream ss(line);
+            BenchmarkKeyframe key;
+
+            ss >> key.camera_pos.x >> key.camera_pos.y >> key.camera_pos.z;
+            ss >> key.camera_target.x >> key.camera_target.y >> key.camera_target.z;
+            ss >> key.light_pos.x >> key.light_pos.y >> key.light_pos.z;
+            ss >> key.light_target.x >> key.light_target.y >> key.light_target.z;
+
+            if (ss.fail())
+                return false;
+
+            m_keyframes.push_back(key);
+        }
+
+        return !m_keyframes.empty();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Sweeps the camera across the front of the Cornell box while the spot light pans between the two coloured walls.
+    void create_default()
+    {
+        m_keyframes.clear();
+
+        m_keyframes.push_back({ glm::vec3(0.0f, 10.0f, 30.0f), glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(0.0f, 7.0f, 30.0f), glm::vec3(-6.0f, 7.0f, 0.0f) });
+        m_keyframes.push_back({ glm::vec3(-8.0f, 10.0f, 28.0f), glm::vec3(0.0f, 8.0f, 0.0f), glm::vec3(0.0f, 7.0f, 30.0f), glm::vec3(0.0f, 4.0f, 0.0f) });
+        m_keyframes.push_back({ glm::vec3(0.0f, 15.0f, 20.0f), glm::vec3(0.0f, 6.0f, 0.0f), glm::vec3(4.0f, 10.0f, 28.0f), glm::vec3(6.0f, 7.0f, 0.0f) });
+        m_keyframes.push_back({ glm::vec3(8.0f, 10.0f, 28.0f), glm::vec3(0.0f, 8.0f, 0.0f), glm::vec3(0.0f, 7.0f, 30.0f), glm::vec3(0.0f, 10.0f, 0.0f) });
+        m_keyframes.push_back({ glm::vec3(0.0f, 10.0f, 30.0f), glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(0.0f, 7.0f, 30.0f), glm::vec3(-6.0f, 7.0f, 0.0f) });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    BenchmarkKeyframe evaluate(float t) const
+    {
+        if (m_keyframes.size() == 1)
+            return m_keyframes[0];
+
+        float    f     = glm::clamp(t, 0.0f, 1.0f) * float(m_keyframes.size() - 1);
+        uint32_t idx   = std::min(uint32_t(f), uint32_t(m_keyframes.size() - 2));
+        float    alpha = f - float(idx);
+
+        const BenchmarkKeyframe& a = m_keyframes[idx];
+        const BenchmarkKeyframe& b = m_keyframes[idx + 1];
+
+        BenchmarkKeyframe key;
+
+        key.camera_pos    = glm::mix(a.camera_pos, b.camera_pos, alpha);
+        key.camera_target = glm::mix(a.camera_target, b.camera_target, alpha);
+        key.light_pos     = glm::mix(a.light_pos, b.light_pos, alpha);
+        key.light_target  = glm::mix(a.light_target, b.light_target, alpha);
+
+        return key;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline bool empty() const { return m_keyframes.empty(); }
+
+private:
+    std::vector<BenchmarkKeyframe> m_keyframes;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct TimingStats
+{
+    double mean = 0.0;
+    double min  = 0.0;
+    double max  = 0.0;
+    double p50  = 0.0;
+    double p95  = 0.0;
+    double p99  = 0.0;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Collects per-frame timings and writes them, along with aggregate statistics, to a JSON file.
+class BenchmarkRecorder
+{
+public:
+    struct Frame
+    {
+        double cpu_ms   = 0.0;
+        double gpu_ms   = 0.0;
+        double frame_ms = 0.0;
+    };
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void reset(uint32_t frame_count)
+    {
+        m_frames.clear();
+        m_frames.resize(frame_count);
+        m_settings.clear();
+        m_passes.clear();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline Frame& frame(uint32_t idx) { return m_frames[idx]; }
+    inline uint32_t frame_count() const { return uint32_t(m_frames.size()); }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void add_setting(const std::string& name, const std::string& value)
+    {
+        m_settings.push_back({ name, value });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Smoothed per-pass timings at the end of the run. A negative GPU time means the pass was only timed on the CPU.
+    void add_pass(const std::string& name, double cpu_ms, double gpu_ms)
+    {
+        m_passes.push_back({ name, cpu_ms, gpu_ms });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    static TimingStats compute_stats(std::vector<double> samples)
+    {
+        TimingStats stats;
+
+        if (samples.empty())
+            return stats;
+
+        std::sort(samples.begin(), samples.end());
+
+        double sum = 0.0;
+
+        for (auto s : samples)
+            sum += s;
+
+        stats.mean = sum / double(samples.size());
+        stats.min  = samples.front();
+        stats.max  = samples.back();
+        stats.p50  = percentile(samples, 0.50);
+        stats.p95  = percentile(samples, 0.95);
+        stats.p99  = percentile(samples, 0.99);
+
+        return stats;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool write_json(const std::string& path) const
+    {
+        std::ofstream file(path);
+
+        if (!file.is_open())
+            return false;
+
+        std::vector<double> cpu;
+        std::vector<double> gpu;
+        std::vector<double> frame;
+
+        for (const auto& f : m_frames)
+        {
+            cpu.push_back(f.cpu_ms);
+            gpu.push_back(f.gpu_ms);
+            frame.push_back(f.frame_ms);
+        }
+
+        file << "{\n";
+        file << "  \"settings\": {";
+
+        for (uint32_t i = 0; i < m_settings.size(); i++)
+            file << (i == 0 ? "\n" : ",\n") << "    \"" << m_settings[i].first << "\": \"" << m_settings[i].second << "\"";
+
+        file << "\n  },\n";
+        file << "  \"frame_count\": " << m_frames.size() << ",\n";
+        file << "  \"aggregate\": {\n";
+
+        write_stats(file, "cpu_ms", compute_stats(cpu), false);
+        write_stats(file, "gpu_ms", compute_stats(gpu), false);
+        write_stats(file, "frame_ms", compute_stats(frame), true);
+
+        file << "  },\n";
+        file << "  \"passes\": [";
+
+        for (uint32_t i = 0; i < m_passes.size(); i++)
+        {
+            file << (i == 0 ? "\n" : ",\n") << "    { \"name\": \"" << m_passes[i].name << "\", \"cpu_ms\": " << m_passes[i].cpu_ms;
+
+            if (m_passes[i].gpu_ms >= 0.0)
+                file << ", \"gpu_ms\": " << m_passes[i].gpu_ms;
+
+            file << " }";
+        }
+
+        file << "\n  ],\n";
+        file << "  \"frames\": [\n";
+
+        for (uint32_t i = 0; i < m_frames.size(); i++)
+        {
+            const Frame& f = m_frames[i];
+            file << "    { \"frame\": " << i << ", \"cpu_ms\": " << f.cpu_ms << ", \"gpu_ms\": " << f.gpu_ms << ", \"frame_ms\": " << f.frame_ms << " }";
+            file << (i == m_frames.size() - 1 ? "\n" : ",\n");
+        }
+
+        file << "  ]\n";
+        file << "}\n";
+
+        return true;
+    }
+
+private:
+    // Nearest-rank percentile over an already sorted array.
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        size_t rank = size_t(std::ceil(p * double(sorted.size())));
+        return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    static void write_stats(std::ofstream& file, const char* name, const TimingStats& stats, bool last)
+    {
+        file << "    \"" << name << "\": { \"mean\": " << stats.mean << ", \"min\": " << stats.min << ", \"max\": " << stats.max << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << " }";
+        file << (last ? "\n" : ",\n");
+    }
+
+private:
+    struct Pass
+    {
+        std::string name;
+        double      cpu_ms;
+        double      gpu_ms;
+    };
+
+    std::vector<Frame>                               m_frames;
+    std::vector<Pass>                                m_passes;
+    std::vector<std::pair<std::string, std::string>> m_settings;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -1,26 +1,98 @@
 #define _USE_MATH_DEFINES
 #include <application.h>
-#include <mesh.h>
+#include <ogl.h>
 #include <camera.h>
-#include <material.h>
 #include <memory>
 #include <iostream>
 #include <stack>
 #include <random>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <unordered_map>
+
+#include "benchmark.h"
+#include "profiler.h"
+#include "rsm_reference.h"
+#include "sample_sets.h"
+#include "scene_cache.h"
+#include "scene_bvh.h"
+#include "thread_pool.h"
+#include "uniform_ring.h"
+#include "program_cache.h"
+#include "render_graph.h"
+#include "quality_controller.h"
+#include "quality_sweep.h"
 
 #define CAMERA_FAR_PLANE 1000.0f
 #define RSM_SIZE 1024
+#define MIN_RSM_SIZE 256
+#define MAX_RSM_SIZE 2048
 #define SAMPLES_TEXTURE_SIZE 64
+#define MAX_SAMPLES_TEXTURE_SIZE 256
+#define BLUE_NOISE_SIZE 16
 #define SCALED_INDIRECT 0.5f
+#define MIN_SCALED_INDIRECT 0.25f
+#define QUALITY_MAX_PASS_AGE 120
+#define BENCH_QUERY_COUNT 4
+#define SWEEP_REFERENCE_ROTATIONS 8
+#define SWEEP_WARMUP_FRAMES (PROFILER_FRAMES_IN_FLIGHT + 1)
+#define MAX_LIGHTS 32
+#define MIN_VPL_CLUSTERS 256
+#define MAX_VPL_CLUSTERS 4096
+#define UPLOAD_STAGING_SIZE (4 * 1024 * 1024)
+#define UPLOAD_BUDGET_PER_FRAME (16 * 1024 * 1024)
+#define UNIFORM_RING_FRAME_SIZE (2 * 1024 * 1024)
+#define SCENE_SCALE 10.0f
+#define PROGRAM_CACHE_DIRECTORY "program_cache"
+#define MAX_INSTANCE_GRID 32
+
+// How the indirect lighting pass finds its VPLs.
+enum IndirectGatherMode
+{
+    INDIRECT_GATHER_POLAR,      // Fixed polar sample pattern around the projected pixel.
+    INDIRECT_GATHER_IMPORTANCE, // Samples drawn from the RSM flux luminance pyramid.
+    INDIRECT_GATHER_CLUSTERS    // Loop over the clustered VPL list.
+};
 
-// Uniform buffer data structure.
-struct ObjectUniforms
+static const char* kIndirectGatherModeNames[] = { "Polar Samples", "Importance Sampling", "VPL Clusters" };
+
+// Per-pixel variation of the sample pattern. Matches the DITHER_* defines in the indirect shaders.
+enum DitherMode
 {
-    DW_ALIGNED(16)
-    glm::mat4 model;
+    DITHER_NONE,
+    DITHER_BAYER,     // Scales the sample offsets by a 4x4 or 8x8 Bayer matrix.
+    DITHER_BLUE_NOISE // Rotates the sample pattern by a tiled blue noise texture.
+};
+
+static const char* kDitherModeNames[] = { "None", "Bayer", "Blue Noise" };
+static const char* kDitherModeArgs[]  = { "none", "bayer", "blue-noise" };
+
+// UI names of the SampleSetType values in sample_sets.h.
+static const char* kSampleSetTypeNames[] = { "Random", "Poisson Disk", "Halton", "Sobol" };
+
+// How the low resolution indirect lighting is brought to full resolution. Rejected pixels are gathered again at full
+// resolution in both modes.
+enum UpsampleMode
+{
+    UPSAMPLE_INTERPOLATE,    // Bilinear, rejecting pixels if any of the four texels lies on a different surface.
+    UPSAMPLE_JOINT_BILATERAL // Tent filter over a larger footprint, weighted by geometric similarity to the pixel.
+};
+
+static const char* kUpsampleModeNames[] = { "Interpolate", "Joint Bilateral" };
+static const char* kUpsampleModeArgs[]  = { "interpolate", "bilateral" };
+
+// Geometry passes over the scene. Each one culls the submeshes against its own view volume.
+enum ScenePass
+{
+    SCENE_PASS_GBUFFER, // Camera frustum.
+    SCENE_PASS_RSM,     // Union of the light frusta, limited to the light range.
+    SCENE_PASS_COUNT
 };
 
+// Uniform buffer data structure.
 struct GlobalUniforms
 {
     DW_ALIGNED(16)
@@ -29,6 +101,120 @@ struct GlobalUniforms
     glm::mat4 light_view_proj;
     DW_ALIGNED(16)
     glm::vec4 cam_pos;
+    DW_ALIGNED(16)
+    glm::mat4 inv_view_proj;
+    DW_ALIGNED(16)
+    glm::mat4 prev_view_proj;
+};
+
+// Matches the SpotLight struct in the shaders (std140).
+struct LightData
+{
+    DW_ALIGNED(16)
+    glm::mat4 view_proj;
+    DW_ALIGNED(16)
+    glm::mat4 inv_view_proj; // Reconstructs VPL positions from the depth in the packed RSM.
+    DW_ALIGNED(16)
+    glm::vec4 position; // xyz: position, w: range
+    DW_ALIGNED(16)
+    glm::vec4 direction; // xyz: direction, w: shadow bias
+    DW_ALIGNED(16)
+    glm::vec4 color; // rgb: color * intensity
+    DW_ALIGNED(16)
+    glm::vec4 cutoff; // x: cos(inner cutoff), y: cos(outer cutoff)
+    DW_ALIGNED(16)
+    glm::ivec4 samples; // x: polar sample count, y: first polar sample, z: importance sample count
+};
+
+struct LightUniforms
+{
+    LightData lights[MAX_LIGHTS];
+    DW_ALIGNED(16)
+    glm::ivec4 light_count;
+};
+
+// A spot light in addition to the main light. They share the cone, range and bias of the main light.
+struct SpotLight
+{
+    glm::vec3 position;
+    glm::vec3 target;
+    glm::vec3 color;
+    float     intensity;
+};
+
+// Versions of the inputs that a pass was last executed with.
+struct PassInputs
+{
+    uint32_t light    = UINT32_MAX;
+    uint32_t camera   = UINT32_MAX;
+    uint32_t scene    = UINT32_MAX;
+    uint32_t settings = UINT32_MAX;
+};
+
+// GPU buffers of a scene cache. Submeshes are uploaded in order and only drawn once they are resident.
+//
+// Every pass culls the instances and submeshes against its view volume and draws the survivors from its own lists, with
+// every visible instance in a single instanced draw per submesh. The draw commands and the transforms of the visible
+// instances are written to the uniform ring each time the pass runs. The material buffer holds the albedo of every
+// submesh, indexed by the base instance of its command.
+struct SceneMesh
+{
+    GLuint                    vao                 = 0;
+    GLuint                    vbo                 = 0;
+    GLuint                    ibo                 = 0;
+    GLuint                    material_buffer     = 0;
+    uint32_t                  resident_submeshes  = 0;
+    std::vector<SceneSubMesh> submeshes;
+    SceneBvh                  bvh;
+    std::vector<uint8_t>      visible;
+    std::vector<uint32_t>     draw_lists[SCENE_PASS_COUNT];
+    glm::vec3                 min_extents;
+    glm::vec3                 max_extents;
+    std::vector<glm::mat4>    instances;
+    std::vector<glm::mat4>    visible_instances[SCENE_PASS_COUNT];
+    UniformRange              instance_ranges[SCENE_PASS_COUNT];
+};
+
+// Matches the layout glMultiDrawElementsIndirect reads.
+struct DrawElementsIndirectCommand
+{
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t  base_vertex;
+    uint32_t base_instance;
+};
+
+// Matches the Material struct in gbuffer_fs.glsl (std430).
+struct MaterialData
+{
+    glm::vec4 albedo;
+};
+
+// A scene cache mapped by a loader thread, along with the BVH over its submeshes. The cache is null if loading failed.
+struct LoadedScene
+{
+    std::string                 path;
+    std::unique_ptr<SceneCache> cache;
+    SceneBvh                    bvh;
+};
+
+// Progress of the mesh currently being copied to the GPU.
+struct SceneUpload
+{
+    std::unique_ptr<SceneCache> cache;
+    uint32_t                    mesh         = 0;
+    uint32_t                    submesh      = 0;
+    uint64_t                    vertex_bytes = 0; // Bytes of the current submesh copied so far.
+    uint64_t                    index_bytes  = 0;
+};
+
+// Matches the Vpl struct in the VPL clustering shaders (std430).
+struct VplCluster
+{
+    glm::vec4 position;
+    glm::vec4 normal;
+    glm::vec4 flux;
 };
 
 class ReflectiveShadowMaps : public dw::Application
@@ -38,18 +224,33 @@ protected:
 
     bool init(int argc, const char* argv[]) override
     {
+        if (!parse_arguments(argc, argv))
+            return false;
+
+        m_multi_draw_supported = extension_supported("GL_ARB_shader_draw_parameters");
+
+        if (m_multi_draw_indirect && !m_multi_draw_supported)
+        {
+            DW_LOG_INFO("GL_ARB_shader_draw_parameters is not supported, drawing every submesh separately");
+            m_multi_draw_indirect = false;
+        }
+
+        m_program_cache.initialize(PROGRAM_CACHE_DIRECTORY, m_program_cache_enabled);
+
         // Create GPU resources.
         if (!create_shaders())
             return false;
 
+        DW_LOG_INFO("Created programs in " + std::to_string(m_program_cache.total_ms()) + " ms (" + std::to_string(m_program_cache.hits()) + " cached, " + std::to_string(m_program_cache.misses()) + " compiled)");
+
         if (!create_uniform_buffer())
             return false;
 
-        // Load scene.
+        // Start loading the scene, update() draws it as it arrives.
         if (!load_scene())
             return false;
 
-        create_framebuffers();
+        build_render_graph();
         create_samples_texture();
         create_dither_texture();
         create_spot_light();
@@ -57,8 +258,21 @@ protected:
         // Create camera.
         create_camera();
 
-        // Object transforms
-        m_object_transforms.model = glm::scale(glm::mat4(1.0f), glm::vec3(10.0f));
+        glGenQueries(1, &m_refine_query);
+
+        // Pixel pack buffer for the non-blocking readback of the per-light flux estimates.
+        glGenBuffers(1, &m_light_estimate_pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_light_estimate_pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float) * MAX_LIGHTS, nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if (m_bench_mode || m_sweep_mode)
+        {
+            // Benchmarks measure the complete scene.
+            finish_scene_loading();
+
+            return m_sweep_mode ? begin_sweep() : begin_benchmark();
+        }
 
         return true;
     }
@@ -67,34 +281,140 @@ protected:
 
     void update(double delta) override
     {
-        // Update camera.
-        update_camera();
+        if (m_bench_mode)
+            begin_benchmark_frame();
 
-        update_global_uniforms(m_global_uniforms);
-        update_object_uniforms(m_object_transforms);
+        m_profiler.begin_frame();
+
+        if (m_sweep_mode)
+            begin_sweep_frame();
+
+        {
+            ProfileScope scope(m_profiler, "update_camera", false);
+
+            if (m_bench_mode)
+            {
+                // Replay the scripted path instead of user input.
+                update_benchmark_path();
+            }
+            else if (!m_sweep_mode)
+            {
+                // Update camera.
+                update_camera();
+            }
+        }
 
-        if (m_debug_gui)
+        poll_light_estimates();
+
+        if (!m_scene_loaded)
+        {
+            ProfileScope scope(m_profiler, "stream_scene");
+            stream_scene(UPLOAD_BUDGET_PER_FRAME);
+        }
+
+        if (m_debug_gui && !m_bench_mode && !m_sweep_mode)
+        {
+            ProfileScope scope(m_profiler, "ui", false);
             ui();
+        }
 
-        render_rsm();
-        render_gbuffer();
+        if (m_adaptive_quality)
+            update_adaptive_quality();
 
-        if (!m_indirect_only)
-            direct_lighting();
+        // Pushed after every change of this frame, so that the passes run with the data of the versions they record.
+        m_uniform_ring.begin_frame();
 
-        if (m_rsm_enabled || m_indirect_only)
+        update_global_uniforms(m_global_uniforms);
+        update_light_uniforms();
+
+        // The RSM depends on the lights and the scene, the G-buffer on the camera and the scene, and lighting on all of
+        // them plus the render settings.
+        bool lighting_changed = update_pass_inputs(m_lighting_inputs, true, true, true);
+
+        m_static_frames = lighting_changed ? 0 : m_static_frames + 1;
+
+        // Temporal accumulation keeps refining a static image until the history has converged.
+        bool lighting_dirty = lighting_changed || (m_temporal_accumulation && m_static_frames < temporal_convergence_frames());
+
+        if (update_pass_inputs(m_rsm_inputs, true, false, false))
+            render_rsm();
+
+        if (update_pass_inputs(m_gbuffer_inputs, false, true, false))
+            render_gbuffer();
+
+        if (lighting_dirty)
         {
-            indirect_lighting();
-            copy_indirect();
+            if (!m_indirect_only)
+                direct_lighting();
+
+            if (m_rsm_enabled || m_indirect_only)
+            {
+                // The pyramid also provides the per-light estimates that the sample budget is split by.
+                if (m_gather_mode == INDIRECT_GATHER_CLUSTERS)
+                    cluster_vpls();
+                else if (m_gather_mode == INDIRECT_GATHER_IMPORTANCE || m_light_count > 1)
+                    build_flux_pyramid();
+
+                indirect_lighting();
+
+                if (m_edge_aware_blur)
+                    blur_indirect();
+
+                if (m_temporal_accumulation)
+                    temporal_accumulation();
+
+                copy_indirect();
+            }
+            else
+                m_history_valid = false;
+
+            m_frame_index++;
         }
+
+        present_composite();
+
+        m_uniform_ring.end_frame();
+
+        m_profiler.end_frame();
+
+        if (m_bench_mode)
+            end_benchmark_frame();
+
+        if (m_sweep_mode)
+            end_sweep_frame();
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
     void shutdown() override
     {
-        for (auto mesh : m_scene)
-            dw::Mesh::unload(mesh);
+        if (m_bench_mode)
+            glDeleteQueries(BENCH_QUERY_COUNT * 2, &m_bench_queries[0][0]);
+
+        m_profiler.shutdown();
+
+        glDeleteQueries(1, &m_refine_query);
+
+        if (m_light_estimate_fence)
+            glDeleteSync(m_light_estimate_fence);
+
+        glDeleteBuffers(1, &m_light_estimate_pbo);
+
+        m_uniform_ring.destroy();
+
+        // Loads that have not started yet return right away.
+        m_loader_cancelled = true;
+        m_loader_pool.reset();
+
+        glDeleteBuffers(1, &m_staging_buffer);
+
+        for (auto& mesh : m_scene)
+        {
+            glDeleteVertexArrays(1, &mesh.vao);
+            glDeleteBuffers(1, &mesh.vbo);
+            glDeleteBuffers(1, &mesh.ibo);
+            glDeleteBuffers(1, &mesh.material_buffer);
+        }
 
         m_scene.clear();
     }
@@ -106,7 +426,8 @@ protected:
         // Override window resized method to update camera projection.
         m_main_camera->update_projection(60.0f, 0.1f, CAMERA_FAR_PLANE, float(m_width) / float(m_height));
 
-        create_framebuffers();
+        // Only the window sized targets are rebuilt, the RSM keeps its contents.
+        build_render_graph();
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -189,168 +510,2363 @@ protected:
     // -----------------------------------------------------------------------------------------------------------------------------------
 
 private:
-    void create_spot_light()
+    bool parse_arguments(int argc, const char* argv[])
     {
-        m_inner_cutoff    = 10.0f;
-        m_outer_cutoff    = 15.0f;
-        m_light_intensity = 1.0f;
-        m_light_range     = 100.0f;
-        m_light_bias      = 0.001f;
-        m_light_color     = glm::vec3(1.0f, 1.0f, 1.0f);
-        m_light_pos       = glm::vec3(0.0f, 7.0f, 30.0f);
-        m_light_target    = glm::vec3(-6.0f, 7.0f, 0.0f);
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+
+            if (arg == "--bench")
+                m_bench_mode = true;
+            else if (arg == "--sweep")
+                m_sweep_mode = true;
+            else if (arg == "--no-dither")
+                m_dither_mode = DITHER_NONE;
+            else if (arg == "--no-interpolation")
+                m_screenspace_interpolation = false;
+            else if (arg == "--direct-only")
+                m_rsm_enabled = false;
+            else if (arg == "--compact-gbuffer")
+                m_compact_gbuffer = true;
+            else if (arg == "--packed-rsm")
+                m_packed_rsm = true;
+            else if (arg == "--importance-sampling")
+                m_gather_mode = INDIRECT_GATHER_IMPORTANCE;
+            else if (arg == "--vpl-clusters")
+                m_gather_mode = INDIRECT_GATHER_CLUSTERS;
+            else if (arg == "--temporal")
+                m_temporal_accumulation = true;
+            else if (arg == "--compute-gather")
+                m_compute_gather = true;
+            else if (arg == "--no-mdi")
+                m_multi_draw_indirect = false;
+            else if (arg == "--no-culling")
+                m_frustum_culling = false;
+            else if (arg == "--no-program-cache")
+                m_program_cache_enabled = false;
+            else if (arg == "--no-shader-permutations")
+                m_shader_permutations = false;
+            else if (arg == "--bayer-8x8")
+                m_bayer_8x8 = true;
+            else if (arg == "--scene" && i + 1 < argc)
+                m_scene_paths.push_back(argv[++i]);
+            else if (i + 1 < argc)
+            {
+                std::string value = argv[++i];
+
+                if (arg == "--bench-frames")
+                    m_bench_frames = std::max(1, int_from_arg(arg, value, int(m_bench_frames)));
+                else if (arg == "--bench-warmup")
+                    m_bench_warmup = std::max(0, int_from_arg(arg, value, int(m_bench_warmup)));
+                else if (arg == "--bench-output")
+                    m_bench_output = value;
+                else if (arg == "--bench-path")
+                    m_bench_path_file = value;
+                else if (arg == "--trace")
+                    m_trace_output = value;
+                else if (arg == "--sweep-output")
+                    m_sweep_output = value;
+                else if (arg == "--sweep-views")
+                    m_sweep_views = std::max(int_from_arg(arg, value, m_sweep_views), 1);
+                else if (arg == "--sweep-frames")
+                    m_sweep_frames = std::max(int_from_arg(arg, value, m_sweep_frames), 1);
+                else if (arg == "--sweep-samples" || arg == "--sweep-radii" || arg == "--sweep-rsm-sizes")
+                {
+                    bool valid = arg == "--sweep-samples" ? parse_sweep_list(value, m_sweep_samples) : (arg == "--sweep-radii" ? parse_sweep_list(value, m_sweep_radii) : parse_sweep_list(value, m_sweep_rsm_sizes));
 
-        update_spot_light();
+                    if (!valid)
+                    {
+                        DW_LOG_ERROR("Invalid list for " + arg + ": " + value);
+                        return false;
+                    }
+                }
+                else if (arg == "--samples")
+                    m_num_samples = std::max(int_from_arg(arg, value, m_num_samples), 1);
+                else if (arg == "--radius")
+                    m_sample_radius = float_from_arg(arg, value, m_sample_radius);
+                else if (arg == "--importance-samples")
+                    m_importance_samples = std::max(int_from_arg(arg, value, m_importance_samples), 1);
+                else if (arg == "--temporal-samples")
+                    m_temporal_samples = std::max(int_from_arg(arg, value, m_temporal_samples), 1);
+                else if (arg == "--sample-set-size")
+                    m_samples_texture_size = glm::clamp(int_from_arg(arg, value, m_samples_texture_size), 1, MAX_SAMPLES_TEXTURE_SIZE);
+                else if (arg == "--rsm-size")
+                    m_rsm_resolution = rsm_size_from_arg(int_from_arg(arg, value, m_rsm_resolution));
+                else if (arg == "--indirect-scale")
+                    m_indirect_scale = glm::clamp(float_from_arg(arg, value, m_indirect_scale), MIN_SCALED_INDIRECT, 1.0f);
+                else if (arg == "--target-frame-time")
+                {
+                    m_adaptive_quality  = true;
+                    m_target_frame_time = std::max(float_from_arg(arg, value, m_target_frame_time), 1.0f);
+                }
+                else if (arg == "--instance-grid")
+                    m_instance_grid = glm::clamp(int_from_arg(arg, value, m_instance_grid), 1, MAX_INSTANCE_GRID);
+                else if (arg == "--lights")
+                    m_light_count = glm::clamp(int_from_arg(arg, value, m_light_count), 1, MAX_LIGHTS);
+                else if (arg == "--vpl-count")
+                    m_vpl_count = glm::clamp(int_from_arg(arg, value, m_vpl_count), MIN_VPL_CLUSTERS, MAX_VPL_CLUSTERS);
+                else if (arg == "--sample-set" && sample_set_from_arg(value) != SAMPLE_SET_COUNT)
+                    m_sample_set = sample_set_from_arg(value);
+                else if (arg == "--dither" && value == kDitherModeArgs[DITHER_NONE])
+                    m_dither_mode = DITHER_NONE;
+                else if (arg == "--dither" && value == kDitherModeArgs[DITHER_BAYER])
+                    m_dither_mode = DITHER_BAYER;
+                else if (arg == "--dither" && value == kDitherModeArgs[DITHER_BLUE_NOISE])
+                    m_dither_mode = DITHER_BLUE_NOISE;
+                else if (arg == "--upsample" && value == kUpsampleModeArgs[UPSAMPLE_INTERPOLATE])
+                    m_upsample_mode = UPSAMPLE_INTERPOLATE;
+                else if (arg == "--upsample" && value == kUpsampleModeArgs[UPSAMPLE_JOINT_BILATERAL])
+                    m_upsample_mode = UPSAMPLE_JOINT_BILATERAL;
+                else if (arg == "--upsample-radius")
+                    m_upsample_radius = glm::clamp(int_from_arg(arg, value, m_upsample_radius), 1, 4);
+                else if (arg == "--blur")
+                {
+                    int radius = int_from_arg(arg, value, m_edge_aware_blur ? m_blur_radius : 0);
+
+                    m_edge_aware_blur = radius > 0;
+                    m_blur_radius     = glm::clamp(radius, 1, 8);
+                }
+                else
+                {
+                    DW_LOG_ERROR("Unknown argument: " + arg);
+                    return false;
+                }
+            }
+            else
+            {
+                DW_LOG_ERROR("Unknown argument: " + arg);
+                return false;
+            }
+        }
+
+        if (m_scene_paths.empty())
+            m_scene_paths.push_back("mesh/cornell_box.obj");
+
+        // Sample counts are clamped once all arguments are known, since they depend on the size of the sample set.
+        clamp_sample_counts();
+
+        // The sweep uses the benchmark path for its viewpoints, but runs instead of the benchmark.
+        if (m_sweep_mode)
+        {
+            m_bench_mode = false;
+
+            for (int& samples : m_sweep_samples)
+                samples = glm::clamp(samples, 1, MAX_SAMPLES_TEXTURE_SIZE);
+
+            for (int& size : m_sweep_rsm_sizes)
+                size = rsm_size_from_arg(size);
+        }
+
+        return true;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void create_samples_texture()
+    // Parses the whole value as an integer. Logs and returns 'fallback' for malformed values, so that they are ignored.
+    static int int_from_arg(const std::string& arg, const std::string& value, int fallback)
     {
-        std::default_random_engine            engine;
-        std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+        char* end = nullptr;
 
-        std::vector<glm::vec3> samples;
+        errno       = 0;
+        long result = strtol(value.c_str(), &end, 10);
 
-        for (int i = 0; i < SAMPLES_TEXTURE_SIZE; i++)
+        if (value.empty() || *end != '\0' || errno == ERANGE || result < INT_MIN || result > INT_MAX)
         {
-            float xi1 = dis(engine);
-            float xi2 = dis(engine);
+            DW_LOG_ERROR("Ignoring invalid value for " + arg + ": " + value);
+            return fallback;
+        }
+
+        return int(result);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    static float float_from_arg(const std::string& arg, const std::string& value, float fallback)
+    {
+        char* end = nullptr;
 
-            float x = xi1 * sin(2.0f * M_PI * xi2);
-            float y = xi1 * cos(2.0f * M_PI * xi2);
+        errno        = 0;
+        float result = strtof(value.c_str(), &end);
 
-            samples.push_back(glm::vec3(x, y, xi1));
+        if (value.empty() || *end != '\0' || errno == ERANGE || !std::isfinite(result))
+        {
+            DW_LOG_ERROR("Ignoring invalid value for " + arg + ": " + value);
+            return fallback;
         }
 
-        m_samples_texture = std::make_unique<dw::Texture2D>(SAMPLES_TEXTURE_SIZE, 1, 1, 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT);
-        m_samples_texture->set_data(0, 0, samples.data());
+        return result;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void update_spot_light()
+    // Rounds down to a power of two within [MIN_RSM_SIZE, MAX_RSM_SIZE].
+    static int rsm_size_from_arg(int size)
     {
-        m_light_dir  = glm::normalize(m_light_target - m_light_pos);
-        m_light_view = glm::lookAt(m_light_pos, m_light_pos + m_light_dir, glm::vec3(0.0f, 1.0f, 0.0f));
-        m_light_proj = glm::perspective(glm::radians(2.0f * m_outer_cutoff), 1.0f, 1.0f, 1000.0f);
+        int result = MIN_RSM_SIZE;
+
+        while (result * 2 <= std::min(size, MAX_RSM_SIZE))
+            result *= 2;
+
+        return result;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    bool create_shaders()
+    void clamp_sample_counts()
+    {
+        m_num_samples        = glm::clamp(m_num_samples, 1, m_samples_texture_size);
+        m_importance_samples = glm::clamp(m_importance_samples, 1, m_samples_texture_size);
+        m_temporal_samples   = glm::clamp(m_temporal_samples, 1, m_samples_texture_size);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool load_benchmark_path()
     {
+        if (m_bench_path_file.empty())
+            m_bench_path.create_default();
+        else if (!m_bench_path.load(m_bench_path_file))
         {
-            // Create general shaders
-            m_fullscreen_triangle_vs = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl"));
-            m_direct_fs              = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/direct_light_fs.glsl"));
-            m_indirect_fs            = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/indirect_light_fs.glsl"));
-            m_copy_fs                = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/copy_fs.glsl"));
-            m_rsm_vs                 = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_VERTEX_SHADER, "shader/rsm_vs.glsl"));
-            m_gbuffer_vs             = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_VERTEX_SHADER, "shader/gbuffer_vs.glsl"));
-            m_gbuffer_fs             = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/gbuffer_fs.glsl"));
+            DW_LOG_FATAL("Failed to load benchmark path: " + m_bench_path_file);
+            return false;
+        }
 
-            {
-                if (!m_fullscreen_triangle_vs || !m_direct_fs)
-                {
-                    DW_LOG_FATAL("Failed to create Shaders");
-                    return false;
-                }
+        return true;
+    }
 
-                // Create general shader program
-                dw::Shader* shaders[] = { m_fullscreen_triangle_vs.get(), m_direct_fs.get() };
-                m_direct_program      = std::make_unique<dw::Program>(2, shaders);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-                if (!m_direct_program)
-                {
-                    DW_LOG_FATAL("Failed to create Shader Program");
-                    return false;
-                }
+    bool begin_benchmark()
+    {
+        if (!load_benchmark_path())
+            return false;
 
-                m_direct_program->uniform_block_binding("GlobalUniforms", 0);
-            }
+        // Run without a visible window and without vsync so that the measured times are not capped by the display.
+        glfwHideWindow(m_window);
+        glfwSwapInterval(0);
+
+        // Measure the full frame cost, including frames where the path holds still.
+        m_skip_unchanged_passes = false;
+
+        glGenQueries(BENCH_QUERY_COUNT * 2, &m_bench_queries[0][0]);
+
+        m_bench_frame = 0;
+        m_bench_recorder.reset(m_bench_frames);
+
+        if (!m_trace_output.empty())
+            m_profiler.capture_trace(m_trace_output, m_bench_warmup + m_bench_frames);
+
+        m_bench_recorder.add_setting("renderer", (const char*)glGetString(GL_RENDERER));
+        m_bench_recorder.add_setting("resolution", std::to_string(m_width) + "x" + std::to_string(m_height));
+        m_bench_recorder.add_setting("rsm_size", std::to_string(m_rsm_size));
+        m_bench_recorder.add_setting("render_target_mb", std::to_string(double(m_render_graph.allocated_bytes()) / (1024.0 * 1024.0)));
+        m_bench_recorder.add_setting("light_count", std::to_string(m_light_count));
+        m_bench_recorder.add_setting("scaled_indirect", std::to_string(m_indirect_scale));
+        m_bench_recorder.add_setting("sample_set_size", std::to_string(m_samples_texture_size));
+        m_bench_recorder.add_setting("target_frame_time", m_adaptive_quality ? std::to_string(m_target_frame_time) : "off");
+        m_bench_recorder.add_setting("num_samples", std::to_string(m_num_samples));
+        m_bench_recorder.add_setting("sample_radius", std::to_string(m_sample_radius));
+        m_bench_recorder.add_setting("dither", kDitherModeArgs[m_dither_mode]);
+        m_bench_recorder.add_setting("dither_size", std::to_string(m_dither_size));
+        m_bench_recorder.add_setting("shader_permutations", m_shader_permutations ? "true" : "false");
+        m_bench_recorder.add_setting("sample_set", kSampleSetTypeArgs[m_sample_set]);
+        m_bench_recorder.add_setting("screenspace_interpolation", m_screenspace_interpolation ? "true" : "false");
+        m_bench_recorder.add_setting("upsample", kUpsampleModeArgs[m_upsample_mode]);
+        m_bench_recorder.add_setting("upsample_radius", std::to_string(m_upsample_radius));
+        m_bench_recorder.add_setting("blur_radius", std::to_string(m_edge_aware_blur ? m_blur_radius : 0));
+        m_bench_recorder.add_setting("indirect_lighting", m_rsm_enabled ? "true" : "false");
+        m_bench_recorder.add_setting("compact_gbuffer", m_compact_gbuffer ? "true" : "false");
+        m_bench_recorder.add_setting("packed_rsm", m_packed_rsm ? "true" : "false");
+        m_bench_recorder.add_setting("gather_mode", kIndirectGatherModeNames[m_gather_mode]);
+        m_bench_recorder.add_setting("compute_gather", use_compute_gather() ? "true" : "false");
+        m_bench_recorder.add_setting("multi_draw_indirect", m_multi_draw_indirect ? "true" : "false");
+        m_bench_recorder.add_setting("frustum_culling", m_frustum_culling ? "true" : "false");
+        m_bench_recorder.add_setting("instance_grid", std::to_string(m_instance_grid));
+        m_bench_recorder.add_setting("importance_samples", std::to_string(m_importance_samples));
+        m_bench_recorder.add_setting("vpl_count", std::to_string(vpl_cluster_count()));
+        m_bench_recorder.add_setting("temporal_accumulation", m_temporal_accumulation ? "true" : "false");
+        m_bench_recorder.add_setting("temporal_samples", std::to_string(m_temporal_samples));
+        m_bench_recorder.add_setting("warmup_frames", std::to_string(m_bench_warmup));
 
-            {
-                if (!m_fullscreen_triangle_vs || !m_indirect_fs)
-                {
-                    DW_LOG_FATAL("Failed to create Shaders");
-                    return false;
-                }
+        return true;
+    }
 
-                // Create general shader program
-                dw::Shader* shaders[] = { m_fullscreen_triangle_vs.get(), m_indirect_fs.get() };
-                m_indirect_program    = std::make_unique<dw::Program>(2, shaders);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-                if (!m_indirect_program)
-                {
-                    DW_LOG_FATAL("Failed to create Shader Program");
-                    return false;
-                }
+    void begin_benchmark_frame()
+    {
+        auto now = std::chrono::high_resolution_clock::now();
 
-                m_indirect_program->uniform_block_binding("GlobalUniforms", 0);
-            }
+        int32_t recorded = int32_t(m_bench_frame) - int32_t(m_bench_warmup);
 
-            {
-                if (!m_fullscreen_triangle_vs || !m_copy_fs)
-                {
-                    DW_LOG_FATAL("Failed to create Shaders");
-                    return false;
-                }
+        if (recorded > 0)
+            m_bench_recorder.frame(recorded - 1).frame_ms = std::chrono::duration<double, std::milli>(now - m_bench_frame_start).count();
 
-                // Create general shader program
-                dw::Shader* shaders[] = { m_fullscreen_triangle_vs.get(), m_copy_fs.get() };
-                m_copy_program        = std::make_unique<dw::Program>(2, shaders);
+        m_bench_frame_start = now;
 
-                if (!m_copy_program)
-                {
-                    DW_LOG_FATAL("Failed to create Shader Program");
-                    return false;
-                }
+        // Read back the query issued BENCH_QUERY_COUNT frames ago before it is reused. By now the GPU has almost
+        // certainly finished with it, so this does not stall the pipeline.
+        if (m_bench_frame >= BENCH_QUERY_COUNT)
+            resolve_benchmark_query(m_bench_frame - BENCH_QUERY_COUNT);
 
-                m_copy_program->uniform_block_binding("GlobalUniforms", 0);
-            }
+        // Timestamps rather than an elapsed query around the frame, since the profiler's GL_TIME_ELAPSED scopes can't be
+        // nested inside another active elapsed query.
+        glQueryCounter(m_bench_queries[m_bench_frame % BENCH_QUERY_COUNT][0], GL_TIMESTAMP);
+    }
 
-            {
-                if (!m_rsm_vs || !m_gbuffer_fs)
-                {
-                    DW_LOG_FATAL("Failed to create Shaders");
-                    return false;
-                }
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-                // Create general shader program
-                dw::Shader* shaders[] = { m_rsm_vs.get(), m_gbuffer_fs.get() };
-                m_rsm_program         = std::make_unique<dw::Program>(2, shaders);
+    void end_benchmark_frame()
+    {
+        glQueryCounter(m_bench_queries[m_bench_frame % BENCH_QUERY_COUNT][1], GL_TIMESTAMP);
 
-                if (!m_rsm_program)
-                {
-                    DW_LOG_FATAL("Failed to create Shader Program");
-                    return false;
-                }
+        auto now = std::chrono::high_resolution_clock::now();
+
+        int32_t recorded = int32_t(m_bench_frame) - int32_t(m_bench_warmup);
+
+        if (recorded >= 0)
+            m_bench_recorder.frame(recorded).cpu_ms = std::chrono::duration<double, std::milli>(now - m_bench_frame_start).count();
+
+        m_bench_frame++;
+
+        if (m_bench_frame == m_bench_warmup + m_bench_frames)
+        {
+            glFinish();
+
+            uint32_t first = m_bench_frame > BENCH_QUERY_COUNT ? m_bench_frame - BENCH_QUERY_COUNT : 0;
+
+            for (uint32_t i = first; i < m_bench_frame; i++)
+                resolve_benchmark_query(i);
+
+            // The final frame has no successor to measure its full duration against.
+            BenchmarkRecorder::Frame& last = m_bench_recorder.frame(m_bench_frames - 1);
+            last.frame_ms                  = std::max(last.cpu_ms, last.gpu_ms);
+
+            for (const auto& pass : m_profiler.results())
+                m_bench_recorder.add_pass(pass.name, pass.cpu_ms, pass.has_gpu ? pass.gpu_ms : -1.0);
+
+            if (m_bench_recorder.write_json(m_bench_output))
+                DW_LOG_INFO("Benchmark results written to " + m_bench_output);
+            else
+                DW_LOG_ERROR("Failed to write benchmark results to " + m_bench_output);
+
+            m_profiler.flush_trace();
+
+            request_exit();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void resolve_benchmark_query(uint32_t frame)
+    {
+        GLuint64 start = 0;
+        GLuint64 end   = 0;
+        glGetQueryObjectui64v(m_bench_queries[frame % BENCH_QUERY_COUNT][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(m_bench_queries[frame % BENCH_QUERY_COUNT][1], GL_QUERY_RESULT, &end);
+
+        if (frame >= m_bench_warmup)
+            m_bench_recorder.frame(frame - m_bench_warmup).gpu_ms = double(end - start) / 1000000.0;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_benchmark_path()
+    {
+        uint32_t total = m_bench_warmup + m_bench_frames;
+        float    t     = total > 1 ? float(m_bench_frame) / float(total - 1) : 0.0f;
+
+        apply_benchmark_keyframe(m_bench_path.evaluate(t));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void apply_benchmark_keyframe(const BenchmarkKeyframe& key)
+    {
+        m_light_pos    = key.light_pos;
+        m_light_target = key.light_target;
+
+        update_spot_light();
+
+        // Drive the camera matrices directly so that the path is independent of frame time.
+        dw::Camera* current = m_main_camera.get();
+
+        current->m_position = key.camera_pos;
+        current->m_forward  = glm::normalize(key.camera_target - key.camera_pos);
+        current->m_right    = glm::normalize(glm::cross(current->m_forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        current->m_up       = glm::normalize(glm::cross(current->m_right, current->m_forward));
+        current->m_view     = glm::lookAt(key.camera_pos, key.camera_target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        update_transforms(current);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Renders every configuration of the sweep from m_sweep_views viewpoints spread along the benchmark path. Each
+    // viewpoint first renders a reference for the sample radius of the configurations that follow, and every configuration
+    // then runs SWEEP_WARMUP_FRAMES frames, so that the profiler only resolves frames rendered with it, followed by
+    // m_sweep_frames measured frames. The last one is read back and compared with the reference.
+    bool begin_sweep()
+    {
+        if (!load_benchmark_path())
+            return false;
+
+        glfwHideWindow(m_window);
+        glfwSwapInterval(0);
+
+        m_skip_unchanged_passes = false;
+        m_adaptive_quality      = false;
+        m_temporal_accumulation = false;
+
+        // Only the indirect lighting is compared, so the composite holds nothing else.
+        m_rsm_enabled   = true;
+        m_indirect_only = true;
+
+        // The reference gathers the whole set, and the prefixes of it are the sets of the smaller sample counts.
+        m_samples_texture_size = MAX_SAMPLES_TEXTURE_SIZE;
+        create_samples_texture();
+
+        // The gather sums its samples instead of averaging them, so every configuration is scaled to the brightness the
+        // light amount gives at the sample count the sweep was started with.
+        m_sweep_base_samples = m_num_samples;
+        m_sweep_light_amount = m_indirect_light_amount;
+
+        m_sweep.build(m_sweep_samples, m_sweep_radii, m_sweep_rsm_sizes);
+
+        m_sweep_view      = 0;
+        m_sweep_config    = 0;
+        m_sweep_frame     = 0;
+        m_sweep_reference = true;
+
+        DW_LOG_INFO("Sweeping " + std::to_string(m_sweep.configs().size()) + " configurations from " + std::to_string(m_sweep_views) + " viewpoints on " + (const char*)glGetString(GL_RENDERER));
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The reference uses the full sample set at full resolution from the largest RSM without a dither pattern, and is
+    // averaged over SWEEP_REFERENCE_ROTATIONS rotations of the pattern.
+    void apply_sweep_settings()
+    {
+        const SweepConfig& config = m_sweep.configs()[m_sweep_config];
+
+        bool dither = !m_sweep_reference && config.dither;
+
+        m_num_samples               = m_sweep_reference ? MAX_SAMPLES_TEXTURE_SIZE : config.num_samples;
+        m_sample_radius             = config.sample_radius;
+        m_screenspace_interpolation = !m_sweep_reference && config.interpolation;
+        m_rsm_resolution            = m_sweep_reference ? MAX_RSM_SIZE : config.rsm_size;
+        m_indirect_light_amount     = m_sweep_light_amount * float(m_sweep_base_samples) / float(m_num_samples);
+
+        if ((m_dither_mode != DITHER_NONE) != dither)
+        {
+            m_dither_mode = dither ? DITHER_BLUE_NOISE : DITHER_NONE;
+            create_dither_texture();
+        }
+
+        // Viewpoints sit in the middle of equal parts of the path, since paths usually end where they start.
+        apply_benchmark_keyframe(m_bench_path.evaluate((float(m_sweep_view) + 0.5f) / float(m_sweep_views)));
+
+        m_sweep_gpu_ms     = 0.0;
+        m_sweep_gpu_frames = 0;
+
+        m_settings_version++;
+        build_render_graph();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void begin_sweep_frame()
+    {
+        if (m_sweep_frame == 0)
+            apply_sweep_settings();
+
+        m_pattern_rotation = m_sweep_reference ? float(m_sweep_frame) / float(SWEEP_REFERENCE_ROTATIONS) : 0.0f;
+
+        // The profiler has just resolved the frame PROFILER_FRAMES_IN_FLIGHT frames back, which skips the first frame of
+        // the configuration where the render targets were allocated.
+        if (!m_sweep_reference && m_sweep_frame >= SWEEP_WARMUP_FRAMES)
+        {
+            double gpu_ms = m_profiler.last_gpu_time("indirect_lighting");
+
+            if (gpu_ms >= 0.0)
+            {
+                m_sweep_gpu_ms += gpu_ms;
+                m_sweep_gpu_frames++;
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void end_sweep_frame()
+    {
+        m_sweep_frame++;
+
+        if (m_sweep_reference)
+        {
+            read_texture(m_composite_rt, m_width, m_height, m_sweep_image);
+
+            if (m_sweep_frame == 1)
+                m_sweep_reference_image = m_sweep_image;
+            else
+            {
+                for (size_t i = 0; i < m_sweep_image.data.size(); i++)
+                    m_sweep_reference_image.data[i] += m_sweep_image.data[i];
+            }
+
+            if (m_sweep_frame < SWEEP_REFERENCE_ROTATIONS)
+                return;
+
+            for (float& value : m_sweep_reference_image.data)
+                value *= 1.0f / float(SWEEP_REFERENCE_ROTATIONS);
+
+            m_sweep_reference = false;
+            m_sweep_frame     = 0;
+
+            return;
+        }
+
+        if (m_sweep_frame < SWEEP_WARMUP_FRAMES + m_sweep_frames)
+            return;
+
+        read_texture(m_composite_rt, m_width, m_height, m_sweep_image);
+
+        RsmImageError      error  = rsm_image_error(m_sweep_image, m_sweep_reference_image);
+        const SweepConfig& config = m_sweep.configs()[m_sweep_config];
+        double             gpu_ms = m_sweep_gpu_frames > 0 ? m_sweep_gpu_ms / double(m_sweep_gpu_frames) : -1.0;
+
+        m_sweep.add_result({ m_sweep_config, m_sweep_view, gpu_ms, error.rmse, error.psnr });
+
+        int index = m_sweep_view * int(m_sweep.configs().size()) + m_sweep_config + 1;
+        int total = m_sweep_views * int(m_sweep.configs().size());
+
+        DW_LOG_INFO("Sweep " + std::to_string(index) + "/" + std::to_string(total) + ": " + std::to_string(config.num_samples) + " samples, radius " + std::to_string(config.sample_radius) + ", RSM " + std::to_string(config.rsm_size) + (config.dither ? ", dither" : "") + (config.interpolation ? ", interpolation" : "") + " - " + std::to_string(gpu_ms) + " ms, " + std::to_string(error.psnr) + " dB");
+
+        m_sweep_frame = 0;
+
+        if (++m_sweep_config == int(m_sweep.configs().size()))
+        {
+            m_sweep_config = 0;
+
+            if (++m_sweep_view == m_sweep_views)
+            {
+                finish_sweep();
+                return;
+            }
+        }
+
+        // Every viewpoint and sample radius needs its own reference.
+        m_sweep_reference = m_sweep_config == 0 || m_sweep.configs()[m_sweep_config].sample_radius != m_sweep.configs()[m_sweep_config - 1].sample_radius;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void finish_sweep()
+    {
+        size_t      extension   = m_sweep_output.rfind(".csv");
+        std::string pareto_path = (extension == std::string::npos ? m_sweep_output : m_sweep_output.substr(0, extension)) + "_pareto.csv";
+
+        if (m_sweep.write_csv(m_sweep_output) && m_sweep.write_pareto_csv(pareto_path))
+            DW_LOG_INFO("Sweep results written to " + m_sweep_output + " and " + pareto_path);
+        else
+            DW_LOG_ERROR("Failed to write sweep results to " + m_sweep_output + " and " + pareto_path);
+
+        request_exit();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_spot_light()
+    {
+        m_inner_cutoff    = 10.0f;
+        m_outer_cutoff    = 15.0f;
+        m_light_intensity = 1.0f;
+        m_light_range     = 100.0f;
+        m_light_bias      = 0.001f;
+        m_light_color     = glm::vec3(1.0f, 1.0f, 1.0f);
+        m_light_pos       = glm::vec3(0.0f, 7.0f, 30.0f);
+        m_light_target    = glm::vec3(-6.0f, 7.0f, 0.0f);
+
+        update_spot_light();
+        create_extra_lights();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Places the lights beyond the main light on a deterministic spiral in front of the box, aimed at random points inside
+    // it and with varying hues.
+    void create_extra_lights()
+    {
+        std::default_random_engine            engine;
+        std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+
+        m_extra_lights.resize(m_light_count - 1);
+
+        for (int i = 0; i < m_light_count - 1; i++)
+        {
+            float angle = float(i) * 2.39996f;
+            float hue   = fmodf(float(i) * 0.618034f, 1.0f) * 6.0f;
+
+            SpotLight& light = m_extra_lights[i];
+
+            light.position  = glm::vec3(12.0f * sinf(angle), 10.0f + 6.0f * cosf(angle), 28.0f);
+            light.target    = glm::vec3(dis(engine) * 16.0f - 8.0f, dis(engine) * 16.0f + 2.0f, dis(engine) * 8.0f - 8.0f);
+            light.color     = glm::clamp(glm::vec3(fabsf(hue - 3.0f) - 1.0f, 2.0f - fabsf(hue - 2.0f), 2.0f - fabsf(hue - 4.0f)), 0.0f, 1.0f) * 0.5f + 0.5f;
+            light.intensity = 1.0f;
+        }
+
+        m_light_estimates.clear();
+
+        // A new light count leaves RSM layers that were never rendered, even when the array keeps its size. The light
+        // uniforms, which the layered RSM pass and its culling read the matrices of every layer from, are pushed after the
+        // UI, so the re-render sees valid data for the new lights.
+        m_light_version++;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The gather uses the first u_NumSamples offsets and windows of the set, so the set types are all chosen such that
+    // prefixes of them are well distributed too.
+    void create_samples_texture()
+    {
+        std::vector<SamplePoint> points;
+        std::vector<float>       offsets;
+
+        generate_sample_set(SampleSetType(m_sample_set), m_samples_texture_size, points);
+        polar_sample_offsets(points, offsets);
+
+        m_samples.clear();
+
+        for (int i = 0; i < m_samples_texture_size; i++)
+            m_samples.push_back(glm::vec3(offsets[i * 3], offsets[i * 3 + 1], offsets[i * 3 + 2]));
+
+        // Permutations with the offsets baked in are stale now.
+        m_gather_permutations.clear();
+
+        m_samples_texture = std::make_unique<dw::Texture2D>(m_samples_texture_size, 1, 1, 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT);
+        m_samples_texture->set_data(0, 0, m_samples.data());
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_spot_light()
+    {
+        m_light_dir  = glm::normalize(m_light_target - m_light_pos);
+        m_light_view = glm::lookAt(m_light_pos, m_light_pos + m_light_dir, glm::vec3(0.0f, 1.0f, 0.0f));
+        m_light_proj = glm::perspective(glm::radians(2.0f * m_outer_cutoff), 1.0f, 1.0f, 1000.0f);
+
+        m_light_version++;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool create_shaders()
+    {
+        // Shader changes select different lighting paths.
+        m_settings_version++;
+
+        {
+            // Shaders that read or write the G-buffer are compiled for the active G-buffer layout.
+            std::vector<std::string> gbuffer_defines;
+
+            if (m_compact_gbuffer)
+                gbuffer_defines.push_back("COMPACT_GBUFFER");
+
+            // Scene shaders read their material from the per-draw material buffer when drawn with a multi-draw.
+            std::vector<std::string> draw_defines;
+            std::vector<std::string> gbuffer_draw_defines = gbuffer_defines;
+
+            if (m_multi_draw_indirect)
+            {
+                draw_defines.push_back("MULTI_DRAW_INDIRECT");
+                gbuffer_draw_defines.push_back("MULTI_DRAW_INDIRECT");
+            }
+
+            // Shaders that write or read the RSM are compiled for the active RSM layout.
+            std::vector<std::string> rsm_defines;
+            std::vector<std::string> rsm_draw_defines = draw_defines;
+
+            if (m_packed_rsm)
+            {
+                rsm_defines.push_back("PACKED_RSM");
+                rsm_draw_defines.push_back("PACKED_RSM");
+            }
+
+            std::vector<std::string> indirect_defines = gbuffer_defines;
+
+            indirect_defines.insert(indirect_defines.end(), rsm_defines.begin(), rsm_defines.end());
+
+            if (m_gather_mode == INDIRECT_GATHER_IMPORTANCE)
+                indirect_defines.push_back("IMPORTANCE_SAMPLING");
+            else if (m_gather_mode == INDIRECT_GATHER_CLUSTERS)
+                indirect_defines.push_back("VPL_CLUSTERS");
+
+            // The compute gather covers the polar and clustered modes, importance sampling always uses the fragment path.
+            std::vector<std::string> indirect_compute_defines = gbuffer_defines;
+
+            indirect_compute_defines.insert(indirect_compute_defines.end(), rsm_defines.begin(), rsm_defines.end());
+
+            if (m_gather_mode == INDIRECT_GATHER_CLUSTERS)
+                indirect_compute_defines.push_back("VPL_CLUSTERS");
+
+            // The generic gather programs read the dither mode and sample count from uniforms, the permutations specialized
+            // for the current settings are compiled on first use in gather_program().
+            m_indirect_defines         = indirect_defines;
+            m_indirect_compute_defines = indirect_compute_defines;
+            m_gather_permutations.clear();
+
+            // Programs come out of the binary cache when their sources, defines and the driver are unchanged.
+            m_direct_program             = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "shader/direct_light_fs.glsl", gbuffer_defines } });
+            m_indirect_program           = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "shader/indirect_light_fs.glsl", indirect_defines } });
+            m_indirect_compute_program   = m_program_cache.create({ { GL_COMPUTE_SHADER, "shader/indirect_light_cs.glsl", indirect_compute_defines } });
+            m_copy_program               = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "shader/copy_fs.glsl", {} } });
+            m_interpolate_program        = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "shader/interpolate_indirect_fs.glsl", gbuffer_defines } });
+            m_upsample_program           = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "shader/upsample_indirect_fs.glsl", gbuffer_defines } });
+            m_blur_program               = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "shader/edge_aware_blur_fs.glsl", gbuffer_defines } });
+            m_temporal_program           = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "shader/temporal_accumulation_fs.glsl", gbuffer_defines } });
+            std::vector<std::string> cluster_init_defines = rsm_defines;
+
+            cluster_init_defines.push_back("CLUSTER_INIT");
+
+            m_rsm_luminance_program      = m_program_cache.create({ { GL_COMPUTE_SHADER, "shader/rsm_luminance_cs.glsl", rsm_defines } });
+            m_vpl_cluster_init_program   = m_program_cache.create({ { GL_COMPUTE_SHADER, "shader/vpl_cluster_update_cs.glsl", cluster_init_defines } });
+            m_vpl_cluster_assign_program = m_program_cache.create({ { GL_COMPUTE_SHADER, "shader/vpl_cluster_assign_cs.glsl", rsm_defines } });
+            m_vpl_cluster_update_program = m_program_cache.create({ { GL_COMPUTE_SHADER, "shader/vpl_cluster_update_cs.glsl", rsm_defines } });
+            m_rsm_program                = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/rsm_vs.glsl", draw_defines }, { GL_GEOMETRY_SHADER, "shader/rsm_gs.glsl", draw_defines }, { GL_FRAGMENT_SHADER, "shader/gbuffer_fs.glsl", rsm_draw_defines } });
+            m_gbuffer_program            = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/gbuffer_vs.glsl", draw_defines }, { GL_FRAGMENT_SHADER, "shader/gbuffer_fs.glsl", gbuffer_draw_defines } });
+
+            if (!m_direct_program || !m_indirect_program || !m_indirect_compute_program || !m_copy_program || !m_interpolate_program || !m_upsample_program || !m_blur_program || !m_temporal_program || !m_rsm_luminance_program || !m_vpl_cluster_init_program || !m_vpl_cluster_assign_program || !m_vpl_cluster_update_program || !m_rsm_program || !m_gbuffer_program)
+            {
+                DW_LOG_FATAL("Failed to create Shader Program");
+                return false;
+            }
+
+            m_direct_program->uniform_block_binding("GlobalUniforms", 0);
+            m_direct_program->uniform_block_binding("LightUniforms", 2);
+            m_indirect_program->uniform_block_binding("GlobalUniforms", 0);
+            m_indirect_program->uniform_block_binding("LightUniforms", 2);
+            m_indirect_compute_program->uniform_block_binding("GlobalUniforms", 0);
+            m_indirect_compute_program->uniform_block_binding("LightUniforms", 2);
+            m_copy_program->uniform_block_binding("GlobalUniforms", 0);
+            m_interpolate_program->uniform_block_binding("GlobalUniforms", 0);
+            m_upsample_program->uniform_block_binding("GlobalUniforms", 0);
+            m_blur_program->uniform_block_binding("GlobalUniforms", 0);
+            m_temporal_program->uniform_block_binding("GlobalUniforms", 0);
+            m_rsm_luminance_program->uniform_block_binding("LightUniforms", 2);
+            m_vpl_cluster_init_program->uniform_block_binding("LightUniforms", 2);
+            m_vpl_cluster_assign_program->uniform_block_binding("LightUniforms", 2);
+            m_vpl_cluster_update_program->uniform_block_binding("LightUniforms", 2);
+            m_rsm_program->uniform_block_binding("GlobalUniforms", 0);
+            m_rsm_program->uniform_block_binding("LightUniforms", 2);
+            m_gbuffer_program->uniform_block_binding("GlobalUniforms", 0);
+        }
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Declares the targets of a frame and the passes that use them, in the order update() runs them, and recreates the
+    // framebuffers if any target got a different texture. Called again whenever the window size or a setting that adds or
+    // removes passes changes. Targets that no enabled pass uses are not allocated, and the RSM targets survive resizes.
+    void build_render_graph()
+    {
+        // One RSM layer per light. The layer resolution drops as lights are added so that the arrays stay within the memory
+        // of four full size RSMs. dw::Texture2D only creates an array texture for more than one layer, so there are always
+        // at least two.
+        m_rsm_size        = m_light_count <= 4 ? m_rsm_resolution : (m_light_count <= 16 ? m_rsm_resolution / 2 : m_rsm_resolution / 4);
+        int rsm_layers    = std::max(m_light_count, 2);
+        int rsm_mip_count = int(log2(m_rsm_size)) + 1;
+        int width         = int(m_width);
+        int height        = int(m_height);
+        int scaled_width  = scaled_indirect_size().x;
+        int scaled_height = scaled_indirect_size().y;
+
+        m_render_graph.begin();
+
+        // The G-buffer, RSM, composite and history are persistent, since update() skips the passes that write them while
+        // their inputs are unchanged. Everything else lives within the lighting passes of one frame.
+        RenderTarget gbuffer_albedo    = m_render_graph.create_target("gbuffer_albedo", { width, height, 1, 1, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE }, true);
+        RenderTarget gbuffer_depth     = m_render_graph.create_target("gbuffer_depth", { width, height, 1, 1, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT }, true);
+        RenderTarget gbuffer_normals   = RENDER_TARGET_NONE;
+        RenderTarget gbuffer_world_pos = RENDER_TARGET_NONE;
+
+        if (m_compact_gbuffer)
+        {
+            // Octahedral encoded normals, world position is reconstructed from depth.
+            gbuffer_normals = m_render_graph.create_target("gbuffer_normals", { width, height, 1, 1, GL_RG16_SNORM, GL_RG, GL_SHORT }, true);
+        }
+        else
+        {
+            gbuffer_normals   = m_render_graph.create_target("gbuffer_normals", { width, height, 1, 1, GL_RGB16F, GL_RGB, GL_HALF_FLOAT }, true);
+            gbuffer_world_pos = m_render_graph.create_target("gbuffer_world_pos", { width, height, 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT }, true);
+        }
+
+        RenderTarget rsm_flux      = RENDER_TARGET_NONE;
+        RenderTarget rsm_normals   = RENDER_TARGET_NONE;
+        RenderTarget rsm_world_pos = RENDER_TARGET_NONE;
+        RenderTarget rsm_packed    = RENDER_TARGET_NONE;
+
+        if (m_packed_rsm)
+        {
+            // Depth, octahedral normal and flux of a VPL in one texel, so that reading it takes a single fetch.
+            rsm_packed = m_render_graph.create_target("rsm_packed", { m_rsm_size, m_rsm_size, rsm_layers, 1, GL_RGBA32UI, GL_RGBA_INTEGER, GL_UNSIGNED_INT }, true);
+        }
+        else
+        {
+            rsm_flux      = m_render_graph.create_target("rsm_flux", { m_rsm_size, m_rsm_size, rsm_layers, 1, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE }, true);
+            rsm_normals   = m_render_graph.create_target("rsm_normals", { m_rsm_size, m_rsm_size, rsm_layers, 1, GL_RGB16F, GL_RGB, GL_HALF_FLOAT }, true);
+            rsm_world_pos = m_render_graph.create_target("rsm_world_pos", { m_rsm_size, m_rsm_size, rsm_layers, 1, GL_RGB32F, GL_RGB, GL_FLOAT }, true);
+        }
+
+        RenderTarget rsm_depth = m_render_graph.create_target("rsm_depth", { m_rsm_size, m_rsm_size, rsm_layers, 1, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT }, true);
+        RenderTarget composite = m_render_graph.create_target("composite", { width, height, 1, 1, GL_RGB16F, GL_RGB, GL_HALF_FLOAT }, true);
+
+        RenderTarget history[2];
+        RenderTarget history_geometry[2];
+
+        // Ping-ponged temporal history: accumulated indirect light with the history length in alpha, and the normal and view
+        // depth it was accumulated for.
+        for (int i = 0; i < 2; i++)
+        {
+            history[i]          = m_render_graph.create_target("history_" + std::to_string(i), { width, height, 1, 1, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT }, true);
+            history_geometry[i] = m_render_graph.create_target("history_geometry_" + std::to_string(i), { width, height, 1, 1, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT }, true);
+        }
+
+        // Full mip chain of the attenuated flux luminance, only read with texelFetch.
+        RenderTarget rsm_luminance = m_render_graph.create_target("rsm_luminance", { m_rsm_size, m_rsm_size, rsm_layers, rsm_mip_count, GL_R32F, GL_RED, GL_FLOAT }, false);
+
+        // Index of the VPL cluster each RSM texel belongs to.
+        RenderTarget vpl_labels = m_render_graph.create_target("vpl_labels", { m_rsm_size, m_rsm_size, rsm_layers, 1, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT }, false);
+
+        // RGBA so that the compute gather can write them as images.
+        RenderTarget indirect         = m_render_graph.create_target("indirect", { width, height, 1, 1, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT }, false);
+        RenderTarget scaled_indirect  = m_render_graph.create_target("scaled_indirect", { scaled_width, scaled_height, 1, 1, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT }, false);
+        RenderTarget indirect_stencil = m_render_graph.create_target("indirect_stencil", { width, height, 1, 1, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8 }, false);
+        RenderTarget blur             = m_render_graph.create_target("blur", { width, height, 1, 1, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT }, false);
+
+        std::vector<RenderTarget> gbuffer = { gbuffer_albedo, gbuffer_normals, gbuffer_world_pos, gbuffer_depth };
+        std::vector<RenderTarget> rsm     = { rsm_flux, rsm_normals, rsm_world_pos, rsm_packed };
+
+        m_render_graph.add_pass("rsm", {}, { rsm_flux, rsm_normals, rsm_world_pos, rsm_packed, rsm_depth });
+        m_render_graph.add_pass("gbuffer", {}, gbuffer);
+
+        if (!m_indirect_only)
+            m_render_graph.add_pass("direct_lighting", { gbuffer_albedo, gbuffer_normals, gbuffer_world_pos, gbuffer_depth, rsm_depth }, { composite });
+
+        if (m_rsm_enabled || m_indirect_only)
+        {
+            RenderTarget gather_luminance = RENDER_TARGET_NONE;
+
+            if (m_gather_mode == INDIRECT_GATHER_CLUSTERS)
+                m_render_graph.add_pass("cluster_vpls", rsm, { vpl_labels });
+            else if (m_gather_mode == INDIRECT_GATHER_IMPORTANCE || m_light_count > 1)
+            {
+                m_render_graph.add_pass("build_flux_pyramid", { rsm_flux, rsm_world_pos, rsm_packed }, { rsm_luminance });
+
+                if (m_gather_mode == INDIRECT_GATHER_IMPORTANCE)
+                    gather_luminance = rsm_luminance;
+            }
+
+            std::vector<RenderTarget> gather_reads = { gbuffer_normals, gbuffer_world_pos, gbuffer_depth, rsm_flux, rsm_normals, rsm_world_pos, rsm_packed, gather_luminance };
+
+            if (m_screenspace_interpolation)
+            {
+                m_render_graph.add_pass("gather_low_res", gather_reads, { scaled_indirect });
+                m_render_graph.add_pass("interpolate_indirect", { scaled_indirect, gbuffer_normals, gbuffer_world_pos, gbuffer_depth }, { indirect, indirect_stencil });
+                m_render_graph.add_pass("gather_refine", gather_reads, { indirect, indirect_stencil });
+            }
+            else
+                m_render_graph.add_pass("gather", gather_reads, { indirect });
+
+            if (m_edge_aware_blur)
+                m_render_graph.add_pass("blur_indirect", { indirect, gbuffer_normals, gbuffer_world_pos, gbuffer_depth }, { blur, indirect });
+
+            if (m_temporal_accumulation)
+            {
+                m_render_graph.add_pass("temporal_accumulation", { indirect, history[0], history[1], history_geometry[0], history_geometry[1], gbuffer_normals, gbuffer_world_pos, gbuffer_depth }, { history[0], history[1], history_geometry[0], history_geometry[1] });
+                m_render_graph.add_pass("copy_indirect", { history[0], history[1] }, { composite });
+            }
+            else
+                m_render_graph.add_pass("copy_indirect", { indirect }, { composite });
+        }
+
+        m_render_graph.add_pass("present", { composite }, {});
+
+        if (!m_render_graph.compile())
+            return;
+
+        m_gbuffer_albedo_rt    = m_render_graph.texture(gbuffer_albedo);
+        m_gbuffer_normals_rt   = m_render_graph.texture(gbuffer_normals);
+        m_gbuffer_world_pos_rt = m_render_graph.texture(gbuffer_world_pos);
+        m_gbuffer_depth_rt     = m_render_graph.texture(gbuffer_depth);
+        m_rsm_flux_rt          = m_render_graph.texture(rsm_flux);
+        m_rsm_normals_rt       = m_render_graph.texture(rsm_normals);
+        m_rsm_world_pos_rt     = m_render_graph.texture(rsm_world_pos);
+        m_rsm_packed_rt        = m_render_graph.texture(rsm_packed);
+        m_rsm_depth_rt         = m_render_graph.texture(rsm_depth);
+        m_rsm_luminance_rt     = m_render_graph.texture(rsm_luminance);
+        m_vpl_labels           = m_render_graph.texture(vpl_labels);
+        m_composite_rt         = m_render_graph.texture(composite);
+        m_indirect_rt          = m_render_graph.texture(indirect);
+        m_scaled_indirect_rt   = m_render_graph.texture(scaled_indirect);
+        m_indirect_stencil_rt  = m_render_graph.texture(indirect_stencil);
+        m_blur_rt              = m_render_graph.texture(blur);
+
+        for (int i = 0; i < 2; i++)
+        {
+            m_history_rt[i]          = m_render_graph.texture(history[i]);
+            m_history_geometry_rt[i] = m_render_graph.texture(history_geometry[i]);
+        }
+
+        // New textures hold no results yet. Only rerun the RSM if one of its own targets is new, a resize just needs the
+        // camera dependent passes.
+        if (m_render_graph.reallocated(rsm_flux) || m_render_graph.reallocated(rsm_normals) || m_render_graph.reallocated(rsm_world_pos) || m_render_graph.reallocated(rsm_packed) || m_render_graph.reallocated(rsm_depth))
+            m_scene_version++;
+        else
+            m_camera_version++;
+
+        if (m_render_graph.reallocated(history[0]) || m_render_graph.reallocated(history[1]) || m_render_graph.reallocated(history_geometry[0]) || m_render_graph.reallocated(history_geometry[1]))
+            m_history_valid = false;
+
+        if (m_rsm_luminance_rt)
+        {
+            m_rsm_luminance_rt->set_min_filter(GL_NEAREST_MIPMAP_NEAREST);
+            m_rsm_luminance_rt->set_mag_filter(GL_NEAREST);
+            m_rsm_luminance_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        }
+
+        if (m_vpl_labels)
+        {
+            m_vpl_labels->set_min_filter(GL_NEAREST);
+            m_vpl_labels->set_mag_filter(GL_NEAREST);
+        }
+
+        m_gbuffer_albedo_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        m_gbuffer_normals_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        m_gbuffer_depth_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+        if (m_gbuffer_world_pos_rt)
+            m_gbuffer_world_pos_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+        for (dw::Texture2D* rt : { m_rsm_flux_rt, m_rsm_normals_rt, m_rsm_world_pos_rt, m_rsm_depth_rt })
+        {
+            if (!rt)
+                continue;
+
+            rt->set_wrapping(GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER);
+            rt->set_border_color(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+
+        // Integer textures can't be filtered. The gathers fetch it by texel and treat coordinates outside it as black.
+        if (m_rsm_packed_rt)
+        {
+            m_rsm_packed_rt->set_min_filter(GL_NEAREST);
+            m_rsm_packed_rt->set_mag_filter(GL_NEAREST);
+            m_rsm_packed_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (m_history_rt[i])
+                m_history_rt[i]->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+            if (m_history_geometry_rt[i])
+                m_history_geometry_rt[i]->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        }
+
+        create_framebuffers();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Framebuffers are cheap, so they are all recreated with the graph. Passes that are disabled get none.
+    void create_framebuffers()
+    {
+        m_gbuffer_fbo = std::make_unique<dw::Framebuffer>();
+
+        dw::Texture* gbuffer_rts[] = { m_gbuffer_albedo_rt, m_gbuffer_normals_rt, m_gbuffer_world_pos_rt };
+        m_gbuffer_fbo->attach_multiple_render_targets(m_compact_gbuffer ? 2 : 3, gbuffer_rts);
+        m_gbuffer_fbo->attach_depth_stencil_target(m_gbuffer_depth_rt, 0, 0);
+
+        // dw::Framebuffer attaches single layers, the RSM needs every layer attached so that the geometry shader can pick one.
+        m_rsm_fbo = std::make_unique<dw::Framebuffer>();
+
+        GLenum rsm_draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_rsm_fbo->id());
+
+        if (m_packed_rsm)
+        {
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_rsm_packed_rt->id(), 0);
+            glDrawBuffers(1, rsm_draw_buffers);
+        }
+        else
+        {
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_rsm_flux_rt->id(), 0);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, m_rsm_normals_rt->id(), 0);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, m_rsm_world_pos_rt->id(), 0);
+            glDrawBuffers(3, rsm_draw_buffers);
+        }
+
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_rsm_depth_rt->id(), 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            DW_LOG_ERROR("Layered RSM framebuffer is incomplete");
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        m_composite_fbo = std::make_unique<dw::Framebuffer>();
+        m_composite_fbo->attach_render_target(0, m_composite_rt, 0, 0);
+
+        m_indirect_fbo.reset();
+        m_scaled_indirect_fbo.reset();
+        m_blur_fbo.reset();
+
+        if (m_indirect_rt)
+        {
+            m_indirect_fbo = std::make_unique<dw::Framebuffer>();
+            m_indirect_fbo->attach_render_target(0, m_indirect_rt, 0, 0);
+
+            // The stencil only exists for the refinement after screen space interpolation.
+            if (m_indirect_stencil_rt)
+                m_indirect_fbo->attach_depth_stencil_target(m_indirect_stencil_rt, 0, 0);
+        }
+
+        if (m_scaled_indirect_rt)
+        {
+            m_scaled_indirect_fbo = std::make_unique<dw::Framebuffer>();
+            m_scaled_indirect_fbo->attach_render_target(0, m_scaled_indirect_rt, 0, 0);
+        }
+
+        if (m_blur_rt)
+        {
+            m_blur_fbo = std::make_unique<dw::Framebuffer>();
+            m_blur_fbo->attach_render_target(0, m_blur_rt, 0, 0);
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            m_history_fbo[i].reset();
+
+            if (!m_history_rt[i])
+                continue;
+
+            m_history_fbo[i] = std::make_unique<dw::Framebuffer>();
+
+            dw::Texture* history_rts[] = { m_history_rt[i], m_history_geometry_rt[i] };
+            m_history_fbo[i]->attach_multiple_render_targets(2, history_rts);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_dither_texture()
+    {
+        std::vector<uint8_t> dither;
+
+        if (m_dither_mode == DITHER_BLUE_NOISE)
+        {
+            std::vector<float> noise;
+            generate_blue_noise(BLUE_NOISE_SIZE, noise);
+
+            for (float value : noise)
+                dither.push_back(uint8_t(value * 255.0f));
+
+            m_dither_size = BLUE_NOISE_SIZE;
+        }
+        else
+            m_dither_size = create_bayer_matrix(dither);
+
+        m_dither_texture = std::make_unique<dw::Texture2D>(m_dither_size, m_dither_size, 1, 1, 1, GL_R8, GL_RED, GL_UNSIGNED_BYTE);
+        m_dither_texture->set_min_filter(GL_NEAREST);
+        m_dither_texture->set_mag_filter(GL_NEAREST);
+        m_dither_texture->set_wrapping(GL_REPEAT, GL_REPEAT, GL_REPEAT);
+        m_dither_texture->set_data(0, 0, dither.data());
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Returns the size of the matrix.
+    int create_bayer_matrix(std::vector<uint8_t>& dither)
+    {
+        // The 8x8 matrix spreads the offsets over 64 levels instead of 16, at the cost of a larger repeating pattern.
+        int i           = 0;
+        int dither_size = m_bayer_8x8 ? 8 : 4;
+
+        dither.resize(dither_size * dither_size);
+
+        if (m_bayer_8x8)
+        {
+            dither[i++] = (1.0f / 65.0f * 255);
+            dither[i++] = (49.0f / 65.0f * 255);
+            dither[i++] = (13.0f / 65.0f * 255);
+            dither[i++] = (61.0f / 65.0f * 255);
+            dither[i++] = (4.0f / 65.0f * 255);
+            dither[i++] = (52.0f / 65.0f * 255);
+            dither[i++] = (16.0f / 65.0f * 255);
+            dither[i++] = (64.0f / 65.0f * 255);
+
+            dither[i++] = (33.0f / 65.0f * 255);
+            dither[i++] = (17.0f / 65.0f * 255);
+            dither[i++] = (45.0f / 65.0f * 255);
+            dither[i++] = (29.0f / 65.0f * 255);
+            dither[i++] = (36.0f / 65.0f * 255);
+            dither[i++] = (20.0f / 65.0f * 255);
+            dither[i++] = (48.0f / 65.0f * 255);
+            dither[i++] = (32.0f / 65.0f * 255);
+
+            dither[i++] = (9.0f / 65.0f * 255);
+            dither[i++] = (57.0f / 65.0f * 255);
+            dither[i++] = (5.0f / 65.0f * 255);
+            dither[i++] = (53.0f / 65.0f * 255);
+            dither[i++] = (12.0f / 65.0f * 255);
+            dither[i++] = (60.0f / 65.0f * 255);
+            dither[i++] = (8.0f / 65.0f * 255);
+            dither[i++] = (56.0f / 65.0f * 255);
+
+            dither[i++] = (41.0f / 65.0f * 255);
+            dither[i++] = (25.0f / 65.0f * 255);
+            dither[i++] = (37.0f / 65.0f * 255);
+            dither[i++] = (21.0f / 65.0f * 255);
+            dither[i++] = (44.0f / 65.0f * 255);
+            dither[i++] = (28.0f / 65.0f * 255);
+            dither[i++] = (40.0f / 65.0f * 255);
+            dither[i++] = (24.0f / 65.0f * 255);
+
+            dither[i++] = (3.0f / 65.0f * 255);
+            dither[i++] = (51.0f / 65.0f * 255);
+            dither[i++] = (15.0f / 65.0f * 255);
+            dither[i++] = (63.0f / 65.0f * 255);
+            dither[i++] = (2.0f / 65.0f * 255);
+            dither[i++] = (50.0f / 65.0f * 255);
+            dither[i++] = (14.0f / 65.0f * 255);
+            dither[i++] = (62.0f / 65.0f * 255);
+
+            dither[i++] = (35.0f / 65.0f * 255);
+            dither[i++] = (19.0f / 65.0f * 255);
+            dither[i++] = (47.0f / 65.0f * 255);
+            dither[i++] = (31.0f / 65.0f * 255);
+            dither[i++] = (34.0f / 65.0f * 255);
+            dither[i++] = (18.0f / 65.0f * 255);
+            dither[i++] = (46.0f / 65.0f * 255);
+            dither[i++] = (30.0f / 65.0f * 255);
+
+            dither[i++] = (11.0f / 65.0f * 255);
+            dither[i++] = (59.0f / 65.0f * 255);
+            dither[i++] = (7.0f / 65.0f * 255);
+            dither[i++] = (55.0f / 65.0f * 255);
+            dither[i++] = (10.0f / 65.0f * 255);
+            dither[i++] = (58.0f / 65.0f * 255);
+            dither[i++] = (6.0f / 65.0f * 255);
+            dither[i++] = (54.0f / 65.0f * 255);
+
+            dither[i++] = (43.0f / 65.0f * 255);
+            dither[i++] = (27.0f / 65.0f * 255);
+            dither[i++] = (39.0f / 65.0f * 255);
+            dither[i++] = (23.0f / 65.0f * 255);
+            dither[i++] = (42.0f / 65.0f * 255);
+            dither[i++] = (26.0f / 65.0f * 255);
+            dither[i++] = (38.0f / 65.0f * 255);
+            dither[i++] = (22.0f / 65.0f * 255);
+        }
+        else
+        {
+            dither[i++] = (0.0f / 16.0f * 255);
+            dither[i++] = (8.0f / 16.0f * 255);
+            dither[i++] = (2.0f / 16.0f * 255);
+            dither[i++] = (10.0f / 16.0f * 255);
+
+            dither[i++] = (12.0f / 16.0f * 255);
+            dither[i++] = (4.0f / 16.0f * 255);
+            dither[i++] = (14.0f / 16.0f * 255);
+            dither[i++] = (6.0f / 16.0f * 255);
+
+            dither[i++] = (3.0f / 16.0f * 255);
+            dither[i++] = (11.0f / 16.0f * 255);
+            dither[i++] = (1.0f / 16.0f * 255);
+            dither[i++] = (9.0f / 16.0f * 255);
+
+            dither[i++] = (15.0f / 16.0f * 255);
+            dither[i++] = (7.0f / 16.0f * 255);
+            dither[i++] = (13.0f / 16.0f * 255);
+            dither[i++] = (5.0f / 16.0f * 255);
+        }
+
+        return dither_size;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool create_uniform_buffer()
+    {
+        // Create the ring the per-frame object, global and light uniforms are written to
+        if (!m_uniform_ring.create(UNIFORM_RING_FRAME_SIZE, extension_supported("GL_ARB_buffer_storage")))
+            return false;
+
+        if (!m_uniform_ring.persistent())
+            DW_LOG_INFO("GL_ARB_buffer_storage is not supported, mapping the uniform ring every frame");
+
+        // Create storage buffer for the clustered VPLs, sized for the largest cluster count
+        m_vpl_cluster_ssbo = std::make_unique<dw::ShaderStorageBuffer>(GL_DYNAMIC_DRAW, sizeof(VplCluster) * MAX_VPL_CLUSTERS);
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void render_rsm()
+    {
+        ProfileScope scope(m_profiler, "render_rsm");
+
+        // A single instanced pass renders the RSMs of all lights.
+        render_scene(m_rsm_fbo.get(), m_rsm_program, m_rsm_size, m_rsm_size, GL_NONE, SCENE_PASS_RSM, m_light_count);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Writes the luminance of the attenuated RSM flux of every light and builds its mip chain, which importance sampling
+    // descends to find bright VPLs. The top mip holds the average reflected flux of each light.
+    void build_flux_pyramid()
+    {
+        ProfileScope scope(m_profiler, "flux_pyramid");
+
+        m_rsm_luminance_program->use();
+
+        bind_rsm(m_rsm_luminance_program.get(), 0);
+
+        m_uniform_ring.bind(2, m_light_uniform_range);
+
+        m_rsm_luminance_rt->bind_image(0, 0, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glDispatchCompute((m_rsm_size + 7) / 8, (m_rsm_size + 7) / 8, m_light_count);
+
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+        // Box filtered mips hold the average luminance of each 2x2 block, which is all the warping needs.
+        m_rsm_luminance_rt->generate_mipmaps();
+
+        request_light_estimates();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Reads back the top mip of the luminance pyramid without stalling: the copy into the pixel pack buffer is fenced and
+    // only mapped by poll_light_estimates() once the GPU has finished it. The estimates are therefore a few frames old.
+    void request_light_estimates()
+    {
+        // Only one readback in flight.
+        if (m_light_estimate_fence)
+            return;
+
+        int top_level = int(log2(m_rsm_size));
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_light_estimate_pbo);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_rsm_luminance_rt->id());
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, top_level, GL_RED, GL_FLOAT, nullptr);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        m_light_estimate_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_light_estimate_count = m_light_count;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Polled every frame, so that a readback completes even if the pyramid is not rebuilt in the meantime.
+    void poll_light_estimates()
+    {
+        if (!m_light_estimate_fence)
+            return;
+
+        GLenum status = glClientWaitSync(m_light_estimate_fence, 0, 0);
+
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return;
+
+        glDeleteSync(m_light_estimate_fence);
+        m_light_estimate_fence = nullptr;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_light_estimate_pbo);
+
+        float* data = (float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(float) * MAX_LIGHTS, GL_MAP_READ_BIT);
+
+        // Skip results from before a change of the light count.
+        if (data && m_light_estimate_count == m_light_count)
+            m_light_estimates.assign(data, data + m_light_count);
+
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The clusters are seeded on a square grid over each light's RSM, so the effective cluster count is the largest square
+    // that fits into the light's share of m_vpl_count.
+    int vpl_grid_size() const
+    {
+        return std::max(1, int(sqrtf(float(m_vpl_count / m_light_count))));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Every light gets its own grid of clusters.
+    int vpl_cluster_count() const
+    {
+        return vpl_grid_size() * vpl_grid_size() * m_light_count;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void set_vpl_cluster_uniforms(CachedProgram* program)
+    {
+        int grid_size = vpl_grid_size();
+
+        bind_rsm(program, 0);
+
+        program->set_uniform("u_GridSize", grid_size);
+        program->set_uniform("u_CellSize", (m_rsm_size + grid_size - 1) / grid_size);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Reduces the RSM to a list of representative VPLs. The clusters are seeded from the lit texels of a light space grid and
+    // refined with a few k-means iterations, where every texel is only compared against the clusters of its 3x3 neighbouring
+    // grid cells.
+    void cluster_vpls()
+    {
+        ProfileScope scope(m_profiler, "cluster_vpls");
+
+        int num_clusters = vpl_cluster_count();
+
+        m_vpl_cluster_ssbo->bind_base(0);
+        m_uniform_ring.bind(2, m_light_uniform_range);
+
+        m_vpl_cluster_init_program->use();
+        set_vpl_cluster_uniforms(m_vpl_cluster_init_program.get());
+
+        glDispatchCompute(num_clusters, 1, 1);
+
+        for (int i = 0; i < m_vpl_iterations; i++)
+        {
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            m_vpl_cluster_assign_program->use();
+            set_vpl_cluster_uniforms(m_vpl_cluster_assign_program.get());
+
+            m_vpl_cluster_assign_program->set_uniform("u_NormalWeight", m_vpl_normal_weight);
+            m_vpl_cluster_assign_program->set_uniform("u_FluxWeight", m_vpl_flux_weight);
+
+            m_vpl_labels->bind_image(0, 0, 0, GL_WRITE_ONLY, GL_R32UI);
+
+            glDispatchCompute((m_rsm_size + 7) / 8, (m_rsm_size + 7) / 8, m_light_count);
+
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+            m_vpl_cluster_update_program->use();
+            set_vpl_cluster_uniforms(m_vpl_cluster_update_program.get());
+
+            m_vpl_labels->bind_image(0, 0, 0, GL_READ_ONLY, GL_R32UI);
+
+            glDispatchCompute(num_clusters, 1, 1);
+        }
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void render_gbuffer()
+    {
+        ProfileScope scope(m_profiler, "render_gbuffer");
+
+        render_scene(m_gbuffer_fbo.get(), m_gbuffer_program, m_width, m_height, GL_BACK, SCENE_PASS_GBUFFER);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Binds the RSM to 'first_unit' and the units after it: the packed target on its own, or flux, normals and world position.
+    void bind_rsm(CachedProgram* program, int first_unit)
+    {
+        if (m_packed_rsm)
+        {
+            if (program->set_uniform("s_RSM", first_unit))
+                m_rsm_packed_rt->bind(first_unit);
+
+            return;
+        }
+
+        if (program->set_uniform("s_RSMFlux", first_unit))
+            m_rsm_flux_rt->bind(first_unit);
+
+        if (program->set_uniform("s_RSMNormals", first_unit + 1))
+            m_rsm_normals_rt->bind(first_unit + 1);
+
+        if (program->set_uniform("s_RSMWorldPos", first_unit + 2))
+            m_rsm_world_pos_rt->bind(first_unit + 2);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Binds the source of G-buffer positions: the depth buffer in the compact layout, the world position target otherwise.
+    void bind_gbuffer_position(CachedProgram* program, int unit)
+    {
+        if (m_compact_gbuffer)
+        {
+            if (program->set_uniform("s_Depth", unit))
+                m_gbuffer_depth_rt->bind(unit);
+        }
+        else if (program->set_uniform("s_WorldPos", unit))
+            m_gbuffer_world_pos_rt->bind(unit);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void direct_lighting()
+    {
+        ProfileScope scope(m_profiler, "direct_lighting");
+
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+
+        // Lighting is composited off screen so that it can be presented again while nothing changes.
+        m_composite_fbo->bind();
+
+        glViewport(0, 0, m_width, m_height);
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // Bind shader program.
+        m_direct_program->use();
+
+        if (m_direct_program->set_uniform("s_Albedo", 0))
+            m_gbuffer_albedo_rt->bind(0);
+
+        if (m_direct_program->set_uniform("s_Normals", 1))
+            m_gbuffer_normals_rt->bind(1);
+
+        bind_gbuffer_position(m_direct_program.get(), 2);
+
+        if (m_direct_program->set_uniform("s_ShadowMap", 3))
+            m_rsm_depth_rt->bind(3);
+
+        // Bind uniform buffers.
+        m_uniform_ring.bind(0, m_global_uniform_range);
+        m_uniform_ring.bind(2, m_light_uniform_range);
+
+        // Render fullscreen triangle
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void indirect_lighting()
+    {
+        ProfileScope scope(m_profiler, "indirect_lighting");
+
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+
+        if (m_screenspace_interpolation)
+        {
+            {
+                ProfileScope low_res_scope(m_profiler, "gather_low_res");
+
+                if (use_compute_gather())
+                    gather_indirect_compute(m_scaled_indirect_rt, scaled_indirect_size().x, scaled_indirect_size().y);
+                else
+                {
+                    m_scaled_indirect_fbo->bind();
+                    glViewport(0, 0, scaled_indirect_size().x, scaled_indirect_size().y);
+
+                    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                    glClear(GL_COLOR_BUFFER_BIT);
+
+                    gather_indirect();
+                }
+            }
+
+            interpolate_indirect();
+
+            {
+                ProfileScope refine_scope(m_profiler, "gather_refine");
+
+                // The refinement is sparse and relies on the stencil test, so it always uses the fragment path. Only run the
+                // full gather on the pixels the interpolation pass rejected (stencil value of 1).
+                glEnable(GL_STENCIL_TEST);
+                glStencilFunc(GL_EQUAL, 1, 0xFF);
+                glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+                glStencilMask(0x00);
+
+                bool count_refined = begin_refine_query();
+
+                gather_indirect();
+
+                if (count_refined)
+                    glEndQuery(GL_SAMPLES_PASSED);
+
+                glStencilMask(0xFF);
+                glDisable(GL_STENCIL_TEST);
+            }
+        }
+        else if (use_compute_gather())
+            gather_indirect_compute(m_indirect_rt, m_width, m_height);
+        else
+        {
+            m_indirect_fbo->bind();
+            glViewport(0, 0, m_width, m_height);
+
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            gather_indirect();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool use_compute_gather() const
+    {
+        return m_compute_gather && m_gather_mode != INDIRECT_GATHER_IMPORTANCE;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Resolution of the gather before screen space interpolation.
+    glm::ivec2 scaled_indirect_size() const
+    {
+        return glm::ivec2(std::max(int(m_width * m_indirect_scale), 1), std::max(int(m_height * m_indirect_scale), 1));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Returns the gather program specialized for the current dither mode, and for a fixed sample count when a single light
+    // gathers the whole sample set every frame. Permutations are compiled on first use and go through the program cache
+    // like every other program, so each one is only compiled once per driver. Falls back to the generic program when
+    // permutations are off or one fails to compile.
+    CachedProgram* gather_program(bool compute)
+    {
+        CachedProgram* generic = compute ? m_indirect_compute_program.get() : m_indirect_program.get();
+
+        if (!m_shader_permutations)
+            return generic;
+
+        std::vector<std::string> defines = compute ? m_indirect_compute_defines : m_indirect_defines;
+
+        defines.push_back("DITHER_MODE " + std::to_string(m_dither_mode));
+        defines.push_back("DITHER_SIZE " + std::to_string(m_dither_size));
+
+        // The compute gather reads its offsets from the sample texture, only the fragment path bakes them in. The adaptive
+        // quality controller moves the sample count every few seconds, and compiling a program for every step would hitch
+        // the frame it lands on, so it keeps the generic sample loop.
+        if (!compute && !m_adaptive_quality && m_gather_mode == INDIRECT_GATHER_POLAR && m_light_count == 1 && !m_temporal_accumulation && m_num_samples >= 1 && m_num_samples <= m_samples_texture_size)
+        {
+            std::string offsets;
+            char        offset[96];
+
+            for (int i = 0; i < m_num_samples; i++)
+            {
+                snprintf(offset, sizeof(offset), "%svec3(%.9g, %.9g, %.9g)", i > 0 ? ", " : "", m_samples[i].x, m_samples[i].y, m_samples[i].z);
+                offsets += offset;
+            }
+
+            defines.push_back("NUM_SAMPLES " + std::to_string(m_num_samples));
+            defines.push_back("SAMPLE_OFFSETS " + offsets);
+        }
+
+        std::string key = compute ? "cs" : "fs";
+
+        for (const std::string& define : defines)
+            key += "|" + define;
+
+        auto it = m_gather_permutations.find(key);
+
+        if (it == m_gather_permutations.end())
+        {
+            std::unique_ptr<CachedProgram> program;
+
+            if (compute)
+                program = m_program_cache.create({ { GL_COMPUTE_SHADER, "shader/indirect_light_cs.glsl", defines } });
+            else
+                program = m_program_cache.create({ { GL_VERTEX_SHADER, "shader/fullscreen_triangle_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "shader/indirect_light_fs.glsl", defines } });
+
+            if (program)
+            {
+                program->uniform_block_binding("GlobalUniforms", 0);
+                program->uniform_block_binding("LightUniforms", 2);
+            }
+            else
+                DW_LOG_ERROR("Failed to create gather permutation, using the generic program");
+
+            // Failed permutations are kept as null so that they are not recompiled every frame.
+            it = m_gather_permutations.emplace(key, std::move(program)).first;
+        }
+
+        return it->second ? it->second.get() : generic;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Runs the indirect_light_fs gather into the currently bound framebuffer.
+    void gather_indirect()
+    {
+        CachedProgram* program = gather_program(false);
+
+        // Bind shader program.
+        program->use();
+
+        set_gather_inputs(program);
+
+        // Render fullscreen triangle
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Runs the tiled indirect_light_cs gather into every texel of the target.
+    void gather_indirect_compute(dw::Texture2D* target, int w, int h)
+    {
+        CachedProgram* program = gather_program(true);
+
+        program->use();
+
+        set_gather_inputs(program);
+
+        target->bind_image(0, 0, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+        glDispatchCompute((w + 15) / 16, (h + 15) / 16, 1);
+
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Binds the textures, uniforms and buffers shared by both gather implementations.
+    void set_gather_inputs(CachedProgram* program)
+    {
+        if (program->set_uniform("s_Normals", 0))
+            m_gbuffer_normals_rt->bind(0);
+
+        bind_gbuffer_position(program, 1);
+
+        bind_rsm(program, 2);
+
+        if (program->set_uniform("s_Samples", 5))
+            m_samples_texture->bind(5);
+
+        if (program->set_uniform("s_Dither", 6))
+            m_dither_texture->bind(6);
+
+        if (m_gather_mode == INDIRECT_GATHER_IMPORTANCE && program->set_uniform("s_RSMLuminance", 7))
+            m_rsm_luminance_rt->bind(7);
+
+        program->set_uniform("u_Dither", m_dither_mode);
+        program->set_uniform("u_DitherSize", m_dither_size);
+        program->set_uniform("u_NumSamples", m_num_samples);
+
+        // Rotate the pattern by the golden ratio every frame when accumulating, the sample windows of the lights are stepped
+        // through the sample set in update_light_uniforms().
+        program->set_uniform("u_FrameRotation", m_temporal_accumulation ? fmodf(float(m_frame_index) * 0.618034f, 1.0f) : m_pattern_rotation);
+        program->set_uniform("u_SampleRadius", m_sample_radius * (1.0f / float(RSM_SIZE)));
+        program->set_uniform("u_IndirectLightAmount", m_indirect_light_amount);
+
+        if (m_gather_mode == INDIRECT_GATHER_IMPORTANCE)
+            program->set_uniform("u_ImportanceLevel", m_importance_level);
+        else if (m_gather_mode == INDIRECT_GATHER_CLUSTERS)
+        {
+            // The clusters hold the summed flux of all their texels. Scale it so that a uniformly lit sampling disk gives the
+            // same result as the polar gather, whose converged value is u_NumSamples / 3 times the per-texel contribution.
+            // The radius is in texels of an RSM_SIZE map, so smaller RSM layers cover the disk with fewer, brighter texels.
+            float radius    = std::max(m_sample_radius, 1.0f);
+            float rsm_scale = float(RSM_SIZE) / float(m_rsm_size);
+
+            program->set_uniform("u_VplCount", vpl_cluster_count());
+            program->set_uniform("u_VplFluxScale", float(m_num_samples) * rsm_scale * rsm_scale / (3.0f * float(M_PI) * radius * radius));
+
+            m_vpl_cluster_ssbo->bind_base(0);
+        }
+
+        // Bind uniform buffers.
+        m_uniform_ring.bind(0, m_global_uniform_range);
+        m_uniform_ring.bind(2, m_light_uniform_range);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Upsamples the low resolution indirect lighting to full resolution wherever the low resolution neighbours lie on the
+    // same surface as the pixel, with either of the UpsampleMode filters. Every other pixel is left marked in the stencil
+    // buffer for the refinement pass.
+    void interpolate_indirect()
+    {
+        ProfileScope scope(m_profiler, "interpolate_indirect");
+
+        m_indirect_fbo->bind();
+        glViewport(0, 0, m_width, m_height);
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClearStencil(1);
+        glStencilMask(0xFF);
+        glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        // Pixels that were interpolated clear their stencil value, rejected pixels are discarded and keep it.
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+
+        CachedProgram* program = m_upsample_mode == UPSAMPLE_JOINT_BILATERAL ? m_upsample_program.get() : m_interpolate_program.get();
+
+        program->use();
+
+        if (program->set_uniform("s_Indirect", 0))
+            m_scaled_indirect_rt->bind(0);
+
+        if (program->set_uniform("s_Normals", 1))
+            m_gbuffer_normals_rt->bind(1);
+
+        bind_gbuffer_position(program, 2);
+
+        program->set_uniform("u_IndirectSize", glm::vec2(float(scaled_indirect_size().x), float(scaled_indirect_size().y)));
+
+        if (m_upsample_mode == UPSAMPLE_JOINT_BILATERAL)
+        {
+            program->set_uniform("u_Radius", m_upsample_radius);
+            program->set_uniform("u_NormalPower", m_bilateral_normal_power);
+            program->set_uniform("u_DepthSigma", m_bilateral_depth_sigma);
+        }
+        else
+        {
+            program->set_uniform("u_NormalThreshold", m_interpolation_normal_threshold);
+            program->set_uniform("u_DistanceThreshold", m_interpolation_distance_threshold);
+        }
+
+        // Bind uniform buffers.
+        m_uniform_ring.bind(0, m_global_uniform_range);
+
+        // Render fullscreen triangle
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        glDisable(GL_STENCIL_TEST);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Separable edge-aware blur of the full resolution indirect lighting, ping-ponging through the blur target.
+    void blur_indirect()
+    {
+        ProfileScope scope(m_profiler, "blur_indirect");
+
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+
+        glViewport(0, 0, m_width, m_height);
+
+        m_blur_program->use();
+
+        if (m_blur_program->set_uniform("s_Normals", 1))
+            m_gbuffer_normals_rt->bind(1);
+
+        bind_gbuffer_position(m_blur_program.get(), 2);
+
+        m_blur_program->set_uniform("u_Radius", m_blur_radius);
+        m_blur_program->set_uniform("u_NormalPower", m_bilateral_normal_power);
+        m_blur_program->set_uniform("u_DepthSigma", m_bilateral_depth_sigma);
+
+        // Bind uniform buffers.
+        m_uniform_ring.bind(0, m_global_uniform_range);
+
+        // Horizontal pass into the blur target.
+        m_blur_fbo->bind();
+
+        if (m_blur_program->set_uniform("s_Indirect", 0))
+            m_indirect_rt->bind(0);
+
+        m_blur_program->set_uniform("u_Direction", glm::vec2(1.0f, 0.0f));
+
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // Vertical pass back into the indirect target.
+        m_indirect_fbo->bind();
+
+        if (m_blur_program->set_uniform("s_Indirect", 0))
+            m_blur_rt->bind(0);
+
+        m_blur_program->set_uniform("u_Direction", glm::vec2(0.0f, 1.0f));
+
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Counts the refined pixels with an occlusion query. A new query is only issued once the previous result has arrived,
+    // so reading it back never stalls.
+    bool begin_refine_query()
+    {
+        if (m_refine_query_pending)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(m_refine_query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (!available)
+                return false;
+
+            GLuint samples = 0;
+            glGetQueryObjectuiv(m_refine_query, GL_QUERY_RESULT, &samples);
+
+            m_refined_pixel_ratio  = float(samples) / float(m_width * m_height);
+            m_refine_query_pending = false;
+        }
+
+        glBeginQuery(GL_SAMPLES_PASSED, m_refine_query);
+        m_refine_query_pending = true;
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Blends this frame's indirect lighting with the reprojected history from last frame. History is rejected where the
+    // reprojected surface does not match the normal and view depth stored with it.
+    void temporal_accumulation()
+    {
+        ProfileScope scope(m_profiler, "temporal_accumulation");
+
+        uint32_t current  = m_frame_index % 2;
+        uint32_t previous = 1 - current;
+
+        m_history_fbo[current]->bind();
+        glViewport(0, 0, m_width, m_height);
+
+        m_temporal_program->use();
+
+        if (m_temporal_program->set_uniform("s_Indirect", 0))
+            m_indirect_rt->bind(0);
+
+        if (m_temporal_program->set_uniform("s_History", 1))
+            m_history_rt[previous]->bind(1);
+
+        if (m_temporal_program->set_uniform("s_HistoryGeometry", 2))
+            m_history_geometry_rt[previous]->bind(2);
+
+        if (m_temporal_program->set_uniform("s_Normals", 3))
+            m_gbuffer_normals_rt->bind(3);
+
+        bind_gbuffer_position(m_temporal_program.get(), 4);
+
+        m_temporal_program->set_uniform("u_HistoryValid", m_history_valid ? 1 : 0);
+        m_temporal_program->set_uniform("u_MinBlendFactor", m_temporal_blend_factor);
+        m_temporal_program->set_uniform("u_NormalThreshold", m_temporal_normal_threshold);
+        m_temporal_program->set_uniform("u_DepthThreshold", m_temporal_depth_threshold);
+
+        // Bind uniform buffers.
+        m_uniform_ring.bind(0, m_global_uniform_range);
+
+        // Render fullscreen triangle
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        m_history_valid = true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void copy_indirect()
+    {
+        ProfileScope scope(m_profiler, "copy_indirect");
+
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        m_composite_fbo->bind();
+
+        glViewport(0, 0, m_width, m_height);
+
+        if (m_indirect_only)
+        {
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+
+        // Bind shader program.
+        m_copy_program->use();
+
+        if (m_copy_program->set_uniform("s_Color", 0))
+        {
+            if (m_temporal_accumulation)
+                m_history_rt[m_frame_index % 2]->bind(0);
+            else
+                m_indirect_rt->bind(0);
+        }
+
+        // Render fullscreen triangle
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void present_composite()
+    {
+        ProfileScope scope(m_profiler, "present");
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_composite_fbo->id());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Compares the versions of the inputs a pass reads against the ones it last ran with. Returns true if the pass has to
+    // be executed, and records the current versions.
+    bool update_pass_inputs(PassInputs& inputs, bool light, bool camera, bool settings)
+    {
+        PassInputs current;
+
+        current.light    = light ? m_light_version : 0;
+        current.camera   = camera ? m_camera_version : 0;
+        current.scene    = m_scene_version;
+        current.settings = settings ? m_settings_version : 0;
+
+        bool dirty = !m_skip_unchanged_passes || memcmp(&current, &inputs, sizeof(PassInputs)) != 0;
+
+        inputs = current;
+
+        return dirty;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Number of frames after the last change before the accumulated indirect lighting is considered converged: the history
+    // has reached its maximum length and every sample of the set has been used.
+    uint32_t temporal_convergence_frames() const
+    {
+        int frame_samples = std::min(m_temporal_samples, m_num_samples);
+
+        return uint32_t(std::max(ceilf(1.0f / m_temporal_blend_factor), ceilf(float(m_num_samples) / float(frame_samples))));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Feeds the GPU times of the last measured frame to the quality controller. Only frames that ran the gather are used,
+    // since the passes that are skipped while nothing changes would make every frame look cheap.
+    void update_adaptive_quality()
+    {
+        if (m_profiler.measured_frames() == m_quality_measured)
+            return;
+
+        m_quality_measured = m_profiler.measured_frames();
+
+        double gather = m_profiler.recent_gpu_time("indirect_lighting", 0);
+
+        if (gather < 0.0)
+            return;
+
+        QualityCosts costs;
+
+        costs.frame  = m_profiler.recent_frame_gpu_time(QUALITY_MAX_PASS_AGE);
+        costs.rsm    = 0.0;
+        costs.gather = gather;
+
+        for (const char* pass : { "render_rsm", "flux_pyramid", "cluster_vpls" })
+            costs.rsm += std::max(m_profiler.recent_gpu_time(pass, QUALITY_MAX_PASS_AGE), 0.0);
+
+        // Without screen space interpolation the gather runs at full resolution and the scale is unused.
+        QualityLimits limits;
+
+        limits.min_rsm_size       = MIN_RSM_SIZE;
+        limits.max_rsm_size       = MAX_RSM_SIZE;
+        limits.min_indirect_scale = m_screenspace_interpolation ? MIN_SCALED_INDIRECT : m_indirect_scale;
+        limits.max_indirect_scale = m_screenspace_interpolation ? 1.0f : m_indirect_scale;
+        limits.min_samples        = std::min(QUALITY_SAMPLE_STEP, m_samples_texture_size);
+        limits.max_samples        = m_samples_texture_size;
+
+        QualitySettings settings = { m_rsm_resolution, m_indirect_scale, m_num_samples };
+
+        if (!m_quality_controller.update(m_target_frame_time, limits, costs, settings))
+            return;
+
+        m_rsm_resolution = settings.rsm_size;
+        m_indirect_scale = settings.indirect_scale;
+        m_num_samples    = settings.num_samples;
+
+        m_settings_version++;
+        build_render_graph();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void ui()
+    {
+        // Light widgets bump the light version through update_spot_light(), everything else that changes the image bumps
+        // the settings version.
+        bool light_changed    = false;
+        bool settings_changed = false;
+
+        settings_changed |= ImGui::Checkbox("Indirect Lighting", &m_rsm_enabled);
+
+        if (m_rsm_enabled)
+            settings_changed |= ImGui::Checkbox("Indirect Only", &m_indirect_only);
+
+        ImGui::Checkbox("Skip Unchanged Passes", &m_skip_unchanged_passes);
+
+        if (!m_scene_loaded)
+            ImGui::Text("Loading Meshes: %d / %d", int(m_scene_paths.size() - m_pending_scenes), int(m_scene_paths.size()));
+
+        light_changed |= ImGui::Checkbox("Use as Flashlight", &m_flash_light);
+
+        if (!m_flash_light)
+        {
+            light_changed |= ImGui::InputFloat3("Light Position", &m_light_pos.x);
+            light_changed |= ImGui::InputFloat3("Light Target", &m_light_target.x);
+        }
+
+        if (ImGui::SliderInt("Light Count", &m_light_count, 1, MAX_LIGHTS))
+        {
+            create_extra_lights();
+            build_render_graph();
+        }
+
+        if (m_light_count > 1 && ImGui::CollapsingHeader("Additional Lights"))
+        {
+            for (int i = 0; i < m_extra_lights.size(); i++)
+            {
+                std::string id = std::to_string(i + 1);
+
+                light_changed |= ImGui::InputFloat3(("Position##" + id).c_str(), &m_extra_lights[i].position.x);
+                light_changed |= ImGui::InputFloat3(("Target##" + id).c_str(), &m_extra_lights[i].target.x);
+                light_changed |= ImGui::ColorEdit3(("Color##" + id).c_str(), &m_extra_lights[i].color.x);
+                light_changed |= ImGui::InputFloat(("Intensity##" + id).c_str(), &m_extra_lights[i].intensity);
+
+                if (i + 1 < m_light_estimates.size())
+                    ImGui::Text("Estimated Flux: %f, Samples: %d", m_light_estimates[i + 1], m_light_uniforms.lights[i + 1].samples.x);
+
+                ImGui::Separator();
+            }
+        }
+
+        if (ImGui::Checkbox("Compact G-Buffer", &m_compact_gbuffer))
+        {
+            create_shaders();
+            build_render_graph();
+        }
+
+        if (ImGui::Checkbox("Packed RSM", &m_packed_rsm))
+        {
+            create_shaders();
+            build_render_graph();
+        }
+
+        if (m_multi_draw_supported && ImGui::Checkbox("Multi-Draw Indirect", &m_multi_draw_indirect))
+            create_shaders();
+
+        if (ImGui::Checkbox("Frustum Culling", &m_frustum_culling))
+            m_scene_version++;
+
+        if (ImGui::SliderInt("Instance Grid", &m_instance_grid, 1, MAX_INSTANCE_GRID))
+        {
+            for (auto& mesh : m_scene)
+                create_instances(mesh);
+
+            m_scene_version++;
+        }
+
+        ImGui::Text("Drawn Submeshes: G-Buffer %d / %d, RSM %d / %d", m_culling_stats[SCENE_PASS_GBUFFER].x, m_culling_stats[SCENE_PASS_GBUFFER].y, m_culling_stats[SCENE_PASS_RSM].x, m_culling_stats[SCENE_PASS_RSM].y);
+        ImGui::Text("Drawn Instances: G-Buffer %d / %d, RSM %d / %d", m_culling_stats[SCENE_PASS_GBUFFER].z, m_culling_stats[SCENE_PASS_GBUFFER].w, m_culling_stats[SCENE_PASS_RSM].z, m_culling_stats[SCENE_PASS_RSM].w);
+        ImGui::Text("Uniform Ring Stalls: %u", m_uniform_ring.stalls());
+
+        if (ImGui::Combo("Sample Set", &m_sample_set, kSampleSetTypeNames, SAMPLE_SET_COUNT))
+        {
+            create_samples_texture();
+            settings_changed = true;
+        }
+
+        if (ImGui::Combo("Dither", &m_dither_mode, kDitherModeNames, 3))
+        {
+            create_dither_texture();
+            settings_changed = true;
+        }
+
+        if (m_dither_mode == DITHER_BAYER && ImGui::Checkbox("Bayer 8x8", &m_bayer_8x8))
+        {
+            create_dither_texture();
+            settings_changed = true;
+        }
+
+        ImGui::Checkbox("Shader Permutations", &m_shader_permutations);
+        ImGui::Text("Gather Permutations: %d", int(m_gather_permutations.size()));
+
+        settings_changed |= ImGui::Checkbox("Screen Space Interpolation", &m_screenspace_interpolation);
+
+        if (m_screenspace_interpolation)
+        {
+            settings_changed |= ImGui::Combo("Upsampling", &m_upsample_mode, kUpsampleModeNames, 2);
+
+            if (m_upsample_mode == UPSAMPLE_JOINT_BILATERAL)
+                settings_changed |= ImGui::SliderInt("Upsample Radius", &m_upsample_radius, 1, 4);
+            else
+            {
+                settings_changed |= ImGui::SliderFloat("Interpolation Normal Threshold", &m_interpolation_normal_threshold, 0.0f, 1.0f);
+                settings_changed |= ImGui::SliderFloat("Interpolation Distance Threshold", &m_interpolation_distance_threshold, 0.0f, 0.1f);
+            }
+
+            ImGui::Text("Refined Pixels: %.1f%%", m_refined_pixel_ratio * 100.0f);
+        }
+
+        settings_changed |= ImGui::Checkbox("Edge-Aware Blur", &m_edge_aware_blur);
+
+        if (m_edge_aware_blur)
+            settings_changed |= ImGui::SliderInt("Blur Radius", &m_blur_radius, 1, 8);
+
+        if ((m_screenspace_interpolation && m_upsample_mode == UPSAMPLE_JOINT_BILATERAL) || m_edge_aware_blur)
+        {
+            settings_changed |= ImGui::SliderFloat("Bilateral Normal Power", &m_bilateral_normal_power, 1.0f, 64.0f);
+            settings_changed |= ImGui::SliderFloat("Bilateral Depth Sigma", &m_bilateral_depth_sigma, 0.001f, 0.1f);
+        }
+
+        if (ImGui::Combo("Gather Mode", &m_gather_mode, kIndirectGatherModeNames, 3))
+        {
+            create_shaders();
+            build_render_graph();
+        }
+
+        if (m_gather_mode != INDIRECT_GATHER_IMPORTANCE)
+            settings_changed |= ImGui::Checkbox("Compute Gather", &m_compute_gather);
+
+        if (m_gather_mode == INDIRECT_GATHER_IMPORTANCE)
+        {
+            settings_changed |= ImGui::SliderInt("Importance Samples", &m_importance_samples, 1, m_samples_texture_size);
+            settings_changed |= ImGui::SliderInt("Importance Level", &m_importance_level, 0, 4);
+        }
+        else if (m_gather_mode == INDIRECT_GATHER_CLUSTERS)
+        {
+            settings_changed |= ImGui::SliderInt("VPL Count", &m_vpl_count, MIN_VPL_CLUSTERS, MAX_VPL_CLUSTERS);
+            settings_changed |= ImGui::SliderInt("k-means Iterations", &m_vpl_iterations, 0, 8);
+            settings_changed |= ImGui::SliderFloat("Cluster Normal Weight", &m_vpl_normal_weight, 0.0f, 16.0f);
+            settings_changed |= ImGui::SliderFloat("Cluster Flux Weight", &m_vpl_flux_weight, 0.0f, 16.0f);
+            ImGui::Text("Clusters: %d", vpl_cluster_count());
+        }
+
+        if (ImGui::Checkbox("Temporal Accumulation", &m_temporal_accumulation))
+        {
+            m_history_valid  = false;
+            settings_changed = true;
+        }
+
+        if (m_temporal_accumulation)
+        {
+            settings_changed |= ImGui::SliderInt("Samples Per Frame", &m_temporal_samples, 1, m_samples_texture_size);
+            settings_changed |= ImGui::SliderFloat("Temporal Blend Factor", &m_temporal_blend_factor, 0.01f, 1.0f);
+            settings_changed |= ImGui::SliderFloat("Temporal Normal Threshold", &m_temporal_normal_threshold, 0.0f, 1.0f);
+            settings_changed |= ImGui::SliderFloat("Temporal Depth Threshold", &m_temporal_depth_threshold, 0.0f, 0.2f);
+        }
+
+        if (ImGui::InputInt("Num RSM Samples", &m_num_samples))
+        {
+            clamp_sample_counts();
+            settings_changed = true;
+        }
+
+        if (ImGui::SliderInt("Sample Set Size", &m_samples_texture_size, 1, MAX_SAMPLES_TEXTURE_SIZE))
+        {
+            create_samples_texture();
+            clamp_sample_counts();
+            settings_changed = true;
+        }
+
+        if (ImGui::CollapsingHeader("Quality"))
+        {
+            static const char* kRsmSizeNames[] = { "256", "512", "1024", "2048" };
+
+            int rsm_size_index = 0;
+
+            while ((MIN_RSM_SIZE << rsm_size_index) < m_rsm_resolution)
+                rsm_size_index++;
+
+            if (ImGui::Combo("RSM Size", &rsm_size_index, kRsmSizeNames, 4))
+            {
+                m_rsm_resolution = MIN_RSM_SIZE << rsm_size_index;
+                settings_changed = true;
+            }
+
+            if (m_screenspace_interpolation)
+                settings_changed |= ImGui::SliderFloat("Indirect Scale", &m_indirect_scale, MIN_SCALED_INDIRECT, 1.0f);
+
+            if (ImGui::Checkbox("Adaptive Quality", &m_adaptive_quality))
+                m_quality_controller.reset();
+
+            if (m_adaptive_quality)
+            {
+                ImGui::SliderFloat("Target Frame Time (ms)", &m_target_frame_time, 1.0f, 50.0f);
+                ImGui::Text("RSM %d, Indirect Scale %.2f, Samples %d, Changes %u", m_rsm_resolution, m_indirect_scale, m_num_samples, m_quality_controller.changes());
+            }
+        }
+
+        settings_changed |= ImGui::InputFloat("Sample Radius", &m_sample_radius);
+        settings_changed |= ImGui::InputFloat("Indirect Light Amount", &m_indirect_light_amount);
+        light_changed |= ImGui::InputFloat("Light Inner Cutoff", &m_inner_cutoff);
+        light_changed |= ImGui::InputFloat("Light Outer Cutoff", &m_outer_cutoff);
+        light_changed |= ImGui::InputFloat("Light Range", &m_light_range);
+        light_changed |= ImGui::InputFloat("Light Bias", &m_light_bias);
+        light_changed |= ImGui::ColorEdit3("Light Color", &m_light_color.x);
+
+        ImGui::Separator();
+
+        if (ImGui::Button("G-Buffer Albedo"))
+            m_gbuffer_albedo_rt->save_to_disk("GBuffer_Albedo", 0, 0);
+
+        if (!m_compact_gbuffer && ImGui::Button("G-Buffer World Pos"))
+            m_gbuffer_world_pos_rt->save_to_disk("GBuffer_WorldPos", 0, 0);
+
+        if (ImGui::Button("G-Buffer Normals"))
+            m_gbuffer_normals_rt->save_to_disk("GBuffer_Normal", 0, 0);
+
+        if (!m_packed_rsm)
+        {
+            if (ImGui::Button("RSM Flux"))
+                m_rsm_flux_rt->save_to_disk("RSM_Flux", 0, 0);
+
+            if (ImGui::Button("RSM World Pos"))
+                m_rsm_world_pos_rt->save_to_disk("RSM_WorldPos", 0, 0);
+
+            if (ImGui::Button("RSM Normals"))
+                m_rsm_normals_rt->save_to_disk("RSM_Normals", 0, 0);
+        }
+
+        if (!m_compact_gbuffer && !m_packed_rsm && ImGui::Button("Frame Capture"))
+            save_frame_capture("Frame.rsmc");
+
+        ImGui::Separator();
+
+        m_profiler.ui();
+
+        if (ImGui::CollapsingHeader("Render Targets"))
+            m_render_graph.ui();
+
+        if (light_changed)
+            update_spot_light();
+
+        // Settings can enable or disable passes, which changes the targets the graph allocates.
+        if (settings_changed)
+        {
+            m_settings_version++;
+            build_render_graph();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void read_texture(dw::Texture2D* texture, uint32_t w, uint32_t h, RsmImage& image)
+    {
+        image.resize(w, h);
+
+        glBindTexture(GL_TEXTURE_2D, texture->id());
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, image.data.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Reads the first layer of an RSM array.
+    void read_texture_layer(dw::Texture2D* texture, uint32_t w, uint32_t h, RsmImage& image)
+    {
+        std::vector<float> layers(size_t(w) * size_t(h) * 3 * texture->array_size());
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture->id());
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, GL_FLOAT, layers.data());
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        image.resize(w, h);
+        std::copy(layers.begin(), layers.begin() + image.data.size(), image.data.begin());
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Write everything the indirect pass reads this frame so that it can be evaluated by the CPU reference gather.
+    void save_frame_capture(const std::string& path)
+    {
+        RsmFrameCapture capture;
+
+        glm::vec3 light_pos = m_flash_light ? m_main_camera->m_position : m_light_pos;
+        glm::vec3 light_dir = m_flash_light ? m_main_camera->m_forward : m_light_dir;
+        glm::vec3 color     = m_light_color * m_light_intensity;
+
+        memcpy(&capture.light.position[0], &light_pos.x, sizeof(glm::vec3));
+        memcpy(&capture.light.direction[0], &light_dir.x, sizeof(glm::vec3));
+        memcpy(&capture.light.view_proj[0], &m_global_uniforms.light_view_proj[0][0], sizeof(glm::mat4));
+        memcpy(&capture.light.color[0], &color.x, sizeof(glm::vec3));
+
+        capture.light.inner_cutoff    = cosf(glm::radians(m_inner_cutoff));
+        capture.light.outer_cutoff    = cosf(glm::radians(m_outer_cutoff));
+        capture.light.range           = m_light_range;
+        capture.sample_radius         = m_sample_radius * (1.0f / float(RSM_SIZE));
+        capture.indirect_light_amount = m_indirect_light_amount;
+
+        for (int i = 0; i < m_num_samples; i++)
+        {
+            capture.samples.push_back(m_samples[i].x);
+            capture.samples.push_back(m_samples[i].y);
+            capture.samples.push_back(m_samples[i].z);
+        }
+
+        read_texture(m_gbuffer_world_pos_rt, m_width, m_height, capture.gbuffer_world_pos);
+        read_texture(m_gbuffer_normals_rt, m_width, m_height, capture.gbuffer_normals);
+
+        // The CPU reference handles a single light, the capture holds the main light's RSM layer.
+        read_texture_layer(m_rsm_world_pos_rt, m_rsm_size, m_rsm_size, capture.rsm_world_pos);
+        read_texture_layer(m_rsm_normals_rt, m_rsm_size, m_rsm_size, capture.rsm_normals);
+        read_texture_layer(m_rsm_flux_rt, m_rsm_size, m_rsm_size, capture.rsm_flux);
+
+        if (capture.save(path))
+            DW_LOG_INFO("Frame capture written to " + path);
+        else
+            DW_LOG_ERROR("Failed to write frame capture to " + path);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Maps the binary caches of the scene meshes on loader threads, rebuilding any that are missing or out of date. The
+    // meshes are then copied to the GPU by stream_scene().
+    bool load_scene()
+    {
+        m_scene_load_start = std::chrono::high_resolution_clock::now();
+
+        glGenBuffers(1, &m_staging_buffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, m_staging_buffer);
+        glBufferData(GL_COPY_READ_BUFFER, UPLOAD_STAGING_SIZE, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
 
-                m_rsm_program->uniform_block_binding("GlobalUniforms", 0);
-                m_rsm_program->uniform_block_binding("ObjectUniforms", 1);
-            }
+        m_pending_scenes = uint32_t(m_scene_paths.size());
+        m_loader_pool    = std::make_unique<ThreadPool>(std::min(m_pending_scenes, std::max(1u, std::thread::hardware_concurrency())));
 
-            {
-                if (!m_gbuffer_vs || !m_gbuffer_fs)
-                {
-                    DW_LOG_FATAL("Failed to create Shaders");
-                    return false;
-                }
+        for (const std::string& path : m_scene_paths)
+        {
+            m_loader_pool->submit([this, path]() {
+                LoadedScene loaded;
 
-                // Create general shader program
-                dw::Shader* shaders[] = { m_gbuffer_vs.get(), m_gbuffer_fs.get() };
-                m_gbuffer_program     = std::make_unique<dw::Program>(2, shaders);
+                loaded.path = path;
 
-                if (!m_gbuffer_program)
+                if (!m_loader_cancelled)
                 {
-                    DW_LOG_FATAL("Failed to create Shader Program");
-                    return false;
+                    loaded.cache = std::make_unique<SceneCache>();
+
+                    if (load_scene_cache(path, *loaded.cache))
+                    {
+                        loaded.cache->prefetch();
+                        loaded.bvh.build(loaded.cache->submeshes(), loaded.cache->header().submesh_count);
+                    }
+                    else
+                        loaded.cache.reset();
                 }
 
-                m_gbuffer_program->uniform_block_binding("GlobalUniforms", 0);
-                m_gbuffer_program->uniform_block_binding("ObjectUniforms", 1);
-            }
+                std::lock_guard<std::mutex> lock(m_loader_mutex);
+                m_loaded_scenes.push_back(std::move(loaded));
+            });
         }
 
         return true;
@@ -358,411 +2874,400 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void create_framebuffers()
+    // Copies up to 'budget' bytes of loaded meshes to the GPU.
+    void stream_scene(uint64_t budget)
     {
-        m_gbuffer_albedo_rt    = std::make_unique<dw::Texture2D>(m_width, m_height, 1, 1, 1, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE);
-        m_gbuffer_normals_rt   = std::make_unique<dw::Texture2D>(m_width, m_height, 1, 1, 1, GL_RGB16F, GL_RGB, GL_HALF_FLOAT);
-        m_gbuffer_world_pos_rt = std::make_unique<dw::Texture2D>(m_width, m_height, 1, 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT);
-        m_gbuffer_depth_rt     = std::make_unique<dw::Texture2D>(m_width, m_height, 1, 1, 1, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
-
-        m_rsm_flux_rt      = std::make_unique<dw::Texture2D>(RSM_SIZE, RSM_SIZE, 1, 1, 1, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE);
-        m_rsm_normals_rt   = std::make_unique<dw::Texture2D>(RSM_SIZE, RSM_SIZE, 1, 1, 1, GL_RGB16F, GL_RGB, GL_HALF_FLOAT);
-        m_rsm_world_pos_rt = std::make_unique<dw::Texture2D>(RSM_SIZE, RSM_SIZE, 1, 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT);
-        m_rsm_depth_rt     = std::make_unique<dw::Texture2D>(RSM_SIZE, RSM_SIZE, 1, 1, 1, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
+        while (budget > 0)
+        {
+            if (!m_upload.cache && !begin_scene_upload())
+                break;
 
-        m_gbuffer_albedo_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-        m_gbuffer_normals_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-        m_gbuffer_world_pos_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-        m_gbuffer_depth_rt->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+            if (m_upload.cache)
+                budget -= std::min(budget, upload_scene_chunk(budget));
+        }
 
-        m_rsm_flux_rt->set_wrapping(GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER);
-        m_rsm_normals_rt->set_wrapping(GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER);
-        m_rsm_world_pos_rt->set_wrapping(GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER);
-        m_rsm_depth_rt->set_wrapping(GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER);
+        if (m_pending_scenes == 0 && !m_upload.cache)
+        {
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_scene_load_start).count();
 
-        m_rsm_flux_rt->set_border_color(0.0f, 0.0f, 0.0f, 0.0f);
-        m_rsm_normals_rt->set_border_color(0.0f, 0.0f, 0.0f, 0.0f);
-        m_rsm_world_pos_rt->set_border_color(0.0f, 0.0f, 0.0f, 0.0f);
-        m_rsm_depth_rt->set_border_color(0.0f, 0.0f, 0.0f, 0.0f);
+            DW_LOG_INFO("Loaded " + std::to_string(m_scene.size()) + " meshes in " + std::to_string(elapsed) + " ms");
 
-        m_direct_light_rt    = std::make_unique<dw::Texture2D>(m_width, m_height, 1, 1, 1, GL_RGB16F, GL_RGB, GL_HALF_FLOAT);
-        m_indirect_rt        = std::make_unique<dw::Texture2D>(m_width, m_height, 1, 1, 1, GL_RGB16F, GL_RGB, GL_HALF_FLOAT);
-        m_scaled_indirect_rt = std::make_unique<dw::Texture2D>(m_width * SCALED_INDIRECT, m_height * SCALED_INDIRECT, 1, 1, 1, GL_RGB16F, GL_RGB, GL_HALF_FLOAT);
+            m_scene_loaded = true;
+            m_loader_pool.reset();
 
-        m_gbuffer_fbo = std::make_unique<dw::Framebuffer>();
+            glDeleteBuffers(1, &m_staging_buffer);
+            m_staging_buffer = 0;
+        }
+    }
 
-        dw::Texture* gbuffer_rts[] = { m_gbuffer_albedo_rt.get(), m_gbuffer_normals_rt.get(), m_gbuffer_world_pos_rt.get() };
-        m_gbuffer_fbo->attach_multiple_render_targets(3, gbuffer_rts);
-        m_gbuffer_fbo->attach_depth_stencil_target(m_gbuffer_depth_rt.get(), 0, 0);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        m_rsm_fbo = std::make_unique<dw::Framebuffer>();
+    // Blocks until every mesh has been loaded and uploaded.
+    void finish_scene_loading()
+    {
+        while (!m_scene_loaded)
+        {
+            stream_scene(UINT64_MAX);
 
-        dw::Texture* rsm_rts[] = { m_rsm_flux_rt.get(), m_rsm_normals_rt.get(), m_rsm_world_pos_rt.get() };
-        m_rsm_fbo->attach_multiple_render_targets(3, rsm_rts);
-        m_rsm_fbo->attach_depth_stencil_target(m_rsm_depth_rt.get(), 0, 0);
+            if (!m_scene_loaded && !m_upload.cache)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
 
-        m_direct_light_fbo = std::make_unique<dw::Framebuffer>();
-        m_direct_light_fbo->attach_render_target(0, m_direct_light_rt.get(), 0, 0);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        m_indirect_fbo = std::make_unique<dw::Framebuffer>();
-        m_indirect_fbo->attach_render_target(0, m_indirect_rt.get(), 0, 0);
+    // Takes the next mesh finished by the loader threads and creates its GPU buffers. Returns false if none is ready.
+    bool begin_scene_upload()
+    {
+        LoadedScene loaded;
 
-        m_scaled_indirect_fbo = std::make_unique<dw::Framebuffer>();
-        m_scaled_indirect_fbo->attach_render_target(0, m_scaled_indirect_rt.get(), 0, 0);
-    }
+        {
+            std::lock_guard<std::mutex> lock(m_loader_mutex);
 
-    void create_dither_texture()
-    {
-        std::vector<uint8_t> dither;
+            if (m_loaded_scenes.empty())
+                return false;
 
-#ifdef DITHER_8_8
-        int i           = 0;
-        int dither_size = 8;
+            loaded = std::move(m_loaded_scenes.front());
+            m_loaded_scenes.pop_front();
+        }
 
-        dither.resize(dither_size * dither_size);
+        m_pending_scenes--;
 
-        dither[i++] = (1.0f / 65.0f * 255);
-        dither[i++] = (49.0f / 65.0f * 255);
-        dither[i++] = (13.0f / 65.0f * 255);
-        dither[i++] = (61.0f / 65.0f * 255);
-        dither[i++] = (4.0f / 65.0f * 255);
-        dither[i++] = (52.0f / 65.0f * 255);
-        dither[i++] = (16.0f / 65.0f * 255);
-        dither[i++] = (64.0f / 65.0f * 255);
-
-        dither[i++] = (33.0f / 65.0f * 255);
-        dither[i++] = (17.0f / 65.0f * 255);
-        dither[i++] = (45.0f / 65.0f * 255);
-        dither[i++] = (29.0f / 65.0f * 255);
-        dither[i++] = (36.0f / 65.0f * 255);
-        dither[i++] = (20.0f / 65.0f * 255);
-        dither[i++] = (48.0f / 65.0f * 255);
-        dither[i++] = (32.0f / 65.0f * 255);
-
-        dither[i++] = (9.0f / 65.0f * 255);
-        dither[i++] = (57.0f / 65.0f * 255);
-        dither[i++] = (5.0f / 65.0f * 255);
-        dither[i++] = (53.0f / 65.0f * 255);
-        dither[i++] = (12.0f / 65.0f * 255);
-        dither[i++] = (60.0f / 65.0f * 255);
-        dither[i++] = (8.0f / 65.0f * 255);
-        dither[i++] = (56.0f / 65.0f * 255);
-
-        dither[i++] = (41.0f / 65.0f * 255);
-        dither[i++] = (25.0f / 65.0f * 255);
-        dither[i++] = (37.0f / 65.0f * 255);
-        dither[i++] = (21.0f / 65.0f * 255);
-        dither[i++] = (44.0f / 65.0f * 255);
-        dither[i++] = (28.0f / 65.0f * 255);
-        dither[i++] = (40.0f / 65.0f * 255);
-        dither[i++] = (24.0f / 65.0f * 255);
-
-        dither[i++] = (3.0f / 65.0f * 255);
-        dither[i++] = (51.0f / 65.0f * 255);
-        dither[i++] = (15.0f / 65.0f * 255);
-        dither[i++] = (63.0f / 65.0f * 255);
-        dither[i++] = (2.0f / 65.0f * 255);
-        dither[i++] = (50.0f / 65.0f * 255);
-        dither[i++] = (14.0f / 65.0f * 255);
-        dither[i++] = (62.0f / 65.0f * 255);
-
-        dither[i++] = (35.0f / 65.0f * 255);
-        dither[i++] = (19.0f / 65.0f * 255);
-        dither[i++] = (47.0f / 65.0f * 255);
-        dither[i++] = (31.0f / 65.0f * 255);
-        dither[i++] = (34.0f / 65.0f * 255);
-        dither[i++] = (18.0f / 65.0f * 255);
-        dither[i++] = (46.0f / 65.0f * 255);
-        dither[i++] = (30.0f / 65.0f * 255);
-
-        dither[i++] = (11.0f / 65.0f * 255);
-        dither[i++] = (59.0f / 65.0f * 255);
-        dither[i++] = (7.0f / 65.0f * 255);
-        dither[i++] = (55.0f / 65.0f * 255);
-        dither[i++] = (10.0f / 65.0f * 255);
-        dither[i++] = (58.0f / 65.0f * 255);
-        dither[i++] = (6.0f / 65.0f * 255);
-        dither[i++] = (54.0f / 65.0f * 255);
-
-        dither[i++] = (43.0f / 65.0f * 255);
-        dither[i++] = (27.0f / 65.0f * 255);
-        dither[i++] = (39.0f / 65.0f * 255);
-        dither[i++] = (23.0f / 65.0f * 255);
-        dither[i++] = (42.0f / 65.0f * 255);
-        dither[i++] = (26.0f / 65.0f * 255);
-        dither[i++] = (38.0f / 65.0f * 255);
-        dither[i++] = (22.0f / 65.0f * 255);
-#else
-        int i           = 0;
-        int dither_size = 4;
+        if (!loaded.cache)
+        {
+            DW_LOG_ERROR("Failed to load mesh: " + loaded.path);
+            return true;
+        }
 
-        dither.resize(dither_size * dither_size);
+        const SceneCacheHeader& header = loaded.cache->header();
 
-        dither[i++] = (0.0f / 16.0f * 255);
-        dither[i++] = (8.0f / 16.0f * 255);
-        dither[i++] = (2.0f / 16.0f * 255);
-        dither[i++] = (10.0f / 16.0f * 255);
+        SceneMesh mesh;
 
-        dither[i++] = (12.0f / 16.0f * 255);
-        dither[i++] = (4.0f / 16.0f * 255);
-        dither[i++] = (14.0f / 16.0f * 255);
-        dither[i++] = (6.0f / 16.0f * 255);
+        glGenVertexArrays(1, &mesh.vao);
+        glGenBuffers(1, &mesh.vbo);
+        glGenBuffers(1, &mesh.ibo);
 
-        dither[i++] = (3.0f / 16.0f * 255);
-        dither[i++] = (11.0f / 16.0f * 255);
-        dither[i++] = (1.0f / 16.0f * 255);
-        dither[i++] = (9.0f / 16.0f * 255);
+        glBindVertexArray(mesh.vao);
 
-        dither[i++] = (15.0f / 16.0f * 255);
-        dither[i++] = (7.0f / 16.0f * 255);
-        dither[i++] = (13.0f / 16.0f * 255);
-        dither[i++] = (5.0f / 16.0f * 255);
-#endif
+        // Storage only, the contents arrive in chunks through the staging buffer.
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(SceneVertex) * header.vertex_count, nullptr, GL_STATIC_DRAW);
 
-        m_dither_texture = std::make_unique<dw::Texture2D>(dither_size, dither_size, 1, 1, 1, GL_R8, GL_RED, GL_UNSIGNED_BYTE);
-        m_dither_texture->set_min_filter(GL_NEAREST);
-        m_dither_texture->set_mag_filter(GL_NEAREST);
-        m_dither_texture->set_wrapping(GL_REPEAT, GL_REPEAT, GL_REPEAT);
-        m_dither_texture->set_data(0, 0, dither.data());
-    }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * header.index_count, nullptr, GL_STATIC_DRAW);
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+        // Same attribute locations as dw::Mesh.
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, tex_coord));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, normal));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, bitangent));
 
-    bool create_uniform_buffer()
-    {
-        // Create uniform buffer for object matrix data
-        m_object_ubo = std::make_unique<dw::UniformBuffer>(GL_DYNAMIC_DRAW, sizeof(ObjectUniforms));
+        glBindVertexArray(0);
 
-        // Create uniform buffer for global data
-        m_global_ubo = std::make_unique<dw::UniformBuffer>(GL_DYNAMIC_DRAW, sizeof(GlobalUniforms));
+        mesh.submeshes.assign(loaded.cache->submeshes(), loaded.cache->submeshes() + header.submesh_count);
+        mesh.bvh = std::move(loaded.bvh);
+        mesh.visible.resize(header.submesh_count);
+        mesh.min_extents = glm::vec3(header.min_extents[0], header.min_extents[1], header.min_extents[2]);
+        mesh.max_extents = glm::vec3(header.max_extents[0], header.max_extents[1], header.max_extents[2]);
 
-        return true;
-    }
+        create_instances(mesh);
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+        create_draw_buffers(mesh);
 
-    void render_rsm()
-    {
-        render_scene(m_rsm_fbo.get(), m_rsm_program, RSM_SIZE, RSM_SIZE, GL_NONE);
-    }
+        m_scene.push_back(std::move(mesh));
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+        m_upload       = SceneUpload();
+        m_upload.cache = std::move(loaded.cache);
+        m_upload.mesh  = uint32_t(m_scene.size() - 1);
 
-    void render_gbuffer()
-    {
-        render_scene(m_gbuffer_fbo.get(), m_gbuffer_program, m_width, m_height, GL_BACK);
+        return true;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void direct_lighting()
+    // Copies the next chunk of the current submesh, vertices first, and makes the submesh drawable once both are complete.
+    // Returns the number of bytes copied.
+    uint64_t upload_scene_chunk(uint64_t budget)
     {
-        glDisable(GL_DEPTH_TEST);
-        glDisable(GL_CULL_FACE);
-        glDisable(GL_BLEND);
+        SceneMesh& mesh = m_scene[m_upload.mesh];
 
-        //m_direct_light_fbo->bind();
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (m_upload.submesh == mesh.submeshes.size())
+        {
+            m_upload.cache.reset();
+            return 0;
+        }
 
-        glViewport(0, 0, m_width, m_height);
+        const SceneSubMesh& submesh = mesh.submeshes[m_upload.submesh];
 
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        uint64_t vertex_size = uint64_t(submesh.vertex_count) * sizeof(SceneVertex);
+        uint64_t index_size  = uint64_t(submesh.index_count) * sizeof(uint32_t);
+        uint64_t size        = 0;
 
-        // Bind shader program.
-        m_direct_program->use();
+        if (m_upload.vertex_bytes < vertex_size)
+        {
+            size = std::min(std::min(vertex_size - m_upload.vertex_bytes, budget), uint64_t(UPLOAD_STAGING_SIZE));
 
-        if (m_direct_program->set_uniform("s_Albedo", 0))
-            m_gbuffer_albedo_rt->bind(0);
+            const uint8_t* src    = (const uint8_t*)(m_upload.cache->vertices() + submesh.base_vertex) + m_upload.vertex_bytes;
+            uint64_t       offset = uint64_t(submesh.base_vertex) * sizeof(SceneVertex) + m_upload.vertex_bytes;
 
-        if (m_direct_program->set_uniform("s_Normals", 1))
-            m_gbuffer_normals_rt->bind(1);
+            stage_upload(mesh.vbo, offset, src, size);
+            m_upload.vertex_bytes += size;
+        }
+        else if (m_upload.index_bytes < index_size)
+        {
+            size = std::min(std::min(index_size - m_upload.index_bytes, budget), uint64_t(UPLOAD_STAGING_SIZE));
 
-        if (m_direct_program->set_uniform("s_WorldPos", 2))
-            m_gbuffer_world_pos_rt->bind(2);
+            const uint8_t* src    = (const uint8_t*)(m_upload.cache->indices() + submesh.base_index) + m_upload.index_bytes;
+            uint64_t       offset = uint64_t(submesh.base_index) * sizeof(uint32_t) + m_upload.index_bytes;
 
-        if (m_direct_program->set_uniform("s_ShadowMap", 3))
-            m_rsm_depth_rt->bind(3);
+            stage_upload(mesh.ibo, offset, src, size);
+            m_upload.index_bytes += size;
+        }
+
+        if (m_upload.vertex_bytes == vertex_size && m_upload.index_bytes == index_size)
+        {
+            mesh.resident_submeshes++;
 
-        m_direct_program->set_uniform("u_LightPos", m_flash_light ? m_main_camera->m_position : m_light_pos);
-        m_direct_program->set_uniform("u_LightDirection", m_flash_light ? m_main_camera->m_forward : m_light_dir);
-        m_direct_program->set_uniform("u_LightColor", m_light_color);
-        m_direct_program->set_uniform("u_LightInnerCutoff", cosf(glm::radians(m_inner_cutoff)));
-        m_direct_program->set_uniform("u_LightOuterCutoff", cosf(glm::radians(m_outer_cutoff)));
-        m_direct_program->set_uniform("u_LightIntensity", m_light_intensity);
-        m_direct_program->set_uniform("u_LightRange", m_light_range);
-        m_direct_program->set_uniform("u_LightBias", m_light_bias);
+            m_upload.submesh++;
+            m_upload.vertex_bytes = 0;
+            m_upload.index_bytes  = 0;
 
-        // Bind uniform buffers.
-        m_global_ubo->bind_base(0);
+            m_scene_version++;
+        }
 
-        // Render fullscreen triangle
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+        return size;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void indirect_lighting()
+    // Creates the material buffer that the multi-draw shaders index by submesh.
+    void create_draw_buffers(SceneMesh& mesh)
     {
-        glDisable(GL_DEPTH_TEST);
-        glDisable(GL_CULL_FACE);
-        glDisable(GL_BLEND);
+        uint32_t count = uint32_t(mesh.submeshes.size());
 
-        if (m_screenspace_interpolation)
-        {
-            m_scaled_indirect_fbo->bind();
-            glViewport(0, 0, m_width * SCALED_INDIRECT, m_height * SCALED_INDIRECT);
-        }
-        else
+        std::vector<MaterialData> materials(count);
+
+        for (uint32_t i = 0; i < count; i++)
         {
-            m_indirect_fbo->bind();
-            glViewport(0, 0, m_width, m_height);
-        }
+            const SceneSubMesh& submesh = mesh.submeshes[i];
 
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+            materials[i].albedo = glm::vec4(submesh.albedo[0], submesh.albedo[1], submesh.albedo[2], submesh.albedo[3]);
+        }
 
-        // Bind shader program.
-        m_indirect_program->use();
+        glGenBuffers(1, &mesh.material_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh.material_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(MaterialData) * count, materials.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
 
-        if (m_indirect_program->set_uniform("s_Normals", 0))
-            m_gbuffer_normals_rt->bind(0);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        if (m_indirect_program->set_uniform("s_WorldPos", 1))
-            m_gbuffer_world_pos_rt->bind(1);
+    // Writes the commands of the submeshes in the draw list of the pass into the uniform ring, whose fences keep the
+    // commands of earlier frames intact until their draws are done. The base instance carries the submesh index, which the
+    // shaders use to look up the material.
+    UniformRange write_draw_commands(const SceneMesh& mesh, ScenePass pass, uint32_t instances)
+    {
+        const std::vector<uint32_t>& draw_list = mesh.draw_lists[pass];
 
-        if (m_indirect_program->set_uniform("s_RSMFlux", 2))
-            m_rsm_flux_rt->bind(2);
+        m_draw_commands.resize(draw_list.size());
 
-        if (m_indirect_program->set_uniform("s_RSMNormals", 3))
-            m_rsm_normals_rt->bind(3);
+        for (uint32_t i = 0; i < m_draw_commands.size(); i++)
+        {
+            const SceneSubMesh&          submesh = mesh.submeshes[draw_list[i]];
+            DrawElementsIndirectCommand& command = m_draw_commands[i];
+
+            command.count          = submesh.index_count;
+            command.instance_count = instances;
+            command.first_index    = submesh.base_index;
+            command.base_vertex    = int32_t(submesh.base_vertex);
+            command.base_instance  = draw_list[i];
+        }
 
-        if (m_indirect_program->set_uniform("s_RSMWorldPos", 4))
-            m_rsm_world_pos_rt->bind(4);
+        return m_uniform_ring.push(m_draw_commands.data(), sizeof(DrawElementsIndirectCommand) * m_draw_commands.size());
+    }
 
-        if (m_indirect_program->set_uniform("s_Samples", 5))
-            m_samples_texture->bind(5);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        if (m_indirect_program->set_uniform("s_Dither", 6))
-            m_dither_texture->bind(6);
+    // Extracts the six clip planes of a view-projection matrix (Gribb and Hartmann). The planes are left unnormalized since
+    // culling only looks at the sign of the distances.
+    static void extract_frustum_planes(const glm::mat4& view_proj, CullPlane* planes)
+    {
+        glm::vec4 rows[4];
 
-        m_indirect_program->set_uniform("u_Dither", m_enable_dither ? 1 : 0);
-        m_indirect_program->set_uniform("u_NumSamples", m_num_samples);
-        m_indirect_program->set_uniform("u_SampleRadius", m_sample_radius * (1.0f / float(RSM_SIZE)));
-        m_indirect_program->set_uniform("u_IndirectLightAmount", m_indirect_light_amount);
-        m_indirect_program->set_uniform("u_LightPos", m_flash_light ? m_main_camera->m_position : m_light_pos);
-        m_indirect_program->set_uniform("u_LightDirection", m_flash_light ? m_main_camera->m_forward : m_light_dir);
-        m_indirect_program->set_uniform("u_LightInnerCutoff", cosf(glm::radians(m_inner_cutoff)));
-        m_indirect_program->set_uniform("u_LightOuterCutoff", cosf(glm::radians(m_outer_cutoff)));
-        m_indirect_program->set_uniform("u_LightRange", m_light_range);
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
 
-        // Bind uniform buffers.
-        m_global_ubo->bind_base(0);
+        glm::vec4 equations[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
 
-        // Render fullscreen triangle
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+        for (int i = 0; i < 6; i++)
+        {
+            planes[i].normal[0] = equations[i].x;
+            planes[i].normal[1] = equations[i].y;
+            planes[i].normal[2] = equations[i].z;
+            planes[i].distance  = equations[i].w;
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void copy_indirect()
+    // Builds the planes of the view volume of the pass in the object space of an instance, so that the submesh bounds are
+    // tested as they are. The camera pass has a single frustum, the RSM pass one per light.
+    //
+    // Spot lights contribute nothing beyond m_light_range, so the far plane of each light is moved in to that distance.
+    void extract_pass_planes(ScenePass pass, const glm::mat4& model, CullPlane* planes)
     {
-        glDisable(GL_DEPTH_TEST);
-        glDisable(GL_CULL_FACE);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        glViewport(0, 0, m_width, m_height);
-
-        if (m_indirect_only)
+        if (pass == SCENE_PASS_GBUFFER)
         {
-            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT);
+            extract_frustum_planes(m_global_uniforms.view_proj * model, planes);
+            return;
         }
 
-        // Bind shader program.
-        m_copy_program->use();
+        glm::mat4 model_t = glm::transpose(model);
 
-        if (m_copy_program->set_uniform("s_Color", 0))
+        for (int i = 0; i < m_light_count; i++)
         {
-            if (m_screenspace_interpolation)
-                m_scaled_indirect_rt->bind(0);
-            else
-                m_indirect_rt->bind(0);
-        }
+            const LightData& light = m_light_uniforms.lights[i];
 
-        // Render fullscreen triangle
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+            extract_frustum_planes(light.view_proj * model, &planes[6 * i]);
+
+            // Points within range of the light satisfy dot(-direction, p) + dot(direction, position) + range >= 0.
+            glm::vec3 direction = glm::vec3(light.direction);
+            glm::vec4 range     = model_t * glm::vec4(-direction, glm::dot(direction, glm::vec3(light.position)) + m_light_range);
+
+            planes[6 * i + 5].normal[0] = range.x;
+            planes[6 * i + 5].normal[1] = range.y;
+            planes[6 * i + 5].normal[2] = range.z;
+            planes[6 * i + 5].distance  = range.w;
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void ui()
+    // Fills the instance and draw lists of the pass with the instances and resident submeshes that intersect its view
+    // volume, and writes the transforms of the visible instances to the uniform ring.
+    //
+    // All visible instances of a mesh are drawn with the same commands, and the RSM pass draws every light in the same
+    // call, so a submesh is kept if it is inside any of the volumes of any visible instance.
+    void cull_scene(ScenePass pass)
     {
-        ImGui::Checkbox("Indirect Lighting", &m_rsm_enabled);
-
-        if (m_rsm_enabled)
-            ImGui::Checkbox("Indirect Only", &m_indirect_only);
+        std::vector<CullPlane> planes(pass == SCENE_PASS_GBUFFER ? 6 : 6 * m_light_count);
 
-        ImGui::Checkbox("Use as Flashlight", &m_flash_light);
+        m_culling_stats[pass] = glm::ivec4(0);
 
-        if (!m_flash_light)
+        for (auto& mesh : m_scene)
         {
-            ImGui::InputFloat3("Light Position", &m_light_pos.x);
-            ImGui::InputFloat3("Light Target", &m_light_target.x);
-        }
+            std::vector<uint32_t>&  draw_list         = mesh.draw_lists[pass];
+            std::vector<glm::mat4>& visible_instances = mesh.visible_instances[pass];
 
-        ImGui::Checkbox("Dither", &m_enable_dither);
-        ImGui::Checkbox("Screen Space Interpolation", &m_screenspace_interpolation);
-        ImGui::InputInt("Num RSM Samples", &m_num_samples);
-        ImGui::InputFloat("Sample Radius", &m_sample_radius);
-        ImGui::InputFloat("Indirect Light Amount", &m_indirect_light_amount);
-        ImGui::InputFloat("Light Inner Cutoff", &m_inner_cutoff);
-        ImGui::InputFloat("Light Outer Cutoff", &m_outer_cutoff);
-        ImGui::InputFloat("Light Range", &m_light_range);
-        ImGui::InputFloat("Light Bias", &m_light_bias);
-        ImGui::ColorEdit3("Light Color", &m_light_color.x);
+            draw_list.clear();
+            visible_instances.clear();
 
-        ImGui::Separator();
+            std::fill(mesh.visible.begin(), mesh.visible.end(), m_frustum_culling ? 0 : 1);
 
-        if (ImGui::Button("G-Buffer Albedo"))
-            m_gbuffer_albedo_rt->save_to_disk("GBuffer_Albedo", 0, 0);
+            for (const glm::mat4& model : mesh.instances)
+            {
+                if (m_frustum_culling)
+                {
+                    extract_pass_planes(pass, model, planes.data());
 
-        if (ImGui::Button("G-Buffer World Pos"))
-            m_gbuffer_world_pos_rt->save_to_disk("GBuffer_WorldPos", 0, 0);
+                    bool instance_visible = false;
 
-        if (ImGui::Button("G-Buffer Normals"))
-            m_gbuffer_normals_rt->save_to_disk("GBuffer_Normal", 0, 0);
+                    for (uint32_t i = 0; i < planes.size(); i += 6)
+                        instance_visible |= mesh.bvh.cull(&planes[i], 6, mesh.visible.data());
 
-        if (ImGui::Button("RSM Flux"))
-            m_rsm_flux_rt->save_to_disk("RSM_Flux", 0, 0);
+                    if (!instance_visible)
+                        continue;
+                }
+
+                visible_instances.push_back(model);
+            }
 
-        if (ImGui::Button("RSM World Pos"))
-            m_rsm_world_pos_rt->save_to_disk("RSM_WorldPos", 0, 0);
+            m_culling_stats[pass].z += int(visible_instances.size());
+            m_culling_stats[pass].w += int(mesh.instances.size());
+            m_culling_stats[pass].y += int(mesh.resident_submeshes);
 
-        if (ImGui::Button("RSM Normals"))
-            m_rsm_normals_rt->save_to_disk("RSM_Normals", 0, 0);
+            if (visible_instances.empty())
+                continue;
 
-        update_spot_light();
+            mesh.instance_ranges[pass] = m_uniform_ring.push(visible_instances.data(), sizeof(glm::mat4) * visible_instances.size());
+
+            // The ring is full, skip the mesh rather than bind an empty range.
+            if (mesh.instance_ranges[pass].size == 0)
+                continue;
+
+            for (uint32_t i = 0; i < mesh.resident_submeshes; i++)
+            {
+                if (mesh.visible[i])
+                    draw_list.push_back(i);
+            }
+
+            m_culling_stats[pass].x += int(draw_list.size());
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    bool load_scene()
+    // Lays the instances of the mesh out on an m_instance_grid x m_instance_grid grid, centered in front of the camera and
+    // receding away from it, with a gap of a quarter of the mesh size in between.
+    void create_instances(SceneMesh& mesh)
     {
-        dw::Mesh* sponza = dw::Mesh::load("mesh/cornell_box.obj");
+        glm::vec3 spacing = (mesh.max_extents - mesh.min_extents) * SCENE_SCALE * 1.25f;
+
+        mesh.instances.clear();
 
-        if (!sponza)
+        for (int z = 0; z < m_instance_grid; z++)
         {
-            DW_LOG_FATAL("Failed to load mesh!");
-            return false;
+            for (int x = 0; x < m_instance_grid; x++)
+            {
+                glm::vec3 offset = glm::vec3((float(x) - 0.5f * float(m_instance_grid - 1)) * spacing.x, 0.0f, -float(z) * spacing.z);
+
+                mesh.instances.push_back(glm::translate(glm::mat4(1.0f), offset) * glm::scale(glm::mat4(1.0f), glm::vec3(SCENE_SCALE)));
+            }
         }
+    }
 
-        m_scene.push_back(sponza);
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        return true;
+    // Multi-draw needs gl_BaseInstance from GL_ARB_shader_draw_parameters (core in GL 4.6), the persistently mapped
+    // uniform ring needs GL_ARB_buffer_storage (core in GL 4.4).
+    bool extension_supported(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+        for (GLint i = 0; i < count; i++)
+        {
+            if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Writes the data into the staging buffer and copies it into the destination on the GPU. Mapping with
+    // GL_MAP_INVALIDATE_BUFFER_BIT orphans the previous contents, so the staging buffer can be reused while earlier copies
+    // out of it are still pending.
+    void stage_upload(GLuint buffer, uint64_t offset, const void* data, uint64_t size)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, m_staging_buffer);
+
+        void* ptr = glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        memcpy(ptr, data, size);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, size);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -774,32 +3279,56 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void render_mesh(dw::Mesh* mesh, std::unique_ptr<dw::Program>& program)
+    // Draws every visible instance of the mesh 'layers' times, once for each RSM layer.
+    void render_mesh(SceneMesh& mesh, std::unique_ptr<CachedProgram>& program, ScenePass pass, uint32_t layers)
     {
-        // Bind uniform buffers.
-        m_object_ubo->bind_base(1);
+        const std::vector<uint32_t>& draw_list = mesh.draw_lists[pass];
+
+        if (draw_list.empty())
+            return;
+
+        uint32_t instances = uint32_t(mesh.visible_instances[pass].size()) * layers;
+
+        // Bind the instance transforms.
+        m_uniform_ring.bind_storage(2, mesh.instance_ranges[pass]);
 
         // Bind vertex array.
-        mesh->mesh_vertex_array()->bind();
+        glBindVertexArray(mesh.vao);
 
-        dw::SubMesh* submeshes = mesh->sub_meshes();
+        if (m_multi_draw_indirect)
+        {
+            UniformRange commands = write_draw_commands(mesh, pass, instances);
+
+            // The ring is full, its error has been logged.
+            if (commands.size == 0)
+                return;
+
+            m_uniform_ring.bind_draw_indirect();
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mesh.material_buffer);
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)commands.offset, GLsizei(draw_list.size()), 0);
 
-        for (uint32_t i = 0; i < mesh->sub_mesh_count(); i++)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return;
+        }
+
+        for (uint32_t i : draw_list)
         {
-            dw::SubMesh& submesh = submeshes[i];
+            const SceneSubMesh& submesh = mesh.submeshes[i];
 
-            if (submesh.mat)
-                program->set_uniform("u_Diffuse", submesh.mat->albedo_value());
+            program->set_uniform("u_Diffuse", glm::vec4(submesh.albedo[0], submesh.albedo[1], submesh.albedo[2], submesh.albedo[3]));
 
             // Issue draw call.
-            glDrawElementsBaseVertex(GL_TRIANGLES, submesh.index_count, GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * submesh.base_index), submesh.base_vertex);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, submesh.index_count, GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * submesh.base_index), instances, submesh.base_vertex);
         }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void render_scene(dw::Framebuffer* fbo, std::unique_ptr<dw::Program>& program, int w, int h, GLenum cull_face)
+    void render_scene(dw::Framebuffer* fbo, std::unique_ptr<CachedProgram>& program, int w, int h, GLenum cull_face, ScenePass pass, uint32_t layers = 1)
     {
+        cull_scene(pass);
+
         glEnable(GL_DEPTH_TEST);
         glDisable(GL_BLEND);
 
@@ -822,43 +3351,158 @@ private:
         glClearDepth(1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // glClear leaves integer color buffers undefined.
+        if (pass == SCENE_PASS_RSM && m_packed_rsm)
+        {
+            GLuint zero[] = { 0, 0, 0, 0 };
+            glClearBufferuiv(GL_COLOR, 0, zero);
+        }
+
         // Bind shader program.
         program->use();
 
         // Bind uniform buffers.
-        m_global_ubo->bind_base(0);
+        m_uniform_ring.bind(0, m_global_uniform_range);
+        m_uniform_ring.bind(2, m_light_uniform_range);
 
         // Draw scene.
         for (auto& mesh : m_scene)
-            render_mesh(mesh, program);
+            render_mesh(mesh, program, pass, layers);
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void update_object_uniforms(const ObjectUniforms& transform)
+    void update_global_uniforms(const GlobalUniforms& global)
     {
-        void* ptr = m_object_ubo->map(GL_WRITE_ONLY);
-        memcpy(ptr, &transform, sizeof(ObjectUniforms));
-        m_object_ubo->unmap();
+        m_global_uniform_range = m_uniform_ring.push(&global, sizeof(GlobalUniforms));
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void update_global_uniforms(const GlobalUniforms& global)
+    // Fills the light array and splits the sample budget between the lights in proportion to their estimated reflected
+    // flux, so that dim lights do not cost as much as bright ones. Every light keeps at least one sample.
+    void update_light_uniforms()
+    {
+        for (int i = 0; i < m_light_count; i++)
+        {
+            LightData& data = m_light_uniforms.lights[i];
+
+            glm::vec3 position;
+            glm::vec3 direction;
+            glm::vec3 color;
+
+            if (i == 0)
+            {
+                position       = m_flash_light ? m_main_camera->m_position : m_light_pos;
+                direction      = m_flash_light ? m_main_camera->m_forward : m_light_dir;
+                color          = m_light_color * m_light_intensity;
+                data.view_proj = m_light_proj * m_light_view;
+            }
+            else
+            {
+                const SpotLight& light = m_extra_lights[i - 1];
+
+                position       = light.position;
+                direction      = glm::normalize(light.target - light.position);
+                color          = light.color * light.intensity;
+                data.view_proj = m_light_proj * glm::lookAt(position, position + direction, glm::vec3(0.0f, 1.0f, 0.0f));
+            }
+
+            data.inv_view_proj = glm::inverse(data.view_proj);
+            data.position      = glm::vec4(position, m_light_range);
+            data.direction     = glm::vec4(direction, m_light_bias);
+            data.color         = glm::vec4(color, 1.0f);
+            data.cutoff        = glm::vec4(cosf(glm::radians(m_inner_cutoff)), cosf(glm::radians(m_outer_cutoff)), 0.0f, 0.0f);
+        }
+
+        m_light_uniforms.light_count = glm::ivec4(m_light_count, 0, 0, 0);
+
+        // Step through the sample set between frames when accumulating so that consecutive frames use different samples.
+        int polar_budget = m_temporal_accumulation ? std::min(m_temporal_samples, m_num_samples) : m_num_samples;
+        int polar_offset = m_temporal_accumulation ? int((m_frame_index * polar_budget) % m_num_samples) : 0;
+
+        std::vector<int> polar_samples;
+        std::vector<int> importance_samples;
+
+        split_sample_budget(polar_budget, polar_samples);
+        split_sample_budget(m_importance_samples, importance_samples);
+
+        for (int i = 0; i < m_light_count; i++)
+        {
+            glm::ivec4& samples = m_light_uniforms.lights[i].samples;
+
+            // A new split changes the result, the per-frame offsets of temporal accumulation are handled by its convergence.
+            if (samples.x != polar_samples[i] || samples.z != importance_samples[i])
+                m_settings_version++;
+
+            samples = glm::ivec4(polar_samples[i], polar_offset % m_num_samples, importance_samples[i], 0);
+            polar_offset += polar_samples[i];
+        }
+
+        m_light_uniform_range = m_uniform_ring.push(&m_light_uniforms, sizeof(LightUniforms));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Largest remainder split of 'budget' by the light estimates, evenly while there are none yet.
+    void split_sample_budget(int budget, std::vector<int>& samples)
     {
-        void* ptr = m_global_ubo->map(GL_WRITE_ONLY);
-        memcpy(ptr, &global, sizeof(GlobalUniforms));
-        m_global_ubo->unmap();
+        samples.assign(m_light_count, 1);
+
+        int remaining = std::max(budget - m_light_count, 0);
+
+        if (remaining == 0)
+            return;
+
+        float total = 0.0f;
+
+        if (m_light_estimates.size() == m_light_count)
+        {
+            for (float estimate : m_light_estimates)
+                total += estimate;
+        }
+
+        std::vector<float> shares(m_light_count);
+
+        for (int i = 0; i < m_light_count; i++)
+            shares[i] = total > 0.0f ? remaining * m_light_estimates[i] / total : float(remaining) / float(m_light_count);
+
+        int assigned = 0;
+
+        for (int i = 0; i < m_light_count; i++)
+        {
+            int count = int(shares[i]);
+
+            samples[i] += count;
+            shares[i] -= float(count);
+            assigned += count;
+        }
+
+        // Hand out what is left to the largest remainders.
+        for (; assigned < remaining; assigned++)
+        {
+            int largest = int(std::max_element(shares.begin(), shares.end()) - shares.begin());
+
+            samples[largest]++;
+            shares[largest] = -1.0f;
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
     void update_transforms(dw::Camera* camera)
     {
+        glm::mat4 view_proj = camera->m_projection * camera->m_view;
+
+        if (memcmp(&view_proj, &m_global_uniforms.view_proj, sizeof(glm::mat4)) != 0)
+            m_camera_version++;
+
         // Update camera matrices.
+        m_global_uniforms.prev_view_proj  = m_global_uniforms.view_proj;
         m_global_uniforms.view_proj       = camera->m_projection * camera->m_view;
         m_global_uniforms.light_view_proj = m_light_proj * m_light_view;
         m_global_uniforms.cam_pos         = glm::vec4(camera->m_position, 0.0f);
+        m_global_uniforms.inv_view_proj   = glm::inverse(m_global_uniforms.view_proj);
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -899,48 +3543,79 @@ private:
             m_light_proj = glm::perspective(glm::radians(2.0f * m_outer_cutoff), 1.0f, 1.0f, 1000.0f);
         }
 
+        uint32_t camera_version = m_camera_version;
+
         update_transforms(current);
+
+        // The flashlight moves with the camera.
+        if (m_flash_light && camera_version != m_camera_version)
+            m_light_version++;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
 private:
     // General GPU resources.
-    std::unique_ptr<dw::Shader> m_fullscreen_triangle_vs;
-    std::unique_ptr<dw::Shader> m_direct_fs;
-    std::unique_ptr<dw::Shader> m_indirect_fs;
-    std::unique_ptr<dw::Shader> m_copy_fs;
-    std::unique_ptr<dw::Shader> m_rsm_vs;
-    std::unique_ptr<dw::Shader> m_gbuffer_vs;
-    std::unique_ptr<dw::Shader> m_gbuffer_fs;
-
-    std::unique_ptr<dw::Program> m_indirect_program;
-    std::unique_ptr<dw::Program> m_rsm_program;
-    std::unique_ptr<dw::Program> m_gbuffer_program;
-    std::unique_ptr<dw::Program> m_direct_program;
-    std::unique_ptr<dw::Program> m_copy_program;
-
-    std::unique_ptr<dw::Texture2D> m_gbuffer_albedo_rt;
-    std::unique_ptr<dw::Texture2D> m_gbuffer_normals_rt;
-    std::unique_ptr<dw::Texture2D> m_gbuffer_world_pos_rt;
-    std::unique_ptr<dw::Texture2D> m_gbuffer_depth_rt;
-    std::unique_ptr<dw::Texture2D> m_rsm_flux_rt;
-    std::unique_ptr<dw::Texture2D> m_rsm_normals_rt;
-    std::unique_ptr<dw::Texture2D> m_rsm_world_pos_rt;
-    std::unique_ptr<dw::Texture2D> m_rsm_depth_rt;
-    std::unique_ptr<dw::Texture2D> m_direct_light_rt;
+
+    ProgramCache                   m_program_cache;
+    bool                           m_program_cache_enabled = true;
+    std::unique_ptr<CachedProgram> m_indirect_program;
+    std::unique_ptr<CachedProgram> m_indirect_compute_program;
+    std::unique_ptr<CachedProgram> m_rsm_program;
+    std::unique_ptr<CachedProgram> m_gbuffer_program;
+    std::unique_ptr<CachedProgram> m_direct_program;
+    std::unique_ptr<CachedProgram> m_copy_program;
+    std::unique_ptr<CachedProgram> m_interpolate_program;
+    std::unique_ptr<CachedProgram> m_upsample_program;
+    std::unique_ptr<CachedProgram> m_blur_program;
+    std::unique_ptr<CachedProgram> m_temporal_program;
+    std::unique_ptr<CachedProgram> m_rsm_luminance_program;
+    std::unique_ptr<CachedProgram> m_vpl_cluster_init_program;
+    std::unique_ptr<CachedProgram> m_vpl_cluster_assign_program;
+    std::unique_ptr<CachedProgram> m_vpl_cluster_update_program;
+
+    // Gather programs specialized for the current settings, keyed by stage and defines.
+    std::unordered_map<std::string, std::unique_ptr<CachedProgram>> m_gather_permutations;
+    std::vector<std::string>                                         m_indirect_defines;
+    std::vector<std::string>                                         m_indirect_compute_defines;
+    bool                                                             m_shader_permutations = true;
+
+    // Render targets, owned by the render graph and null while no enabled pass uses them.
+    RenderGraph    m_render_graph;
+    dw::Texture2D* m_gbuffer_albedo_rt      = nullptr;
+    dw::Texture2D* m_gbuffer_normals_rt     = nullptr;
+    dw::Texture2D* m_gbuffer_world_pos_rt   = nullptr;
+    dw::Texture2D* m_gbuffer_depth_rt       = nullptr;
+    dw::Texture2D* m_rsm_flux_rt            = nullptr;
+    dw::Texture2D* m_rsm_normals_rt         = nullptr;
+    dw::Texture2D* m_rsm_world_pos_rt       = nullptr;
+    dw::Texture2D* m_rsm_packed_rt          = nullptr;
+    dw::Texture2D* m_rsm_depth_rt           = nullptr;
+    dw::Texture2D* m_rsm_luminance_rt       = nullptr;
+    dw::Texture2D* m_vpl_labels             = nullptr;
+    dw::Texture2D* m_composite_rt           = nullptr;
+    dw::Texture2D* m_indirect_rt            = nullptr;
+    dw::Texture2D* m_scaled_indirect_rt     = nullptr;
+    dw::Texture2D* m_indirect_stencil_rt    = nullptr;
+    dw::Texture2D* m_blur_rt                = nullptr;
+    dw::Texture2D* m_history_rt[2]          = { nullptr, nullptr };
+    dw::Texture2D* m_history_geometry_rt[2] = { nullptr, nullptr };
+
     std::unique_ptr<dw::Texture2D> m_dither_texture;
-    std::unique_ptr<dw::Texture2D> m_indirect_rt;
-    std::unique_ptr<dw::Texture2D> m_scaled_indirect_rt;
 
     std::unique_ptr<dw::Framebuffer> m_gbuffer_fbo;
     std::unique_ptr<dw::Framebuffer> m_rsm_fbo;
-    std::unique_ptr<dw::Framebuffer> m_direct_light_fbo;
+    std::unique_ptr<dw::Framebuffer> m_composite_fbo;
     std::unique_ptr<dw::Framebuffer> m_indirect_fbo;
     std::unique_ptr<dw::Framebuffer> m_scaled_indirect_fbo;
+    std::unique_ptr<dw::Framebuffer> m_blur_fbo;
+    std::unique_ptr<dw::Framebuffer> m_history_fbo[2];
+
+    UniformRing  m_uniform_ring;
+    UniformRange m_global_uniform_range;
+    UniformRange m_light_uniform_range;
 
-    std::unique_ptr<dw::UniformBuffer> m_object_ubo;
-    std::unique_ptr<dw::UniformBuffer> m_global_ubo;
+    std::unique_ptr<dw::ShaderStorageBuffer> m_vpl_cluster_ssbo;
 
     // Camera.
     std::unique_ptr<dw::Camera> m_main_camera;
@@ -959,21 +3634,108 @@ private:
     float     m_light_bias;
     bool      m_flash_light = false;
 
+    // Multiple lights
+    int                    m_light_count = 1;
+    int                    m_rsm_size       = RSM_SIZE;
+    int                    m_rsm_resolution = RSM_SIZE; // RSM size with up to 4 lights, more lights get smaller layers.
+    std::vector<SpotLight> m_extra_lights;
+    std::vector<float>     m_light_estimates;
+    int                    m_light_estimate_count = 0;
+    GLuint                 m_light_estimate_pbo   = 0;
+    GLsync                 m_light_estimate_fence = nullptr;
+
     // RSM
+    int                            m_sample_set                = SAMPLE_SET_SOBOL;
     bool                           m_rsm_enabled               = true;
     bool                           m_indirect_only             = false;
     bool                           m_screenspace_interpolation = true;
     int                            m_num_samples               = SAMPLES_TEXTURE_SIZE;
+    int                            m_samples_texture_size      = SAMPLES_TEXTURE_SIZE;
     float                          m_indirect_light_amount     = 3.0f;
     float                          m_sample_radius             = 500.0f;
+    float                          m_pattern_rotation          = 0.0f; // Fixed rotation of the sample pattern when not accumulating.
     std::unique_ptr<dw::Texture2D> m_samples_texture;
+    std::vector<glm::vec3>         m_samples;
+
+    // Indirect gather
+    int  m_gather_mode        = INDIRECT_GATHER_POLAR;
+    int  m_importance_samples = 16;
+    int  m_importance_level   = 1;
+    bool m_compute_gather     = false;
+
+    // VPL clustering
+    int   m_vpl_count         = 1024;
+    int   m_vpl_iterations    = 2;
+    float m_vpl_normal_weight = 4.0f;
+    float m_vpl_flux_weight   = 2.0f;
+
+    // Temporal accumulation
+    bool     m_temporal_accumulation     = false;
+    bool     m_history_valid             = false;
+    int      m_temporal_samples          = 8;
+    float    m_temporal_blend_factor     = 0.1f;
+    float    m_temporal_normal_threshold = 0.9f;
+    float    m_temporal_depth_threshold  = 0.05f;
+    uint32_t m_frame_index               = 0;
+
+    // Pass scheduling
+    bool       m_skip_unchanged_passes = true;
+    uint32_t   m_light_version         = 0;
+    uint32_t   m_camera_version        = 0;
+    uint32_t   m_scene_version         = 0;
+    uint32_t   m_settings_version      = 0;
+    uint32_t   m_static_frames         = 0;
+    PassInputs m_rsm_inputs;
+    PassInputs m_gbuffer_inputs;
+    PassInputs m_lighting_inputs;
+
+    // Adaptive quality
+    bool              m_adaptive_quality  = false;
+    float             m_target_frame_time = 16.6f;
+    uint64_t          m_quality_measured  = 0;
+    QualityController m_quality_controller;
+
+    // Screen space interpolation
+    float  m_indirect_scale                   = SCALED_INDIRECT;
+    float  m_interpolation_normal_threshold   = 0.9f;
+    float  m_interpolation_distance_threshold = 0.01f;
+    float  m_refined_pixel_ratio              = 0.0f;
+    bool   m_refine_query_pending             = false;
+    GLuint m_refine_query                     = 0;
+
+    // Reconstruction
+    int   m_upsample_mode          = UPSAMPLE_JOINT_BILATERAL;
+    int   m_upsample_radius        = 2;
+    bool  m_edge_aware_blur        = false;
+    int   m_blur_radius            = 4;
+    float m_bilateral_normal_power = 16.0f;
+    float m_bilateral_depth_sigma  = 0.01f;
 
     // Uniforms.
-    ObjectUniforms m_object_transforms;
     GlobalUniforms m_global_uniforms;
+    LightUniforms  m_light_uniforms;
 
     // Scene
-    std::vector<dw::Mesh*> m_scene;
+    std::vector<SceneMesh> m_scene;
+    bool                   m_multi_draw_indirect  = true;
+    bool                   m_multi_draw_supported = false;
+    bool                   m_frustum_culling      = true;
+    int                    m_instance_grid        = 1;
+    glm::ivec4             m_culling_stats[SCENE_PASS_COUNT] = { glm::ivec4(0), glm::ivec4(0) };
+
+    std::vector<DrawElementsIndirectCommand> m_draw_commands; // Scratch list reused by every multi-draw.
+
+    // Asynchronous scene loading
+    std::vector<std::string>                       m_scene_paths;
+    std::unique_ptr<ThreadPool>                    m_loader_pool;
+    std::mutex                                     m_loader_mutex;
+    std::deque<LoadedScene>                        m_loaded_scenes;
+    std::atomic<bool>                              m_loader_cancelled { false };
+    uint32_t                                       m_pending_scenes = 0;
+    SceneUpload                                    m_upload;
+    GLuint                                         m_staging_buffer = 0;
+    bool                                           m_scene_loaded   = false;
+    std::chrono::high_resolution_clock::time_point m_scene_load_start;
 
     // Camera controls.
     bool  m_mouse_look         = false;
@@ -981,12 +3743,52 @@ private:
     float m_sideways_speed     = 0.0f;
     float m_camera_sensitivity = 0.05f;
     float m_camera_speed       = 0.02f;
-    bool  m_enable_dither      = true;
+    int   m_dither_mode        = DITHER_BLUE_NOISE;
+    int   m_dither_size        = BLUE_NOISE_SIZE;
+    bool  m_bayer_8x8          = false;
+    bool  m_compact_gbuffer    = false;
+    bool  m_packed_rsm         = false;
     bool  m_debug_gui          = true;
 
     // Camera orientation.
     float m_camera_x;
     float m_camera_y;
+
+    // Benchmark.
+    bool                                           m_bench_mode   = false;
+    uint32_t                                       m_bench_frames = 500;
+    uint32_t                                       m_bench_warmup = 30;
+    uint32_t                                       m_bench_frame  = 0;
+    std::string                                    m_bench_output = "bench_results.json";
+    std::string                                    m_bench_path_file;
+    BenchmarkPath                                  m_bench_path;
+    BenchmarkRecorder                              m_bench_recorder;
+    GLuint                                         m_bench_queries[BENCH_QUERY_COUNT][2]; // Start and end timestamps of a frame.
+    std::chrono::high_resolution_clock::time_point m_bench_frame_start;
+    std::string                                    m_trace_output;
+
+    // Quality sweep.
+    bool               m_sweep_mode      = false;
+    int                m_sweep_views     = 4;
+    int                m_sweep_frames    = 8;
+    std::string        m_sweep_output    = "sweep.csv";
+    std::vector<int>   m_sweep_samples   = { 16, 32, 64, 128 };
+    std::vector<float> m_sweep_radii     = { 250.0f, 500.0f, 750.0f };
+    std::vector<int>   m_sweep_rsm_sizes = { 512, 1024, 2048 };
+    QualitySweep       m_sweep;
+    int                m_sweep_view         = 0;
+    int                m_sweep_config       = 0;
+    int                m_sweep_frame        = 0;
+    bool               m_sweep_reference    = true;
+    double             m_sweep_gpu_ms       = 0.0;
+    int                m_sweep_gpu_frames   = 0;
+    int                m_sweep_base_samples = SAMPLES_TEXTURE_SIZE;
+    float              m_sweep_light_amount = 3.0f;
+    RsmImage           m_sweep_image;
+    RsmImage           m_sweep_reference_image;
+
+    // Profiling.
+    PassProfiler m_profiler;
 };
 
 DW_DECLARE_MAIN(ReflectiveShadowMaps)
\ No newline at end of file
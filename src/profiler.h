@@ -0,0 +1,491 @@
+#pragma once
+
+#include <ogl.h>
+#include <logger.h>
+#include <imgui.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+
+#define PROFILER_FRAMES_IN_FLIGHT 5
+#define PROFILER_SMOOTHING 0.1
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Smoothed timings of a single profiled scope, reported in the order the scopes were executed.
+struct PassTiming
+{
+    std::string name;
+    uint32_t    depth;
+    bool        has_gpu;
+    double      cpu_ms;
+    double      gpu_ms;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Records nested CPU scopes and, optionally, GPU scopes measured with GL_TIME_ELAPSED queries. The queries of a frame are
+// only read back PROFILER_FRAMES_IN_FLIGHT frames later so that the measurement never waits on the GPU. Since elapsed
+// queries can't be nested, an open GPU scope is split around its GPU children and its time is the sum of its own
+// segments and its children.
+class PassProfiler
+{
+public:
+    void begin_frame()
+    {
+        Frame& frame = m_frames[m_frame_index % PROFILER_FRAMES_IN_FLIGHT];
+
+        if (frame.pending)
+            resolve(frame);
+
+        frame.pending      = true;
+        frame.queries_used = 0;
+        frame.records.clear();
+
+        m_open.clear();
+        m_gpu_open.clear();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void end_frame()
+    {
+        m_frame_index++;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void begin(const char* name, bool gpu)
+    {
+        Frame& frame = current();
+
+        Record record;
+
+        record.name         = name;
+        record.depth        = uint32_t(m_open.size());
+        record.cpu_start_us = now_us();
+        record.cpu_end_us   = record.cpu_start_us;
+        record.gpu          = gpu;
+        record.gpu_ms       = 0.0;
+
+        uint32_t idx = uint32_t(frame.records.size());
+
+        m_open.push_back(idx);
+        frame.records.push_back(record);
+
+        if (gpu)
+        {
+            // Close the parent's current segment, it is resumed once this scope ends.
+            if (!m_gpu_open.empty())
+                glEndQuery(GL_TIME_ELAPSED);
+
+            m_gpu_open.push_back(idx);
+            begin_segment(frame, idx);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void end()
+    {
+        Frame&  frame  = current();
+        Record& record = frame.records[m_open.back()];
+
+        m_open.pop_back();
+
+        if (record.gpu)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            m_gpu_open.pop_back();
+
+            if (!m_gpu_open.empty())
+                begin_segment(frame, m_gpu_open.back());
+        }
+
+        record.cpu_end_us = now_us();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Dump the next 'frame_count' resolved frames to a Chrome trace_event JSON file (load via chrome://tracing or Perfetto).
+    void capture_trace(const std::string& path, uint32_t frame_count)
+    {
+        m_trace_path      = path;
+        m_trace_remaining = frame_count;
+        m_trace_events.clear();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Finish any capture in progress using the frames that have already been resolved.
+    void flush_trace()
+    {
+        if (m_trace_remaining > 0)
+        {
+            m_trace_remaining = 0;
+            write_trace();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline bool capturing() const { return m_trace_remaining > 0; }
+    inline const std::vector<PassTiming>& results() const { return m_results; }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Returns the smoothed GPU time of the named scope, or a negative value if it hasn't been measured yet.
+    double gpu_time(const std::string& name) const
+    {
+        for (const auto& result : m_results)
+        {
+            if (result.name == name && result.has_gpu)
+                return result.gpu_ms;
+        }
+
+        return -1.0;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Number of frames whose GPU times have been read back so far.
+    inline uint64_t measured_frames() const { return m_resolved_frames; }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Returns the smoothed GPU time of the named scope if it ran in one of the last 'max_age' + 1 measured frames, so that
+    // passes which are skipped while their inputs are unchanged keep their last cost. Negative otherwise.
+    double recent_gpu_time(const std::string& name, uint64_t max_age) const
+    {
+        auto it = m_last_measured.find(name);
+
+        if (it == m_last_measured.end() || it->second + max_age + 1 < m_resolved_frames)
+            return -1.0;
+
+        return m_history.at(name).gpu_ms;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Unsmoothed GPU time of the named scope in the last measured frame. Negative if it did not run in that frame.
+    double last_gpu_time(const std::string& name) const
+    {
+        auto it = m_last_gpu_ms.find(name);
+
+        if (it == m_last_gpu_ms.end() || recent_gpu_time(name, 0) < 0.0)
+            return -1.0;
+
+        return it->second;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Sum of recent_gpu_time() over the top level scopes. Estimates the cost of a frame that runs every pass.
+    double recent_frame_gpu_time(uint64_t max_age) const
+    {
+        double total = 0.0;
+
+        for (const auto& entry : m_history)
+        {
+            if (entry.second.depth == 0 && entry.second.has_gpu)
+                total += std::max(recent_gpu_time(entry.first, max_age), 0.0);
+        }
+
+        return total;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void ui()
+    {
+        ImGui::Columns(3, "Profiler");
+        ImGui::Text("Pass");
+        ImGui::NextColumn();
+        ImGui::Text("CPU (ms)");
+        ImGui::NextColumn();
+        ImGui::Text("GPU (ms)");
+        ImGui::NextColumn();
+        ImGui::Separator();
+
+        for (const auto& result : m_results)
+        {
+            ImGui::Text("%*s%s", int(result.depth * 2), "", result.name.c_str());
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", result.cpu_ms);
+            ImGui::NextColumn();
+
+            if (result.has_gpu)
+                ImGui::Text("%.3f", result.gpu_ms);
+            else
+                ImGui::Text("-");
+
+            ImGui::NextColumn();
+        }
+
+        ImGui::Columns(1);
+
+        if (capturing())
+            ImGui::Text("Capturing trace... (%u frames left)", m_trace_remaining);
+        else if (ImGui::Button("Capture Trace"))
+            capture_trace("rsm_trace.json", 60);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void shutdown()
+    {
+        flush_trace();
+
+        for (auto& frame : m_frames)
+        {
+            if (!frame.queries.empty())
+                glDeleteQueries(GLsizei(frame.queries.size()), frame.queries.data());
+
+            frame.queries.clear();
+            frame.pending = false;
+        }
+    }
+
+private:
+    struct Record
+    {
+        std::string           name;
+        uint32_t              depth;
+        double                cpu_start_us;
+        double                cpu_end_us;
+        bool                  gpu;
+        std::vector<uint32_t> queries;
+        double                gpu_ms;
+    };
+
+    struct Frame
+    {
+        bool                pending      = false;
+        uint32_t            queries_used = 0;
+        std::vector<GLuint> queries;
+        std::vector<Record> records;
+    };
+
+    struct TraceEvent
+    {
+        std::string name;
+        uint32_t    tid;
+        double      ts_us;
+        double      dur_us;
+    };
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline Frame& current() { return m_frames[m_frame_index % PROFILER_FRAMES_IN_FLIGHT]; }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void begin_segment(Frame& frame, uint32_t record)
+    {
+        if (frame.queries_used == frame.queries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+
+        frame.records[record].queries.push_back(frame.queries_used);
+        glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.queries_used++]);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    double now_us() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_epoch).count();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void resolve(Frame& frame)
+    {
+        frame.pending = false;
+
+        // If the GPU is still behind by more than the ring size, drop the GPU results of this frame instead of stalling.
+        bool gpu_ready = true;
+
+        for (uint32_t i = 0; i < frame.queries_used; i++)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (!available)
+            {
+                gpu_ready = false;
+                break;
+            }
+        }
+
+        if (gpu_ready)
+        {
+            for (auto& record : frame.records)
+            {
+                for (auto query : record.queries)
+                {
+                    GLuint64 elapsed = 0;
+                    glGetQueryObjectui64v(frame.queries[query], GL_QUERY_RESULT, &elapsed);
+                    record.gpu_ms += double(elapsed) / 1000000.0;
+                }
+            }
+
+            // Add the GPU time of nested scopes to their GPU parents.
+            for (uint32_t i = 0; i < frame.records.size(); i++)
+            {
+                if (!frame.records[i].gpu)
+                    continue;
+
+                for (uint32_t j = i + 1; j < frame.records.size() && frame.records[j].depth > frame.records[i].depth; j++)
+                {
+                    for (auto query : frame.records[j].queries)
+                    {
+                        GLuint64 elapsed = 0;
+                        glGetQueryObjectui64v(frame.queries[query], GL_QUERY_RESULT, &elapsed);
+                        frame.records[i].gpu_ms += double(elapsed) / 1000000.0;
+                    }
+                }
+            }
+        }
+
+        m_results.resize(frame.records.size());
+
+        for (uint32_t i = 0; i < frame.records.size(); i++)
+        {
+            const Record& record = frame.records[i];
+            PassTiming&   result = m_results[i];
+            double        cpu_ms = (record.cpu_end_us - record.cpu_start_us) / 1000.0;
+
+            auto   it       = m_history.find(record.name);
+            bool   first    = it == m_history.end();
+            double prev_cpu = first ? cpu_ms : it->second.cpu_ms;
+            double prev_gpu = first ? record.gpu_ms : it->second.gpu_ms;
+
+            result.name    = record.name;
+            result.depth   = record.depth;
+            result.has_gpu = record.gpu;
+            result.cpu_ms  = prev_cpu + (cpu_ms - prev_cpu) * PROFILER_SMOOTHING;
+            result.gpu_ms  = gpu_ready ? prev_gpu + (record.gpu_ms - prev_gpu) * PROFILER_SMOOTHING : prev_gpu;
+
+            m_history[record.name] = result;
+
+            if (gpu_ready)
+            {
+                m_last_measured[record.name] = m_resolved_frames;
+
+                if (record.gpu)
+                    m_last_gpu_ms[record.name] = record.gpu_ms;
+            }
+        }
+
+        if (gpu_ready)
+            m_resolved_frames++;
+
+        if (m_trace_remaining > 0)
+        {
+            append_trace(frame, gpu_ready);
+
+            if (--m_trace_remaining == 0)
+                write_trace();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void append_trace(const Frame& frame, bool gpu_ready)
+    {
+        // Only durations are known on the GPU timeline, so top-level GPU scopes are laid out back-to-back, never starting
+        // before the CPU submitted them, and nested scopes are laid out back-to-back inside their parent.
+        double              gpu_cursor = 0.0;
+        std::vector<double> nested_cursor;
+
+        for (const auto& record : frame.records)
+        {
+            m_trace_events.push_back({ record.name, 1, record.cpu_start_us, record.cpu_end_us - record.cpu_start_us });
+
+            if (record.gpu && gpu_ready)
+            {
+                nested_cursor.resize(record.depth + 2, 0.0);
+
+                double start = record.depth == 0 ? std::max(gpu_cursor, record.cpu_start_us) : nested_cursor[record.depth];
+                double dur   = record.gpu_ms * 1000.0;
+
+                m_trace_events.push_back({ record.name, 2, start, dur });
+
+                gpu_cursor                      = record.depth == 0 ? start + dur : gpu_cursor;
+                nested_cursor[record.depth]     = start + dur;
+                nested_cursor[record.depth + 1] = start;
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void write_trace()
+    {
+        std::ofstream file(m_trace_path);
+
+        if (!file.is_open())
+        {
+            DW_LOG_ERROR("Failed to write trace to " + m_trace_path);
+            return;
+        }
+
+        file << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+        for (const auto& e : m_trace_events)
+            file << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << (e.tid == 1 ? "cpu" : "gpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << std::fixed << e.ts_us << ",\"dur\":" << e.dur_us << "}";
+
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+        m_trace_events.clear();
+
+        DW_LOG_INFO("Trace written to " + m_trace_path);
+    }
+
+private:
+    uint64_t                                    m_frame_index = 0;
+    Frame                                       m_frames[PROFILER_FRAMES_IN_FLIGHT];
+    std::vector<uint32_t>                       m_open;
+    std::vector<uint32_t>                       m_gpu_open;
+    std::vector<PassTiming>                     m_results;
+    std::unordered_map<std::string, PassTiming> m_history;
+    std::unordered_map<std::string, uint64_t>   m_last_measured;
+    std::unordered_map<std::string, double>     m_last_gpu_ms;
+    uint64_t                                    m_resolved_frames = 0;
+    std::string                                 m_trace_path;
+    uint32_t                                    m_trace_remaining = 0;
+    std::vector<TraceEvent>                     m_trace_events;
+    std::chrono::steady_clock::time_point       m_epoch = std::chrono::steady_clock::now();
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Profiles the enclosing scope.
+class ProfileScope
+{
+public:
+    ProfileScope(PassProfiler& profiler, const char* name, bool gpu = true) :
+        m_profiler(profiler)
+    {
+        m_profiler.begin(name, gpu);
+    }
+
+    ~ProfileScope()
+    {
+        m_profiler.end();
+    }
+
+private:
+    PassProfiler& m_profiler;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <ogl.h>
+#include <logger.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+
+#ifdef _WIN32
+#    include <direct.h>
+#else
+#    include <sys/stat.h>
+#endif
+
+#define PROGRAM_CACHE_MAGIC 0x50525352 // "RSRP"
+#define PROGRAM_CACHE_VERSION 1
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// One shader of a program, compiled from the file with the given defines.
+struct ShaderStage
+{
+    GLenum                   type;
+    std::string              path;
+    std::vector<std::string> defines;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Linked GL program with the parts of the dw::Program interface that the app uses. Unlike dw::Program it can be created
+// from a program binary, which skips compilation entirely.
+class CachedProgram
+{
+public:
+    explicit CachedProgram(GLuint id) :
+        m_id(id) {}
+
+    ~CachedProgram() { glDeleteProgram(m_id); }
+
+    CachedProgram(const CachedProgram&) = delete;
+    CachedProgram& operator=(const CachedProgram&) = delete;
+
+    inline void   use() { glUseProgram(m_id); }
+    inline GLuint id() const { return m_id; }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void uniform_block_binding(const std::string& name, GLuint binding)
+    {
+        GLuint index = glGetUniformBlockIndex(m_id, name.c_str());
+
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(m_id, index, binding);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool set_uniform(const std::string& name, int value)
+    {
+        GLint location = uniform_location(name);
+
+        if (location == -1)
+            return false;
+
+        glUniform1i(location, value);
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool set_uniform(const std::string& name, float value)
+    {
+        GLint location = uniform_location(name);
+
+        if (location == -1)
+            return false;
+
+        glUniform1f(location, value);
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool set_uniform(const std::string& name, const glm::vec2& value)
+    {
+        GLint location = uniform_location(name);
+
+        if (location == -1)
+            return false;
+
+        glUniform2f(location, value.x, value.y);
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool set_uniform(const std::string& name, const glm::vec3& value)
+    {
+        GLint location = uniform_location(name);
+
+        if (location == -1)
+            return false;
+
+        glUniform3f(location, value.x, value.y, value.z);
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool set_uniform(const std::string& name, const glm::vec4& value)
+    {
+        GLint location = uniform_location(name);
+
+        if (location == -1)
+            return false;
+
+        glUniform4f(location, value.x, value.y, value.z, value.w);
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool set_uniform(const std::string& name, const glm::mat4& value)
+    {
+        GLint location = uniform_location(name);
+
+        if (location == -1)
+            return false;
+
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+        return true;
+    }
+
+private:
+    GLint uniform_location(const std::string& name)
+    {
+        auto it = m_locations.find(name);
+
+        if (it != m_locations.end())
+            return it->second;
+
+        GLint location    = glGetUniformLocation(m_id, name.c_str());
+        m_locations[name] = location;
+
+        return location;
+    }
+
+private:
+    GLuint                                 m_id;
+    std::unordered_map<std::string, GLint> m_locations;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Creates programs from their shader stages, keeping the linked binaries on disk. The key of a binary hashes the driver
+// vendor, renderer and version together with the type, path, source and defines of every stage, so editing a shader,
+// changing its defines or updating the driver all miss the cache. A binary the driver rejects, for instance after an
+// update that kept the version string, is recompiled and overwritten.
+//
+// The shaders do not use #include, so the source of a stage is the contents of its file.
+class ProgramCache
+{
+public:
+    // With 'enabled' false every program is compiled from source and nothing is written.
+    void initialize(const std::string& directory, bool enabled)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+        m_directory = directory;
+        m_enabled   = enabled && formats > 0;
+        m_driver    = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+        if (enabled && formats == 0)
+            DW_LOG_INFO("The driver supports no program binary formats, shaders are compiled on every start");
+
+        if (!m_enabled)
+            return;
+
+#ifdef _WIN32
+        _mkdir(m_directory.c_str());
+#else
+        mkdir(m_directory.c_str(), 0755);
+#endif
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Returns null if a shader fails to compile or the program fails to link.
+    std::unique_ptr<CachedProgram> create(const std::vector<ShaderStage>& stages)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        std::unique_ptr<CachedProgram> program;
+        std::string                    path;
+
+        if (m_enabled)
+        {
+            path    = binary_path(stages);
+            program = load(path);
+        }
+
+        if (program)
+            m_hits++;
+        else
+        {
+            program = compile(stages);
+
+            if (program && m_enabled)
+                save(path, program->id());
+
+            m_misses++;
+        }
+
+        m_total_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        return program;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline bool     enabled() const { return m_enabled; }
+    inline uint32_t hits() const { return m_hits; }
+    inline uint32_t misses() const { return m_misses; }
+    inline double   total_ms() const { return m_total_ms; }
+
+private:
+    // FNV-1a.
+    static uint64_t hash_string(uint64_t hash, const std::string& str)
+    {
+        for (char c : str)
+            hash = (hash ^ uint8_t(c)) * 0x100000001B3ull;
+
+        // Separator, so that consecutive strings can't run into each other.
+        return (hash ^ 0xFF) * 0x100000001B3ull;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    std::string binary_path(const std::vector<ShaderStage>& stages)
+    {
+        uint64_t hash = hash_string(0xCBF29CE484222325ull, m_driver);
+
+        for (const ShaderStage& stage : stages)
+        {
+            std::ifstream     file(stage.path, std::ios::binary);
+            std::stringstream source;
+
+            source << file.rdbuf();
+
+            hash = hash_string(hash, std::to_string(stage.type));
+            hash = hash_string(hash, stage.path);
+            hash = hash_string(hash, source.str());
+
+            for (const std::string& define : stage.defines)
+                hash = hash_string(hash, define);
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+
+        return m_directory + "/" + name;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    std::unique_ptr<CachedProgram> load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+
+        if (!file)
+            return nullptr;
+
+        uint32_t header[4];
+
+        if (!file.read((char*)&header[0], sizeof(header)) || header[0] != PROGRAM_CACHE_MAGIC || header[1] != PROGRAM_CACHE_VERSION)
+            return nullptr;
+
+        GLenum               format = header[2];
+        std::vector<uint8_t> binary(header[3]);
+
+        if (!file.read((char*)binary.data(), binary.size()))
+            return nullptr;
+
+        GLuint id = glCreateProgram();
+        glProgramBinary(id, format, binary.data(), GLsizei(binary.size()));
+
+        GLint status = GL_FALSE;
+        glGetProgramiv(id, GL_LINK_STATUS, &status);
+
+        if (status != GL_TRUE)
+        {
+            DW_LOG_INFO("Program binary rejected by the driver, recompiling: " + path);
+            glDeleteProgram(id);
+            return nullptr;
+        }
+
+        return std::unique_ptr<CachedProgram>(new CachedProgram(id));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    std::unique_ptr<CachedProgram> compile(const std::vector<ShaderStage>& stages)
+    {
+        std::vector<std::unique_ptr<dw::Shader>> shaders;
+
+        for (const ShaderStage& stage : stages)
+        {
+            shaders.push_back(std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(stage.type, stage.path, stage.defines)));
+
+            if (!shaders.back())
+            {
+                DW_LOG_ERROR("Failed to create Shader: " + stage.path);
+                return nullptr;
+            }
+        }
+
+        GLuint id = glCreateProgram();
+
+        if (m_enabled)
+            glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+        for (auto& shader : shaders)
+            glAttachShader(id, shader->id());
+
+        glLinkProgram(id);
+
+        for (auto& shader : shaders)
+            glDetachShader(id, shader->id());
+
+        GLint status = GL_FALSE;
+        glGetProgramiv(id, GL_LINK_STATUS, &status);
+
+        if (status != GL_TRUE)
+        {
+            char log[4096];
+            glGetProgramInfoLog(id, sizeof(log), nullptr, &log[0]);
+
+            DW_LOG_ERROR("Failed to link program: " + std::string(log));
+            glDeleteProgram(id);
+            return nullptr;
+        }
+
+        return std::unique_ptr<CachedProgram>(new CachedProgram(id));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void save(const std::string& path, GLuint id)
+    {
+        GLint size = 0;
+        glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &size);
+
+        if (size <= 0)
+            return;
+
+        std::vector<uint8_t> binary(size);
+        GLenum               format = 0;
+
+        glGetProgramBinary(id, size, &size, &format, binary.data());
+
+        uint32_t header[4] = { PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, format, uint32_t(size) };
+
+        // Written under a temporary name first, so that an interrupted write never leaves a truncated binary behind.
+        std::string tmp_path = path + ".tmp";
+
+        {
+            std::ofstream file(tmp_path, std::ios::binary);
+
+            if (!file.write((const char*)&header[0], sizeof(header)) || !file.write((const char*)binary.data(), size))
+            {
+                DW_LOG_ERROR("Failed to write program binary: " + path);
+                return;
+            }
+        }
+
+        std::remove(path.c_str());
+        std::rename(tmp_path.c_str(), path.c_str());
+    }
+
+private:
+    std::string m_directory;
+    std::string m_driver;
+    bool        m_enabled  = false;
+    uint32_t    m_hits     = 0;
+    uint32_t    m_misses   = 0;
+    double      m_total_ms = 0.0;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
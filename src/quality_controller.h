@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#define QUALITY_DOWNGRADE_FRAMES 5
+#define QUALITY_UPGRADE_FRAMES 60
+#define QUALITY_COOLDOWN_FRAMES 30
+#define QUALITY_UPGRADE_HEADROOM 0.85
+#define QUALITY_SAMPLE_STEP 8
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The settings the controller adjusts.
+struct QualitySettings
+{
+    int   rsm_size;
+    float indirect_scale;
+    int   num_samples;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Range the controller keeps the settings in. An equal minimum and maximum leaves a setting alone.
+struct QualityLimits
+{
+    int   min_rsm_size;
+    int   max_rsm_size;
+    float min_indirect_scale;
+    float max_indirect_scale;
+    int   min_samples;
+    int   max_samples;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Smoothed GPU times in milliseconds.
+struct QualityCosts
+{
+    double frame;  // Every pass of a frame that renders the lighting.
+    double rsm;    // Passes that scale with the RSM texel count.
+    double gather; // Passes that scale with the indirect sample count and the indirect pixel count.
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Moves the indirect lighting settings one step at a time to hold the frame cost under a target. Every candidate step is
+// rated by predicting the frame cost after it from the measured pass costs, assuming the RSM passes scale with the texel
+// count of the RSM and the gather with the sample count times the pixel count of the indirect target.
+//
+// Hysteresis comes from three places. The frame has to be over the target for QUALITY_DOWNGRADE_FRAMES measurements in
+// a row before quality drops, but a step up is only taken if it is predicted to stay below QUALITY_UPGRADE_HEADROOM of
+// the target for QUALITY_UPGRADE_FRAMES measurements in a row. After every change the controller waits
+// QUALITY_COOLDOWN_FRAMES, so that the smoothed timings settle on the new settings before they are judged again.
+class QualityController
+{
+public:
+    // Returns true if 'settings' was changed.
+    bool update(double target_ms, const QualityLimits& limits, const QualityCosts& costs, QualitySettings& settings)
+    {
+        if (m_cooldown > 0)
+        {
+            m_cooldown--;
+            return false;
+        }
+
+        if (costs.frame <= 0.0)
+            return false;
+
+        QualitySettings next = settings;
+
+        if (costs.frame > target_ms)
+        {
+            m_upgrade_frames = 0;
+
+            if (++m_downgrade_frames < QUALITY_DOWNGRADE_FRAMES || !downgrade(target_ms, limits, costs, next))
+                return false;
+        }
+        else
+        {
+            m_downgrade_frames = 0;
+
+            if (!upgrade(target_ms * QUALITY_UPGRADE_HEADROOM, limits, costs, next))
+            {
+                m_upgrade_frames = 0;
+                return false;
+            }
+
+            if (++m_upgrade_frames < QUALITY_UPGRADE_FRAMES)
+                return false;
+        }
+
+        settings           = next;
+        m_cooldown         = QUALITY_COOLDOWN_FRAMES;
+        m_downgrade_frames = 0;
+        m_upgrade_frames   = 0;
+        m_changes++;
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void reset()
+    {
+        m_cooldown         = 0;
+        m_downgrade_frames = 0;
+        m_upgrade_frames   = 0;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline uint32_t changes() const { return m_changes; }
+
+private:
+    static double predict(const QualityCosts& costs, const QualitySettings& from, const QualitySettings& to)
+    {
+        double rsm_scale    = double(to.rsm_size) * double(to.rsm_size) / (double(from.rsm_size) * double(from.rsm_size));
+        double gather_scale = (double(to.num_samples) * to.indirect_scale * to.indirect_scale) / (double(from.num_samples) * from.indirect_scale * from.indirect_scale);
+
+        return costs.frame + costs.rsm * (rsm_scale - 1.0) + costs.gather * (gather_scale - 1.0);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Candidate steps in the order they are tried when lowering the quality. Fewer samples are mostly hidden by the dither
+    // and the blur, a lower indirect scale by the upsampling, while a smaller RSM loses detail in the bounced light.
+    static int candidates(const QualityLimits& limits, const QualitySettings& settings, bool up, QualitySettings* steps)
+    {
+        int count = 0;
+
+        QualitySettings samples = settings;
+        QualitySettings scale   = settings;
+        QualitySettings rsm     = settings;
+
+        samples.num_samples  = up ? std::min(settings.num_samples + QUALITY_SAMPLE_STEP, limits.max_samples) : std::max(settings.num_samples - QUALITY_SAMPLE_STEP, limits.min_samples);
+        scale.indirect_scale = up ? std::min(settings.indirect_scale + 0.25f, limits.max_indirect_scale) : std::max(settings.indirect_scale - 0.25f, limits.min_indirect_scale);
+        rsm.rsm_size         = up ? std::min(settings.rsm_size * 2, limits.max_rsm_size) : std::max(settings.rsm_size / 2, limits.min_rsm_size);
+
+        if (samples.num_samples != settings.num_samples)
+            steps[count++] = samples;
+
+        if (scale.indirect_scale != settings.indirect_scale)
+            steps[count++] = scale;
+
+        if (rsm.rsm_size != settings.rsm_size)
+            steps[count++] = rsm;
+
+        return count;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Takes the first step that gets under the target, or the one that saves the most if none does.
+    static bool downgrade(double target_ms, const QualityLimits& limits, const QualityCosts& costs, QualitySettings& settings)
+    {
+        QualitySettings steps[3];
+        int             count = candidates(limits, settings, false, steps);
+
+        if (count == 0)
+            return false;
+
+        int    best      = 0;
+        double best_cost = predict(costs, settings, steps[0]);
+
+        for (int i = 0; i < count; i++)
+        {
+            double cost = predict(costs, settings, steps[i]);
+
+            if (cost <= target_ms)
+            {
+                best = i;
+                break;
+            }
+
+            if (cost < best_cost)
+            {
+                best      = i;
+                best_cost = cost;
+            }
+        }
+
+        settings = steps[best];
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Takes the step back up that the downgrade order would give up last, if it is predicted to stay under the target.
+    static bool upgrade(double target_ms, const QualityLimits& limits, const QualityCosts& costs, QualitySettings& settings)
+    {
+        QualitySettings steps[3];
+        int             count = candidates(limits, settings, true, steps);
+
+        for (int i = count - 1; i >= 0; i--)
+        {
+            if (predict(costs, settings, steps[i]) <= target_ms)
+            {
+                settings = steps[i];
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    uint32_t m_cooldown         = 0;
+    uint32_t m_downgrade_frames = 0;
+    uint32_t m_upgrade_frames   = 0;
+    uint32_t m_changes          = 0;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
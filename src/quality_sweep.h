@@ -0,0 +1,212 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Indirect lighting settings of one configuration of the sweep.
+struct SweepConfig
+{
+    int   num_samples;
+    float sample_radius; // Same units as m_sample_radius.
+    bool  dither;
+    bool  interpolation;
+    int   rsm_size;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Measurement of one configuration from one viewpoint.
+struct SweepResult
+{
+    int    config;
+    int    view;
+    double gpu_ms; // Mean unsmoothed GPU time of the indirect_lighting scope, negative if no frame was measured.
+    double rmse;
+    double psnr;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Parses a comma separated list such as "16,32,64". Returns false if it is empty or an entry is not a number.
+template <typename T>
+bool parse_sweep_list(const std::string& str, std::vector<T>& values)
+{
+    std::stringstream ss(str);
+    std::string       item;
+
+    values.clear();
+
+    while (std::getline(ss, item, ','))
+    {
+        std::stringstream item_ss(item);
+        T                 value;
+
+        if (!(item_ss >> value))
+            return false;
+
+        values.push_back(value);
+    }
+
+    return !values.empty();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Configurations of a quality versus cost sweep and their results. The configurations are the cartesian product of the
+// parameter lists with dither and screen space interpolation each on and off.
+//
+// Every configuration is measured from every viewpoint. The results are written as one CSV row per configuration and
+// viewpoint, and the Pareto frontier of GPU time against error, averaged over the viewpoints, as a second CSV. Error is
+// measured against a reference image of the same sample radius, since the radius sets the region that light is gathered
+// from rather than how well it is sampled, so the frontier is computed separately for every radius.
+class QualitySweep
+{
+public:
+    // Ordered by sample radius first, so that every radius only needs one reference image per viewpoint.
+    void build(const std::vector<int>& samples, const std::vector<float>& radii, const std::vector<int>& rsm_sizes)
+    {
+        m_configs.clear();
+        m_results.clear();
+
+        for (float radius : radii)
+        {
+            for (int rsm_size : rsm_sizes)
+            {
+                for (int interpolation = 0; interpolation < 2; interpolation++)
+                {
+                    for (int dither = 0; dither < 2; dither++)
+                    {
+                        for (int num_samples : samples)
+                            m_configs.push_back({ num_samples, radius, dither == 1, interpolation == 1, rsm_size });
+                    }
+                }
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline const std::vector<SweepConfig>& configs() const { return m_configs; }
+    inline void                            add_result(const SweepResult& result) { m_results.push_back(result); }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool write_csv(const std::string& path) const
+    {
+        return write(path, m_results);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Mean over the viewpoints of the configurations that no other configuration of the same radius beats in both GPU time
+    // and RMSE. The RMSE of the mean is the root of the mean squared error, so that the PSNR stays consistent with it.
+    // Viewpoints without a GPU time (negative gpu_ms) only count towards the error, and configurations without any are
+    // left out, since they can't be placed on the cost axis.
+    std::vector<SweepResult> pareto_frontier() const
+    {
+        std::vector<SweepResult> means(m_configs.size(), SweepResult{ 0, -1, 0.0, 0.0, 0.0 });
+        std::vector<int>         counts(m_configs.size(), 0);
+        std::vector<int>         gpu_counts(m_configs.size(), 0);
+
+        for (const SweepResult& result : m_results)
+        {
+            SweepResult& mean = means[result.config];
+
+            mean.config = result.config;
+            mean.rmse += result.rmse * result.rmse;
+            counts[result.config]++;
+
+            if (result.gpu_ms >= 0.0)
+            {
+                mean.gpu_ms += result.gpu_ms;
+                gpu_counts[result.config]++;
+            }
+        }
+
+        std::vector<SweepResult> measured;
+
+        for (size_t i = 0; i < means.size(); i++)
+        {
+            if (gpu_counts[i] == 0)
+                continue;
+
+            SweepResult mean = means[i];
+
+            mean.gpu_ms /= double(gpu_counts[i]);
+            mean.rmse = std::sqrt(mean.rmse / double(counts[i]));
+            mean.psnr = mean.rmse > 0.0 ? -20.0 * std::log10(mean.rmse) : std::numeric_limits<double>::infinity();
+
+            measured.push_back(mean);
+        }
+
+        // Within a radius, walk the configurations from the cheapest up and keep every one that lowers the error.
+        std::sort(measured.begin(), measured.end(), [this](const SweepResult& a, const SweepResult& b) {
+            float radius_a = m_configs[a.config].sample_radius;
+            float radius_b = m_configs[b.config].sample_radius;
+
+            if (radius_a != radius_b)
+                return radius_a < radius_b;
+
+            return a.gpu_ms < b.gpu_ms || (a.gpu_ms == b.gpu_ms && a.rmse < b.rmse);
+        });
+
+        std::vector<SweepResult> frontier;
+        double                   best_rmse = std::numeric_limits<double>::infinity();
+
+        for (size_t i = 0; i < measured.size(); i++)
+        {
+            if (i > 0 && m_configs[measured[i].config].sample_radius != m_configs[measured[i - 1].config].sample_radius)
+                best_rmse = std::numeric_limits<double>::infinity();
+
+            if (measured[i].rmse < best_rmse)
+            {
+                best_rmse = measured[i].rmse;
+                frontier.push_back(measured[i]);
+            }
+        }
+
+        return frontier;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool write_pareto_csv(const std::string& path) const
+    {
+        return write(path, pareto_frontier());
+    }
+
+private:
+    // The view column is -1 for means over the viewpoints.
+    bool write(const std::string& path, const std::vector<SweepResult>& results) const
+    {
+        std::ofstream file(path);
+
+        if (!file.is_open())
+            return false;
+
+        file << "num_samples,sample_radius,dither,interpolation,rsm_size,view,indirect_gpu_ms,rmse,psnr\n";
+
+        for (const SweepResult& result : results)
+        {
+            const SweepConfig& config = m_configs[result.config];
+
+            file << config.num_samples << "," << config.sample_radius << "," << (config.dither ? 1 : 0) << "," << (config.interpolation ? 1 : 0) << "," << config.rsm_size << ",";
+            file << result.view << "," << result.gpu_ms << "," << result.rmse << "," << result.psnr << "\n";
+        }
+
+        return true;
+    }
+
+private:
+    std::vector<SweepConfig> m_configs;
+    std::vector<SweepResult> m_results;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <ogl.h>
+#include <logger.h>
+#include <imgui.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#define RENDER_TARGET_NONE -1
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Size and format of a render target. Transient targets with equal descriptions can share a texture.
+struct RenderTargetDesc
+{
+    int    width;
+    int    height;
+    int    layers;
+    int    mip_levels;
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+
+    bool operator==(const RenderTargetDesc& other) const
+    {
+        return width == other.width && height == other.height && layers == other.layers && mip_levels == other.mip_levels && internal_format == other.internal_format && format == other.format && type == other.type;
+    }
+};
+
+// Index of a target declared in the render graph.
+typedef int RenderTarget;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Nominal size of a texel. Drivers may pad the three channel formats to four.
+inline size_t render_target_texel_bytes(GLenum internal_format)
+{
+    switch (internal_format)
+    {
+        case GL_R8:
+            return 1;
+        case GL_RGB8:
+            return 3;
+        case GL_RGBA8:
+        case GL_R32F:
+        case GL_R32UI:
+        case GL_RG16_SNORM:
+        case GL_DEPTH24_STENCIL8:
+        case GL_DEPTH_COMPONENT32F:
+            return 4;
+        case GL_RGB16F:
+            return 6;
+        case GL_RGBA16F:
+            return 8;
+        case GL_RGB32F:
+            return 12;
+        case GL_RGBA32F:
+        case GL_RGBA32UI:
+            return 16;
+        default:
+            return 4;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+inline size_t render_target_bytes(const RenderTargetDesc& desc)
+{
+    size_t bytes  = 0;
+    int    width  = desc.width;
+    int    height = desc.height;
+
+    for (int i = 0; i < desc.mip_levels; i++)
+    {
+        bytes += size_t(width) * size_t(height) * size_t(desc.layers) * render_target_texel_bytes(desc.internal_format);
+        width  = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+
+    return bytes;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Describes the render targets of a frame together with the passes that read and write them, and assigns a texture to
+// every target that a pass uses. Targets no pass uses get no texture.
+//
+// Persistent targets keep their contents between frames, so that passes whose inputs did not change can be skipped, and
+// keep their texture across rebuilds of the graph for as long as their description stays the same. Transient targets
+// only live from the first to the last pass that uses them within a frame. Transient targets with equal descriptions and
+// lifetimes that do not overlap share a texture, the closest GL gets to aliasing their memory, and with it its sampler
+// state.
+//
+// The textures are pooled across rebuilds, so declaring the graph again after a resize or a settings change only
+// allocates the targets whose description changed and frees the ones that are no longer used.
+class RenderGraph
+{
+public:
+    // Starts a new declaration. The textures of the previous one stay in the pool until compile().
+    void begin()
+    {
+        m_targets.clear();
+        m_passes.clear();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    RenderTarget create_target(const std::string& name, const RenderTargetDesc& desc, bool persistent)
+    {
+        Target target;
+
+        target.name       = name;
+        target.desc       = desc;
+        target.persistent = persistent;
+
+        m_targets.push_back(target);
+
+        return RenderTarget(m_targets.size() - 1);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Passes are declared in execution order. RENDER_TARGET_NONE entries are skipped, so that optional targets can be passed
+    // as they are.
+    void add_pass(const std::string& name, const std::vector<RenderTarget>& reads, const std::vector<RenderTarget>& writes)
+    {
+        int index = int(m_passes.size());
+
+        m_passes.push_back(name);
+
+        for (const std::vector<RenderTarget>* targets : { &reads, &writes })
+        {
+            for (RenderTarget target : *targets)
+            {
+                if (target == RENDER_TARGET_NONE)
+                    continue;
+
+                m_targets[target].first = std::min(m_targets[target].first, index);
+                m_targets[target].last  = std::max(m_targets[target].last, index);
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Assigns the textures. Returns true if any target got a different texture than it had in the previous graph, in which
+    // case framebuffers that attach them have to be recreated.
+    bool compile()
+    {
+        for (auto& pooled : m_pool)
+        {
+            pooled->used = false;
+            pooled->lifetimes.clear();
+        }
+
+        bool changed = m_targets.size() != m_textures.size();
+
+        // Persistent targets first, they claim the texture they had under the same name.
+        for (Target& target : m_targets)
+        {
+            if (!target.persistent || target.last < 0)
+                continue;
+
+            Pooled* pooled = nullptr;
+
+            for (auto& candidate : m_pool)
+            {
+                if (!candidate->used && candidate->owner == target.name && candidate->desc == target.desc)
+                {
+                    pooled = candidate.get();
+                    break;
+                }
+            }
+
+            target.reallocated = !pooled;
+
+            if (!pooled)
+                pooled = allocate(target.desc, target.name);
+
+            pooled->used = true;
+            pooled->lifetimes.push_back({ target.first, target.last });
+            target.texture = pooled->texture.get();
+        }
+
+        // Transient targets in the order they come alive. Each one shares a texture already in use by this graph if a
+        // lifetime allows it, takes over a texture from the previous graph otherwise, and only then allocates.
+        std::vector<Target*> transients;
+
+        for (Target& target : m_targets)
+        {
+            if (!target.persistent && target.last >= 0)
+                transients.push_back(&target);
+        }
+
+        std::stable_sort(transients.begin(), transients.end(), [](const Target* a, const Target* b) { return a->first < b->first; });
+
+        for (Target* target : transients)
+        {
+            Pooled* shared = nullptr;
+            Pooled* unused = nullptr;
+
+            for (auto& candidate : m_pool)
+            {
+                if (!candidate->owner.empty() || !(candidate->desc == target->desc))
+                    continue;
+
+                if (!candidate->used && !unused)
+                    unused = candidate.get();
+                else if (candidate->used && !shared && !overlaps(*candidate, target->first, target->last))
+                    shared = candidate.get();
+            }
+
+            Pooled* pooled = shared ? shared : unused;
+
+            target->reallocated = !pooled;
+
+            if (!pooled)
+                pooled = allocate(target->desc, "");
+
+            pooled->used = true;
+            pooled->lifetimes.push_back({ target->first, target->last });
+            target->texture = pooled->texture.get();
+        }
+
+        m_pool.erase(std::remove_if(m_pool.begin(), m_pool.end(), [](const std::unique_ptr<Pooled>& pooled) { return !pooled->used; }), m_pool.end());
+
+        // Compare against the previous assignment by name, since the declaration may have changed. A new texture can reuse
+        // the address of a freed one, so allocations always count as a change.
+        for (size_t i = 0; i < m_targets.size() && !changed; i++)
+            changed = m_targets[i].reallocated || m_textures[i].first != m_targets[i].name || m_textures[i].second != m_targets[i].texture;
+
+        m_textures.clear();
+
+        for (const Target& target : m_targets)
+            m_textures.push_back({ target.name, target.texture });
+
+        return changed;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Null for targets that no pass uses.
+    inline dw::Texture2D* texture(RenderTarget target) const { return target == RENDER_TARGET_NONE ? nullptr : m_targets[target].texture; }
+
+    // True if the target got a new texture in the last compile(), so that its contents are undefined.
+    inline bool reallocated(RenderTarget target) const { return target != RENDER_TARGET_NONE && m_targets[target].reallocated; }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Memory of every texture in the pool.
+    size_t allocated_bytes() const
+    {
+        size_t bytes = 0;
+
+        for (const auto& pooled : m_pool)
+            bytes += render_target_bytes(pooled->desc);
+
+        return bytes;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Memory the used targets would take without any sharing.
+    size_t declared_bytes() const
+    {
+        size_t bytes = 0;
+
+        for (const Target& target : m_targets)
+        {
+            if (target.texture)
+                bytes += render_target_bytes(target.desc);
+        }
+
+        return bytes;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void ui()
+    {
+        ImGui::Columns(3, "Render Targets");
+        ImGui::Text("Target");
+        ImGui::NextColumn();
+        ImGui::Text("Size");
+        ImGui::NextColumn();
+        ImGui::Text("MB");
+        ImGui::NextColumn();
+        ImGui::Separator();
+
+        for (const Target& target : m_targets)
+        {
+            if (!target.texture)
+                continue;
+
+            ImGui::Text("%s%s", target.name.c_str(), target.persistent ? "" : " (transient)");
+            ImGui::NextColumn();
+            ImGui::Text("%dx%dx%d", target.desc.width, target.desc.height, target.desc.layers);
+            ImGui::NextColumn();
+            ImGui::Text("%.2f", double(render_target_bytes(target.desc)) / (1024.0 * 1024.0));
+            ImGui::NextColumn();
+        }
+
+        ImGui::Columns(1);
+
+        ImGui::Text("Total: %.2f MB in %d textures (%.2f MB without sharing)", double(allocated_bytes()) / (1024.0 * 1024.0), int(m_pool.size()), double(declared_bytes()) / (1024.0 * 1024.0));
+    }
+
+private:
+    struct Target
+    {
+        std::string      name;
+        RenderTargetDesc desc;
+        bool             persistent  = false;
+        bool             reallocated = false;
+        int              first       = INT_MAX;
+        int              last        = -1;
+        dw::Texture2D*   texture     = nullptr;
+    };
+
+    struct Pooled
+    {
+        RenderTargetDesc                 desc;
+        std::string                      owner; // Name of the persistent target, empty for transient textures.
+        std::unique_ptr<dw::Texture2D>   texture;
+        std::vector<std::pair<int, int>> lifetimes;
+        bool                             used = false;
+    };
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    Pooled* allocate(const RenderTargetDesc& desc, const std::string& owner)
+    {
+        std::unique_ptr<Pooled> pooled(new Pooled());
+
+        pooled->desc    = desc;
+        pooled->owner   = owner;
+        pooled->texture = std::make_unique<dw::Texture2D>(desc.width, desc.height, desc.layers, desc.mip_levels, 1, desc.internal_format, desc.format, desc.type);
+
+        m_pool.push_back(std::move(pooled));
+
+        return m_pool.back().get();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    static bool overlaps(const Pooled& pooled, int first, int last)
+    {
+        for (const auto& lifetime : pooled.lifetimes)
+        {
+            if (first <= lifetime.second && lifetime.first <= last)
+                return true;
+        }
+
+        return false;
+    }
+
+private:
+    std::vector<Target>                                  m_targets;
+    std::vector<std::string>                             m_passes;
+    std::vector<std::unique_ptr<Pooled>>                 m_pool;
+    std::vector<std::pair<std::string, dw::Texture2D*>> m_textures;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
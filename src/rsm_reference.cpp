@@ -0,0 +1,707 @@
+#define _USE_MATH_DEFINES
+#include "rsm_reference.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+
+#if defined(__AVX__)
+#    include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define RSM_SIMD_SSE
+#endif
+
+#define RSM_CAPTURE_MAGIC 0x43525352 // "RSRC"
+#define RSM_CAPTURE_VERSION 2
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// SIMD WRAPPER ----------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+#if defined(__AVX__)
+
+struct SimdFloat
+{
+    static const uint32_t kWidth = 8;
+    __m256                v;
+
+    SimdFloat() {}
+    SimdFloat(__m256 x) :
+        v(x) {}
+
+    static inline SimdFloat load(const float* p) { return _mm256_loadu_ps(p); }
+    static inline SimdFloat set1(float x) { return _mm256_set1_ps(x); }
+    static inline SimdFloat zero() { return _mm256_setzero_ps(); }
+
+    inline float sum() const
+    {
+        __m128 lo = _mm256_castps256_ps128(v);
+        __m128 hi = _mm256_extractf128_ps(v, 1);
+        __m128 s  = _mm_add_ps(lo, hi);
+        s         = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s         = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return _mm256_div_ps(a.v, b.v); }
+inline SimdFloat simd_max(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a.v, b.v); }
+inline SimdFloat simd_sqrt(SimdFloat a) { return _mm256_sqrt_ps(a.v); }
+// Returns 'a' where x > y, zero otherwise.
+inline SimdFloat simd_select_gt(SimdFloat x, SimdFloat y, SimdFloat a) { return _mm256_and_ps(_mm256_cmp_ps(x.v, y.v, _CMP_GT_OQ), a.v); }
+
+#elif defined(RSM_SIMD_SSE)
+
+struct SimdFloat
+{
+    static const uint32_t kWidth = 4;
+    __m128                v;
+
+    SimdFloat() {}
+    SimdFloat(__m128 x) :
+        v(x) {}
+
+    static inline SimdFloat load(const float* p) { return _mm_loadu_ps(p); }
+    static inline SimdFloat set1(float x) { return _mm_set1_ps(x); }
+    static inline SimdFloat zero() { return _mm_setzero_ps(); }
+
+    inline float sum() const
+    {
+        __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        s        = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm_add_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a.v, b.v); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a.v, b.v); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return _mm_div_ps(a.v, b.v); }
+inline SimdFloat simd_max(SimdFloat a, SimdFloat b) { return _mm_max_ps(a.v, b.v); }
+inline SimdFloat simd_sqrt(SimdFloat a) { return _mm_sqrt_ps(a.v); }
+inline SimdFloat simd_select_gt(SimdFloat x, SimdFloat y, SimdFloat a) { return _mm_and_ps(_mm_cmpgt_ps(x.v, y.v), a.v); }
+
+#else
+
+struct SimdFloat
+{
+    static const uint32_t kWidth = 1;
+    float                 v;
+
+    SimdFloat() {}
+    SimdFloat(float x) :
+        v(x) {}
+
+    static inline SimdFloat load(const float* p) { return *p; }
+    static inline SimdFloat set1(float x) { return x; }
+    static inline SimdFloat zero() { return 0.0f; }
+
+    inline float sum() const { return v; }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return a.v + b.v; }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return a.v - b.v; }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return a.v * b.v; }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return a.v / b.v; }
+inline SimdFloat simd_max(SimdFloat a, SimdFloat b) { return std::max(a.v, b.v); }
+inline SimdFloat simd_sqrt(SimdFloat a) { return std::sqrt(a.v); }
+inline SimdFloat simd_select_gt(SimdFloat x, SimdFloat y, SimdFloat a) { return x.v > y.v ? a.v : 0.0f; }
+
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// VPL LIST --------------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Structure-of-arrays VPL list. Flux is pre-multiplied by the spot light attenuation and, for the sampled gather, by the
+// sample weight. The texel coordinates are only used by the brute-force gather.
+struct VplList
+{
+    enum Attribute
+    {
+        POS_X,
+        POS_Y,
+        POS_Z,
+        NORMAL_X,
+        NORMAL_Y,
+        NORMAL_Z,
+        FLUX_R,
+        FLUX_G,
+        FLUX_B,
+        TEXEL_X,
+        TEXEL_Y,
+        ATTRIBUTE_COUNT
+    };
+
+    uint32_t           count = 0;
+    std::vector<float> attributes[ATTRIBUTE_COUNT];
+
+    void resize(uint32_t n)
+    {
+        // Pad to the SIMD width with zero flux VPLs so the shading loop never needs a scalar tail.
+        uint32_t padded = ((n + SimdFloat::kWidth - 1) / SimdFloat::kWidth) * SimdFloat::kWidth;
+
+        count = n;
+
+        for (auto& attribute : attributes)
+            attribute.assign(padded, 0.0f);
+    }
+
+    inline float*       operator[](Attribute a) { return attributes[a].data(); }
+    inline const float* operator[](Attribute a) const { return attributes[a].data(); }
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// HELPERS ---------------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static inline float dot3(const float* a, const float* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static inline void normalize3(float* v)
+{
+    float len = std::sqrt(dot3(v, v));
+
+    if (len > 0.0f)
+    {
+        v[0] /= len;
+        v[1] /= len;
+        v[2] /= len;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same as light_attenuation() in indirect_light_fs.glsl.
+static float light_attenuation(const RsmLight& light, const float* frag_pos)
+{
+    float L[3] = { light.position[0] - frag_pos[0], light.position[1] - frag_pos[1], light.position[2] - frag_pos[2] };
+    float D[3] = { -light.direction[0], -light.direction[1], -light.direction[2] };
+
+    float distance = std::sqrt(dot3(L, L));
+
+    normalize3(L);
+    normalize3(D);
+
+    float theta   = dot3(L, D);
+    float epsilon = light.inner_cutoff - light.outer_cutoff;
+    float t       = std::min(std::max(distance / light.range, 0.0f), 1.0f);
+    float falloff = 1.0f - t * t * (3.0f - 2.0f * t); // smoothstep(range, 0, distance)
+
+    return falloff * std::min(std::max((theta - light.outer_cutoff) / epsilon, 0.0f), 1.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Bilinear fetch with GL_CLAMP_TO_BORDER and a zero border color, matching texture() on the RSM targets.
+static void sample_bilinear(const RsmImage& image, float u, float v, float* out)
+{
+    float x = u * float(image.width) - 0.5f;
+    float y = v * float(image.height) - 0.5f;
+
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+
+    int32_t x0 = int32_t(fx);
+    int32_t y0 = int32_t(fy);
+
+    float tx = x - fx;
+    float ty = y - fy;
+
+    out[0] = out[1] = out[2] = 0.0f;
+
+    for (int32_t j = 0; j < 2; j++)
+    {
+        for (int32_t i = 0; i < 2; i++)
+        {
+            int32_t sx = x0 + i;
+            int32_t sy = y0 + j;
+
+            if (sx < 0 || sy < 0 || sx >= int32_t(image.width) || sy >= int32_t(image.height))
+                continue;
+
+            float        w = (i ? tx : 1.0f - tx) * (j ? ty : 1.0f - ty);
+            const float* t = image.texel(uint32_t(sx), uint32_t(sy));
+
+            out[0] += t[0] * w;
+            out[1] += t[1] * w;
+            out[2] += t[2] * w;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Projects a world position into the light's [0.0 - 1.0] texture space.
+static void project_to_light(const RsmLight& light, const float* p, float* uv)
+{
+    const float* m = light.view_proj;
+
+    float x = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+    float y = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+    float w = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+
+    uv[0] = (x / w) * 0.5f + 0.5f;
+    uv[1] = (y / w) * 0.5f + 0.5f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// SHADING KERNELS -------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Sum of the VPL contributions in [begin, end) onto receiver P with normal N, using pre-weighted flux.
+static void shade_weighted(const VplList& vpls, uint32_t begin, uint32_t end, const float* P, const float* N, float* out)
+{
+    const SimdFloat px = SimdFloat::set1(P[0]);
+    const SimdFloat py = SimdFloat::set1(P[1]);
+    const SimdFloat pz = SimdFloat::set1(P[2]);
+    const SimdFloat nx = SimdFloat::set1(N[0]);
+    const SimdFloat ny = SimdFloat::set1(N[1]);
+    const SimdFloat nz = SimdFloat::set1(N[2]);
+    const SimdFloat z  = SimdFloat::zero();
+    const SimdFloat e  = SimdFloat::set1(1e-8f);
+
+    SimdFloat r = z, g = z, b = z;
+
+    for (uint32_t i = begin; i < end; i += SimdFloat::kWidth)
+    {
+        // d = P - vpl_pos
+        SimdFloat dx = px - SimdFloat::load(vpls[VplList::POS_X] + i);
+        SimdFloat dy = py - SimdFloat::load(vpls[VplList::POS_Y] + i);
+        SimdFloat dz = pz - SimdFloat::load(vpls[VplList::POS_Z] + i);
+
+        SimdFloat d2 = dx * dx + dy * dy + dz * dz;
+
+        SimdFloat emit    = simd_max(z, SimdFloat::load(vpls[VplList::NORMAL_X] + i) * dx + SimdFloat::load(vpls[VplList::NORMAL_Y] + i) * dy + SimdFloat::load(vpls[VplList::NORMAL_Z] + i) * dz);
+        SimdFloat receive = simd_max(z, z - (nx * dx + ny * dy + nz * dz));
+        SimdFloat s       = simd_select_gt(d2, e, (emit * receive) / simd_max(d2 * d2, e));
+
+        r = r + SimdFloat::load(vpls[VplList::FLUX_R] + i) * s;
+        g = g + SimdFloat::load(vpls[VplList::FLUX_G] + i) * s;
+        b = b + SimdFloat::load(vpls[VplList::FLUX_B] + i) * s;
+    }
+
+    out[0] += r.sum();
+    out[1] += g.sum();
+    out[2] += b.sum();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same as shade_weighted(), but weights each VPL by its distance r from the disk center (cx, cy) and rejects VPLs outside
+// the disk. 'k' is the normalization of the polar sample density, all in RSM texel units.
+static void shade_disk(const VplList& vpls, uint32_t begin, uint32_t end, const float* P, const float* N, float cx, float cy, float radius, float k, float* out)
+{
+    const SimdFloat px = SimdFloat::set1(P[0]);
+    const SimdFloat py = SimdFloat::set1(P[1]);
+    const SimdFloat pz = SimdFloat::set1(P[2]);
+    const SimdFloat nx = SimdFloat::set1(N[0]);
+    const SimdFloat ny = SimdFloat::set1(N[1]);
+    const SimdFloat nz = SimdFloat::set1(N[2]);
+    const SimdFloat tx = SimdFloat::set1(cx);
+    const SimdFloat ty = SimdFloat::set1(cy);
+    const SimdFloat r2 = SimdFloat::set1(radius * radius);
+    const SimdFloat kk = SimdFloat::set1(k);
+    const SimdFloat z  = SimdFloat::zero();
+    const SimdFloat e  = SimdFloat::set1(1e-8f);
+
+    SimdFloat r = z, g = z, b = z;
+
+    for (uint32_t i = begin; i < end; i += SimdFloat::kWidth)
+    {
+        SimdFloat du = SimdFloat::load(vpls[VplList::TEXEL_X] + i) - tx;
+        SimdFloat dv = SimdFloat::load(vpls[VplList::TEXEL_Y] + i) - ty;
+        SimdFloat t2 = du * du + dv * dv;
+        SimdFloat w  = simd_select_gt(r2, t2, simd_sqrt(t2) * kk);
+
+        SimdFloat dx = px - SimdFloat::load(vpls[VplList::POS_X] + i);
+        SimdFloat dy = py - SimdFloat::load(vpls[VplList::POS_Y] + i);
+        SimdFloat dz = pz - SimdFloat::load(vpls[VplList::POS_Z] + i);
+
+        SimdFloat d2 = dx * dx + dy * dy + dz * dz;
+
+        SimdFloat emit    = simd_max(z, SimdFloat::load(vpls[VplList::NORMAL_X] + i) * dx + SimdFloat::load(vpls[VplList::NORMAL_Y] + i) * dy + SimdFloat::load(vpls[VplList::NORMAL_Z] + i) * dz);
+        SimdFloat receive = simd_max(z, z - (nx * dx + ny * dy + nz * dz));
+        SimdFloat s       = simd_select_gt(d2, e, (emit * receive * w) / simd_max(d2 * d2, e));
+
+        r = r + SimdFloat::load(vpls[VplList::FLUX_R] + i) * s;
+        g = g + SimdFloat::load(vpls[VplList::FLUX_G] + i) * s;
+        b = b + SimdFloat::load(vpls[VplList::FLUX_B] + i) * s;
+    }
+
+    out[0] += r.sum();
+    out[1] += g.sum();
+    out[2] += b.sum();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// RSM CPU GATHER --------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RsmCpuGather::RsmCpuGather(ThreadPool& pool) :
+    m_pool(pool)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RsmCpuGather::gather(const RsmFrameCapture& capture, const RsmGatherSettings& settings, RsmImage& out)
+{
+    const RsmImage& gbuffer_pos    = capture.gbuffer_world_pos;
+    const RsmImage& gbuffer_normal = capture.gbuffer_normals;
+    const RsmImage& rsm_pos        = capture.rsm_world_pos;
+    const RsmImage& rsm_normal     = capture.rsm_normals;
+    const RsmImage& rsm_flux       = capture.rsm_flux;
+    const RsmLight& light          = capture.light;
+
+    uint32_t num_samples = std::min(settings.num_samples, uint32_t(capture.samples.size() / 3));
+    uint32_t tile_size   = std::max(settings.tile_size, 1u);
+    uint32_t tiles_x     = (gbuffer_pos.width + tile_size - 1) / tile_size;
+    uint32_t tiles_y     = (gbuffer_pos.height + tile_size - 1) / tile_size;
+
+    out.resize(gbuffer_pos.width, gbuffer_pos.height);
+
+    // For the brute-force gather every lit RSM texel becomes a VPL, stored row by row so that each pixel only has to
+    // visit the rows overlapping its sampling disk.
+    VplList               all_vpls;
+    std::vector<uint32_t> row_offsets;
+
+    if (settings.mode == RSM_GATHER_BRUTE_FORCE)
+    {
+        std::vector<uint32_t> lit;
+
+        row_offsets.resize(rsm_flux.height + 1);
+
+        for (uint32_t y = 0; y < rsm_flux.height; y++)
+        {
+            row_offsets[y] = uint32_t(lit.size());
+
+            for (uint32_t x = 0; x < rsm_flux.width; x++)
+            {
+                const float* f = rsm_flux.texel(x, y);
+
+                if (f[0] > 0.0f || f[1] > 0.0f || f[2] > 0.0f)
+                    lit.push_back(y * rsm_flux.width + x);
+            }
+        }
+
+        row_offsets[rsm_flux.height] = uint32_t(lit.size());
+
+        // Rows are padded individually so that every row starts on a SIMD boundary.
+        uint32_t padded_total = 0;
+
+        for (uint32_t y = 0; y < rsm_flux.height; y++)
+        {
+            uint32_t n     = row_offsets[y + 1] - row_offsets[y];
+            row_offsets[y] = padded_total;
+            padded_total += ((n + SimdFloat::kWidth - 1) / SimdFloat::kWidth) * SimdFloat::kWidth;
+        }
+
+        std::vector<uint32_t> row_counts(rsm_flux.height, 0);
+        all_vpls.resize(padded_total);
+
+        for (uint32_t idx : lit)
+        {
+            uint32_t x = idx % rsm_flux.width;
+            uint32_t y = idx / rsm_flux.width;
+            uint32_t i = row_offsets[y] + row_counts[y]++;
+
+            const float* p = rsm_pos.texel(x, y);
+            const float* f = rsm_flux.texel(x, y);
+            float        n[3];
+
+            memcpy(n, rsm_normal.texel(x, y), sizeof(n));
+            normalize3(n);
+
+            float atten = light_attenuation(light, p);
+
+            all_vpls[VplList::POS_X][i]    = p[0];
+            all_vpls[VplList::POS_Y][i]    = p[1];
+            all_vpls[VplList::POS_Z][i]    = p[2];
+            all_vpls[VplList::NORMAL_X][i] = n[0];
+            all_vpls[VplList::NORMAL_Y][i] = n[1];
+            all_vpls[VplList::NORMAL_Z][i] = n[2];
+            all_vpls[VplList::FLUX_R][i]   = f[0] * light.color[0] * atten;
+            all_vpls[VplList::FLUX_G][i]   = f[1] * light.color[1] * atten;
+            all_vpls[VplList::FLUX_B][i]   = f[2] * light.color[2] * atten;
+            all_vpls[VplList::TEXEL_X][i]  = float(x) + 0.5f;
+            all_vpls[VplList::TEXEL_Y][i]  = float(y) + 0.5f;
+        }
+
+        row_offsets[rsm_flux.height] = padded_total;
+    }
+
+    const float rsm_radius = capture.sample_radius * float(rsm_flux.width);
+    const float density    = float(num_samples) / (2.0f * float(M_PI) * rsm_radius * rsm_radius * rsm_radius);
+
+    m_pool.parallel_for(tiles_x * tiles_y, [&](uint32_t tile) {
+        uint32_t x_start = (tile % tiles_x) * tile_size;
+        uint32_t y_start = (tile / tiles_x) * tile_size;
+        uint32_t x_end   = std::min(x_start + tile_size, gbuffer_pos.width);
+        uint32_t y_end   = std::min(y_start + tile_size, gbuffer_pos.height);
+
+        VplList samples;
+
+        if (settings.mode == RSM_GATHER_SAMPLED)
+            samples.resize(num_samples);
+
+        for (uint32_t y = y_start; y < y_end; y++)
+        {
+            for (uint32_t x = x_start; x < x_end; x++)
+            {
+                const float* P = gbuffer_pos.texel(x, y);
+                float        N[3];
+
+                memcpy(N, gbuffer_normal.texel(x, y), sizeof(N));
+
+                float* result = out.texel(x, y);
+
+                // Background pixels have a zero normal in the G-buffer.
+                if (dot3(N, N) == 0.0f)
+                    continue;
+
+                normalize3(N);
+
+                float light_coord[2];
+                project_to_light(light, P, light_coord);
+
+                float indirect[3] = { 0.0f, 0.0f, 0.0f };
+
+                if (settings.mode == RSM_GATHER_SAMPLED)
+                {
+                    for (uint32_t i = 0; i < num_samples; i++)
+                    {
+                        const float* offset = &capture.samples[i * 3];
+
+                        float u = light_coord[0] + offset[0] * capture.sample_radius;
+                        float v = light_coord[1] + offset[1] * capture.sample_radius;
+
+                        float p[3], n[3], f[3];
+
+                        sample_bilinear(rsm_pos, u, v, p);
+                        sample_bilinear(rsm_normal, u, v, n);
+                        sample_bilinear(rsm_flux, u, v, f);
+
+                        normalize3(n);
+
+                        float w = light_attenuation(light, p) * offset[2] * offset[2];
+
+                        samples[VplList::POS_X][i]    = p[0];
+                        samples[VplList::POS_Y][i]    = p[1];
+                        samples[VplList::POS_Z][i]    = p[2];
+                        samples[VplList::NORMAL_X][i] = n[0];
+                        samples[VplList::NORMAL_Y][i] = n[1];
+                        samples[VplList::NORMAL_Z][i] = n[2];
+                        samples[VplList::FLUX_R][i]   = f[0] * light.color[0] * w;
+                        samples[VplList::FLUX_G][i]   = f[1] * light.color[1] * w;
+                        samples[VplList::FLUX_B][i]   = f[2] * light.color[2] * w;
+                    }
+
+                    shade_weighted(samples, 0, uint32_t(samples.attributes[0].size()), P, N, indirect);
+                }
+                else
+                {
+                    float cx = light_coord[0] * float(rsm_flux.width);
+                    float cy = light_coord[1] * float(rsm_flux.height);
+
+                    int32_t row_start = std::max(int32_t(std::floor(cy - rsm_radius)), 0);
+                    int32_t row_end   = std::min(int32_t(std::ceil(cy + rsm_radius)), int32_t(rsm_flux.height) - 1);
+
+                    for (int32_t row = row_start; row <= row_end; row++)
+                        shade_disk(all_vpls, row_offsets[row], row_offsets[row + 1], P, N, cx, cy, rsm_radius, density, indirect);
+                }
+
+                for (uint32_t c = 0; c < 3; c++)
+                    result[c] = std::min(std::max(indirect[c] * capture.indirect_light_amount, 0.0f), 1.0f);
+            }
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+const char* RsmCpuGather::simd_name()
+{
+#if defined(__AVX__)
+    return "AVX";
+#elif defined(RSM_SIMD_SSE)
+    return "SSE";
+#else
+    return "Scalar";
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// IMAGE I/O -------------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool RsmImage::write_pfm(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    // A negative scale marks little-endian data. PFM stores rows bottom-to-top, same as GL.
+    file << "PF\n"
+         << width << " " << height << "\n-1.0\n";
+    file.write((const char*)data.data(), data.size() * sizeof(float));
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool RsmImage::read_pfm(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    std::string header;
+    float       scale;
+    uint32_t    w, h;
+
+    file >> header >> w >> h >> scale;
+    file.get();
+
+    if (header != "PF" || scale > 0.0f)
+        return false;
+
+    resize(w, h);
+    file.read((char*)data.data(), data.size() * sizeof(float));
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void write_image(std::ofstream& file, const RsmImage& image)
+{
+    file.write((const char*)&image.width, sizeof(uint32_t));
+    file.write((const char*)&image.height, sizeof(uint32_t));
+    file.write((const char*)image.data.data(), image.data.size() * sizeof(float));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool read_image(std::ifstream& file, RsmImage& image)
+{
+    uint32_t w = 0, h = 0;
+
+    file.read((char*)&w, sizeof(uint32_t));
+    file.read((char*)&h, sizeof(uint32_t));
+
+    if (!file.good())
+        return false;
+
+    image.resize(w, h);
+    file.read((char*)image.data.data(), image.data.size() * sizeof(float));
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool RsmFrameCapture::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    uint32_t magic        = RSM_CAPTURE_MAGIC;
+    uint32_t version      = RSM_CAPTURE_VERSION;
+    uint32_t sample_count = uint32_t(samples.size() / 3);
+
+    file.write((const char*)&magic, sizeof(uint32_t));
+    file.write((const char*)&version, sizeof(uint32_t));
+    file.write((const char*)&light, sizeof(RsmLight));
+    file.write((const char*)&sample_radius, sizeof(float));
+    file.write((const char*)&indirect_light_amount, sizeof(float));
+    file.write((const char*)&sample_count, sizeof(uint32_t));
+    file.write((const char*)samples.data(), samples.size() * sizeof(float));
+
+    write_image(file, gbuffer_world_pos);
+    write_image(file, gbuffer_normals);
+    write_image(file, rsm_world_pos);
+    write_image(file, rsm_normals);
+    write_image(file, rsm_flux);
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool RsmFrameCapture::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    uint32_t magic        = 0;
+    uint32_t version      = 0;
+    uint32_t sample_count = 0;
+
+    file.read((char*)&magic, sizeof(uint32_t));
+    file.read((char*)&version, sizeof(uint32_t));
+
+    if (magic != RSM_CAPTURE_MAGIC || version != RSM_CAPTURE_VERSION)
+        return false;
+
+    file.read((char*)&light, sizeof(RsmLight));
+    file.read((char*)&sample_radius, sizeof(float));
+    file.read((char*)&indirect_light_amount, sizeof(float));
+    file.read((char*)&sample_count, sizeof(uint32_t));
+
+    if (!file.good())
+        return false;
+
+    samples.resize(size_t(sample_count) * 3);
+    file.read((char*)samples.data(), samples.size() * sizeof(float));
+
+    return read_image(file, gbuffer_world_pos) && read_image(file, gbuffer_normals) && read_image(file, rsm_world_pos) && read_image(file, rsm_normals) && read_image(file, rsm_flux);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RsmImageError rsm_image_error(const RsmImage& image, const RsmImage& reference)
+{
+    RsmImageError error;
+
+    if (image.data.size() != reference.data.size() || image.data.empty())
+    {
+        error.rmse = std::numeric_limits<double>::infinity();
+        return error;
+    }
+
+    double sum = 0.0;
+
+    for (size_t i = 0; i < image.data.size(); i++)
+    {
+        double d = double(image.data[i]) - double(reference.data[i]);
+        sum += d * d;
+    }
+
+    // Both images are clamped to [0.0 - 1.0] by the gather, so the peak signal is 1.
+    error.rmse = std::sqrt(sum / double(image.data.size()));
+    error.psnr = error.rmse > 0.0 ? -20.0 * std::log10(error.rmse) : std::numeric_limits<double>::infinity();
+
+    return error;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class ThreadPool;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Image with interleaved RGB float texels, row 0 at the bottom like a GL texture.
+struct RsmImage
+{
+    uint32_t           width  = 0;
+    uint32_t           height = 0;
+    std::vector<float> data;
+
+    void resize(uint32_t w, uint32_t h)
+    {
+        width  = w;
+        height = h;
+        data.assign(size_t(w) * size_t(h) * 3, 0.0f);
+    }
+
+    inline float*       texel(uint32_t x, uint32_t y) { return &data[(size_t(y) * width + x) * 3]; }
+    inline const float* texel(uint32_t x, uint32_t y) const { return &data[(size_t(y) * width + x) * 3]; }
+
+    bool write_pfm(const std::string& path) const;
+    bool read_pfm(const std::string& path);
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Spot light parameters as passed to indirect_light_fs.glsl. Cutoffs are cosines, matrices are column-major.
+struct RsmLight
+{
+    float position[3];
+    float direction[3];
+    float inner_cutoff;
+    float outer_cutoff;
+    float range;
+    float view_proj[16];
+    float color[3]; // Color times intensity, which the VPL flux is multiplied by.
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Everything the indirect lighting pass reads for a single frame. Written by the sample app and consumed offline.
+struct RsmFrameCapture
+{
+    RsmLight           light;
+    float              sample_radius         = 0.0f; // In RSM texture coordinates, same as u_SampleRadius.
+    float              indirect_light_amount = 1.0f;
+    std::vector<float> samples;                      // xyz per sample, same layout as s_Samples.
+    RsmImage           gbuffer_world_pos;
+    RsmImage           gbuffer_normals;
+    RsmImage           rsm_world_pos;
+    RsmImage           rsm_normals;
+    RsmImage           rsm_flux;
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+enum RsmGatherMode
+{
+    // Same estimator as the shader: u_NumSamples taps from the polar sample set, weighted by offset.z^2.
+    RSM_GATHER_SAMPLED,
+    // Converged value of the sampled estimator: every RSM texel inside the sampling disk, weighted by the density of the
+    // polar sample set. Produces the ground truth that the sampled result is measured against.
+    RSM_GATHER_BRUTE_FORCE
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct RsmGatherSettings
+{
+    RsmGatherMode mode        = RSM_GATHER_SAMPLED;
+    uint32_t      num_samples = 64;
+    uint32_t      tile_size   = 16;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct RsmImageError
+{
+    double rmse = 0.0;
+    double psnr = 0.0;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// CPU version of the indirect_light_fs.glsl gather. The output is split into tiles which are shaded across a thread
+// pool, and the VPL loop is vectorized over a SoA VPL layout (8-wide with AVX, 4-wide with SSE, scalar otherwise).
+class RsmCpuGather
+{
+public:
+    explicit RsmCpuGather(ThreadPool& pool);
+
+    // Fills 'out' with the indirect lighting for every pixel of the capture's G-buffer, including the clamp and
+    // u_IndirectLightAmount scaling done by the shader.
+    void gather(const RsmFrameCapture& capture, const RsmGatherSettings& settings, RsmImage& out);
+
+    static const char* simd_name();
+
+private:
+    ThreadPool& m_pool;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RsmImageError rsm_image_error(const RsmImage& image, const RsmImage& reference);
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,143 @@
+#include "rsm_reference.h"
+#include "sample_sets.h"
+#include "thread_pool.h"
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cerrno>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void print_usage()
+{
+    std::cout << "usage: RSMReferenceTool <capture.rsmc> [options]" << std::endl;
+    std::cout << "  --brute-force        Gather from every lit RSM texel instead of the sample set (ground truth)." << std::endl;
+    std::cout << "  --samples <n>        Number of samples to use from the captured sample set." << std::endl;
+    std::cout << "  --sample-set <type>  Replace the captured sample set: random, poisson, halton or sobol." << std::endl;
+    std::cout << "  --threads <n>        Worker thread count, 0 uses all hardware threads." << std::endl;
+    std::cout << "  --tile <n>           Tile size in pixels." << std::endl;
+    std::cout << "  --out <file.pfm>     Write the indirect lighting image." << std::endl;
+    std::cout << "  --reference <file>   Report RMSE and PSNR against a reference image." << std::endl;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Parses the whole string as an integer in [min_value, max_value]. Leaves 'value' unchanged and returns false otherwise.
+static bool parse_uint(const char* str, long min_value, long max_value, uint32_t& value)
+{
+    char* end = nullptr;
+
+    errno       = 0;
+    long result = strtol(str, &end, 10);
+
+    if (end == str || *end != '\0' || errno == ERANGE || result < min_value || result > max_value)
+        return false;
+
+    value = uint32_t(result);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        print_usage();
+        return 1;
+    }
+
+    RsmGatherSettings settings;
+    std::string       capture_path = argv[1];
+    std::string       out_path;
+    std::string       reference_path;
+    uint32_t          num_threads = 0;
+    SampleSetType     sample_set  = SAMPLE_SET_COUNT;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--brute-force")
+            settings.mode = RSM_GATHER_BRUTE_FORCE;
+        else if (arg == "--samples" && i + 1 < argc && parse_uint(argv[i + 1], 1, 65536, settings.num_samples))
+            i++;
+        else if (arg == "--sample-set" && i + 1 < argc && sample_set_from_arg(argv[i + 1]) != SAMPLE_SET_COUNT)
+            sample_set = sample_set_from_arg(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc && parse_uint(argv[i + 1], 0, 1024, num_threads))
+            i++;
+        else if (arg == "--tile" && i + 1 < argc && parse_uint(argv[i + 1], 1, 4096, settings.tile_size))
+            i++;
+        else if (arg == "--out" && i + 1 < argc)
+            out_path = argv[++i];
+        else if (arg == "--reference" && i + 1 < argc)
+            reference_path = argv[++i];
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    RsmFrameCapture capture;
+
+    if (!capture.load(capture_path))
+    {
+        std::cerr << "Failed to load capture: " << capture_path << std::endl;
+        return 1;
+    }
+
+    // Keeps the capture's sample count, so that the result stays comparable.
+    if (sample_set != SAMPLE_SET_COUNT)
+    {
+        std::vector<SamplePoint> points;
+
+        generate_sample_set(sample_set, uint32_t(capture.samples.size() / 3), points);
+        polar_sample_offsets(points, capture.samples);
+    }
+
+    ThreadPool   pool(num_threads);
+    RsmCpuGather gather(pool);
+    RsmImage     result;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    gather.gather(capture, settings, result);
+
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "Mode       : " << (settings.mode == RSM_GATHER_BRUTE_FORCE ? "brute-force" : "sampled") << std::endl;
+    std::cout << "Resolution : " << result.width << "x" << result.height << std::endl;
+    std::cout << "SIMD       : " << RsmCpuGather::simd_name() << std::endl;
+    std::cout << "Threads    : " << pool.num_threads() << std::endl;
+    std::cout << "Time       : " << elapsed << " ms" << std::endl;
+
+    if (!out_path.empty() && !result.write_pfm(out_path))
+    {
+        std::cerr << "Failed to write image: " << out_path << std::endl;
+        return 1;
+    }
+
+    if (!reference_path.empty())
+    {
+        RsmImage reference;
+
+        if (!reference.read_pfm(reference_path))
+        {
+            std::cerr << "Failed to read reference image: " << reference_path << std::endl;
+            return 1;
+        }
+
+        RsmImageError error = rsm_image_error(result, reference);
+
+        std::cout << "RMSE       : " << error.rmse << std::endl;
+        std::cout << "PSNR       : " << error.psnr << " dB" << std::endl;
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+enum SampleSetType
+{
+    SAMPLE_SET_RANDOM,
+    SAMPLE_SET_POISSON,
+    SAMPLE_SET_HALTON,
+    SAMPLE_SET_SOBOL,
+    SAMPLE_SET_COUNT
+};
+
+static const char* kSampleSetTypeArgs[] = { "random", "poisson", "halton", "sobol" };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Point in [0.0 - 1.0)^2.
+struct SamplePoint
+{
+    float u;
+    float v;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Returns SAMPLE_SET_COUNT for unknown names.
+inline SampleSetType sample_set_from_arg(const std::string& arg)
+{
+    for (int i = 0; i < SAMPLE_SET_COUNT; i++)
+    {
+        if (arg == kSampleSetTypeArgs[i])
+            return SampleSetType(i);
+    }
+
+    return SAMPLE_SET_COUNT;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+inline float radical_inverse(uint32_t i, uint32_t base)
+{
+    float inv_base = 1.0f / float(base);
+    float scale    = inv_base;
+    float result   = 0.0f;
+
+    for (; i > 0; i /= base, scale *= inv_base)
+        result += float(i % base) * scale;
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Second dimension of the Sobol sequence, the first one is the base 2 radical inverse.
+inline uint32_t sobol_dimension_2(uint32_t i)
+{
+    uint32_t result = 0;
+
+    for (uint32_t v = 1u << 31; i > 0; i >>= 1, v ^= v >> 1)
+    {
+        if (i & 1)
+            result ^= v;
+    }
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+inline uint32_t reverse_bits(uint32_t bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return bits;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Best candidate sampling: every new point is the candidate furthest away from all previous ones. The v axis wraps around,
+// since it becomes the angle of the polar mapping. Unlike dart throwing, every prefix of the set is also well spread, which
+// matters because the gather uses the first u_NumSamples points and windows of the set.
+inline void generate_poisson_disk(uint32_t count, std::vector<SamplePoint>& points)
+{
+    const uint32_t kCandidatesPerPoint = 16;
+
+    std::mt19937                          engine(1337);
+    std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+
+    points.clear();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        SamplePoint best          = { dis(engine), dis(engine) };
+        float       best_distance = 0.0f;
+
+        for (uint32_t c = 0; i > 0 && c < i * kCandidatesPerPoint; c++)
+        {
+            SamplePoint candidate = { dis(engine), dis(engine) };
+            float       distance  = 2.0f;
+
+            for (const SamplePoint& p : points)
+            {
+                float du = candidate.u - p.u;
+                float dv = fabsf(candidate.v - p.v);
+
+                dv = std::min(dv, 1.0f - dv);
+
+                distance = std::min(distance, du * du + dv * dv);
+            }
+
+            if (distance > best_distance)
+            {
+                best          = candidate;
+                best_distance = distance;
+            }
+        }
+
+        points.push_back(best);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Generates 'count' points of the given type. The sets are deterministic. Halton skips its first point and Sobol is
+// shifted, as both would otherwise start at u = 0, which maps to a sample with zero weight.
+inline void generate_sample_set(SampleSetType type, uint32_t count, std::vector<SamplePoint>& points)
+{
+    points.clear();
+
+    if (type == SAMPLE_SET_POISSON)
+    {
+        generate_poisson_disk(count, points);
+        return;
+    }
+
+    // Unseeded, as the original sample set was.
+    std::default_random_engine            engine;
+    std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        SamplePoint p;
+
+        if (type == SAMPLE_SET_HALTON)
+        {
+            p.u = radical_inverse(i + 1, 2);
+            p.v = radical_inverse(i + 1, 3);
+        }
+        else if (type == SAMPLE_SET_SOBOL)
+        {
+            // Fixed digital shifts keep every power of two prefix a (0, m, 2)-net.
+            p.u = float(reverse_bits(i) ^ 0x9E3779B9u) * 2.3283064365386963e-10f;
+            p.v = float(sobol_dimension_2(i) ^ 0x7F4A7C15u) * 2.3283064365386963e-10f;
+        }
+        else
+        {
+            p.u = dis(engine);
+            p.v = dis(engine);
+        }
+
+        points.push_back(p);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Maps the points to the polar sample offsets read by the indirect gather: xy is the offset inside the unit disk and z its
+// radius, which is the sample weight. The radius is uniform in [0, 1], so the estimator normalization does not depend on
+// the type of set.
+inline void polar_sample_offsets(const std::vector<SamplePoint>& points, std::vector<float>& offsets)
+{
+    // M_PI needs _USE_MATH_DEFINES on MSVC, which the includer may not have defined.
+    const float two_pi = 6.28318530717958647692f;
+
+    offsets.clear();
+
+    for (const SamplePoint& p : points)
+    {
+        offsets.push_back(p.u * sinf(two_pi * p.v));
+        offsets.push_back(p.u * cosf(two_pi * p.v));
+        offsets.push_back(p.u);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Tileable blue noise texture using the void-and-cluster method. 'values' receives size * size thresholds in
+// [0.0 - 1.0), each used exactly once. The last phase fills the largest voids until the texture is full instead of
+// removing clusters from the inverted pattern, which is the usual simplification.
+inline void generate_blue_noise(uint32_t size, std::vector<float>& values)
+{
+    const float kSigma = 1.5f;
+
+    uint32_t n = size * size;
+
+    // Toroidal Gaussian energy kernel.
+    std::vector<float> kernel(n);
+
+    for (uint32_t y = 0; y < size; y++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            float dx = float(std::min(x, size - x));
+            float dy = float(std::min(y, size - y));
+
+            kernel[y * size + x] = expf(-(dx * dx + dy * dy) / (2.0f * kSigma * kSigma));
+        }
+    }
+
+    std::vector<uint8_t> pattern(n, 0);
+    std::vector<float>   energy(n, 0.0f);
+
+    auto splat = [&](uint32_t i, float sign) {
+        uint32_t px = i % size;
+        uint32_t py = i / size;
+
+        for (uint32_t y = 0; y < size; y++)
+        {
+            for (uint32_t x = 0; x < size; x++)
+                energy[y * size + x] += sign * kernel[((y + size - py) % size) * size + (x + size - px) % size];
+        }
+    };
+
+    // Tightest cluster among the set pixels, or largest void among the empty ones.
+    auto find = [&](uint8_t set) {
+        uint32_t best = n;
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (pattern[i] == set && (best == n || (set ? energy[i] > energy[best] : energy[i] < energy[best])))
+                best = i;
+        }
+
+        return best;
+    };
+
+    // Initial pattern with roughly 10% of the pixels set.
+    std::vector<uint32_t> indices(n);
+
+    for (uint32_t i = 0; i < n; i++)
+        indices[i] = i;
+
+    std::mt19937 engine(1337);
+    std::shuffle(indices.begin(), indices.end(), engine);
+
+    uint32_t ones = std::max(1u, n / 10);
+
+    for (uint32_t i = 0; i < ones; i++)
+    {
+        pattern[indices[i]] = 1;
+        splat(indices[i], 1.0f);
+    }
+
+    // Move the tightest cluster into the largest void until that stops changing anything.
+    for (uint32_t iteration = 0; iteration < n; iteration++)
+    {
+        uint32_t cluster = find(1);
+
+        pattern[cluster] = 0;
+        splat(cluster, -1.0f);
+
+        uint32_t void_index = find(0);
+
+        pattern[void_index] = 1;
+        splat(void_index, 1.0f);
+
+        if (void_index == cluster)
+            break;
+    }
+
+    std::vector<uint32_t> rank(n, 0);
+
+    // Rank the initial pattern by removing its tightest clusters, on a copy.
+    {
+        std::vector<uint8_t> initial_pattern = pattern;
+        std::vector<float>   initial_energy  = energy;
+
+        for (uint32_t r = ones; r > 0; r--)
+        {
+            uint32_t cluster = find(1);
+
+            rank[cluster]    = r - 1;
+            pattern[cluster] = 0;
+            splat(cluster, -1.0f);
+        }
+
+        pattern = initial_pattern;
+        energy  = initial_energy;
+    }
+
+    // Rank the remaining pixels by filling the largest voids.
+    for (uint32_t r = ones; r < n; r++)
+    {
+        uint32_t void_index = find(0);
+
+        rank[void_index]    = r;
+        pattern[void_index] = 1;
+        splat(void_index, 1.0f);
+    }
+
+    values.resize(n);
+
+    for (uint32_t i = 0; i < n; i++)
+        values[i] = (float(rank[i]) + 0.5f) / float(n);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,216 @@
+#include "scene_bvh.h"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define SCENE_BVH_SSE
+#endif
+
+#define SCENE_BVH_WIDTH 4
+#define SCENE_BVH_MAX_DEPTH 64
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void submesh_bounds(const SceneSubMesh* submeshes, const uint32_t* items, uint32_t count, float* min_extents, float* max_extents)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        min_extents[axis] = std::numeric_limits<float>::max();
+        max_extents[axis] = -std::numeric_limits<float>::max();
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const SceneSubMesh& submesh = submeshes[items[i]];
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            min_extents[axis] = std::min(min_extents[axis], submesh.min_extents[axis]);
+            max_extents[axis] = std::max(max_extents[axis], submesh.max_extents[axis]);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SceneBvh::build(const SceneSubMesh* submeshes, uint32_t count)
+{
+    m_items.resize(count);
+    m_nodes.clear();
+
+    for (uint32_t i = 0; i < count; i++)
+        m_items[i] = i;
+
+    if (count > 0)
+        build_node(submeshes, 0, count);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int32_t SceneBvh::build_node(const SceneSubMesh* submeshes, uint32_t first, uint32_t count)
+{
+    // Median split along the longest axis of the centroid bounds, into as many as four equally sized parts.
+    float min_centroid[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float max_centroid[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const SceneSubMesh& submesh = submeshes[m_items[i]];
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float centroid     = submesh.min_extents[axis] + submesh.max_extents[axis];
+            min_centroid[axis] = std::min(min_centroid[axis], centroid);
+            max_centroid[axis] = std::max(max_centroid[axis], centroid);
+        }
+    }
+
+    int split_axis = 0;
+
+    for (int axis = 1; axis < 3; axis++)
+    {
+        if (max_centroid[axis] - min_centroid[axis] > max_centroid[split_axis] - min_centroid[split_axis])
+            split_axis = axis;
+    }
+
+    std::sort(m_items.begin() + first, m_items.begin() + first + count, [submeshes, split_axis](uint32_t a, uint32_t b) {
+        return submeshes[a].min_extents[split_axis] + submeshes[a].max_extents[split_axis] < submeshes[b].min_extents[split_axis] + submeshes[b].max_extents[split_axis];
+    });
+
+    int32_t index = int32_t(m_nodes.size());
+    m_nodes.push_back(SceneBvhNode());
+
+    uint32_t part_count = std::min(count, uint32_t(SCENE_BVH_WIDTH));
+    uint32_t part_first = first;
+
+    for (uint32_t i = 0; i < SCENE_BVH_WIDTH; i++)
+    {
+        uint32_t part_size = 0;
+
+        if (i < part_count)
+            part_size = (count * (i + 1)) / part_count - (count * i) / part_count;
+
+        float min_extents[3] = { 0.0f, 0.0f, 0.0f };
+        float max_extents[3] = { 0.0f, 0.0f, 0.0f };
+        int32_t child        = -1;
+
+        if (part_size > 0)
+        {
+            submesh_bounds(submeshes, &m_items[part_first], part_size, min_extents, max_extents);
+
+            if (part_size > 1)
+                child = build_node(submeshes, part_first, part_size);
+        }
+
+        // Recursion may have grown the node array, so the node is looked up again.
+        SceneBvhNode& node = m_nodes[index];
+
+        node.min_x[i] = min_extents[0];
+        node.min_y[i] = min_extents[1];
+        node.min_z[i] = min_extents[2];
+        node.max_x[i] = max_extents[0];
+        node.max_y[i] = max_extents[1];
+        node.max_z[i] = max_extents[2];
+        node.child[i] = child;
+        node.first[i] = part_first;
+        node.count[i] = part_size;
+
+        part_first += part_size;
+    }
+
+    return index;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool SceneBvh::cull(const CullPlane* planes, uint32_t plane_count, uint8_t* visible) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    bool any_visible = false;
+
+    int32_t stack[SCENE_BVH_MAX_DEPTH * SCENE_BVH_WIDTH];
+    int32_t stack_size = 0;
+
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        const SceneBvhNode& node = m_nodes[stack[--stack_size]];
+
+        // Test all four children against each plane, using the box corner furthest along the normal for rejection and
+        // the nearest one for full containment.
+#if defined(SCENE_BVH_SSE)
+        __m128 outside = _mm_setzero_ps();
+        __m128 inside  = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        const __m128 min_x = _mm_loadu_ps(node.min_x);
+        const __m128 min_y = _mm_loadu_ps(node.min_y);
+        const __m128 min_z = _mm_loadu_ps(node.min_z);
+        const __m128 max_x = _mm_loadu_ps(node.max_x);
+        const __m128 max_y = _mm_loadu_ps(node.max_y);
+        const __m128 max_z = _mm_loadu_ps(node.max_z);
+
+        for (uint32_t i = 0; i < plane_count; i++)
+        {
+            const CullPlane& plane = planes[i];
+
+            __m128 nx = _mm_set1_ps(plane.normal[0]);
+            __m128 ny = _mm_set1_ps(plane.normal[1]);
+            __m128 nz = _mm_set1_ps(plane.normal[2]);
+            __m128 d  = _mm_set1_ps(plane.distance);
+
+            __m128 far_dist  = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, plane.normal[0] >= 0.0f ? max_x : min_x), _mm_mul_ps(ny, plane.normal[1] >= 0.0f ? max_y : min_y)), _mm_add_ps(_mm_mul_ps(nz, plane.normal[2] >= 0.0f ? max_z : min_z), d));
+            __m128 near_dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, plane.normal[0] >= 0.0f ? min_x : max_x), _mm_mul_ps(ny, plane.normal[1] >= 0.0f ? min_y : max_y)), _mm_add_ps(_mm_mul_ps(nz, plane.normal[2] >= 0.0f ? min_z : max_z), d));
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(far_dist, _mm_setzero_ps()));
+            inside  = _mm_and_ps(inside, _mm_cmpge_ps(near_dist, _mm_setzero_ps()));
+        }
+
+        int outside_mask = _mm_movemask_ps(outside);
+        int inside_mask  = _mm_movemask_ps(inside);
+#else
+        int outside_mask = 0;
+        int inside_mask  = (1 << SCENE_BVH_WIDTH) - 1;
+
+        for (uint32_t i = 0; i < plane_count; i++)
+        {
+            const CullPlane& plane = planes[i];
+
+            for (uint32_t j = 0; j < SCENE_BVH_WIDTH; j++)
+            {
+                float far_dist  = plane.normal[0] * (plane.normal[0] >= 0.0f ? node.max_x[j] : node.min_x[j]) + plane.normal[1] * (plane.normal[1] >= 0.0f ? node.max_y[j] : node.min_y[j]) + plane.normal[2] * (plane.normal[2] >= 0.0f ? node.max_z[j] : node.min_z[j]) + plane.distance;
+                float near_dist = plane.normal[0] * (plane.normal[0] >= 0.0f ? node.min_x[j] : node.max_x[j]) + plane.normal[1] * (plane.normal[1] >= 0.0f ? node.min_y[j] : node.max_y[j]) + plane.normal[2] * (plane.normal[2] >= 0.0f ? node.min_z[j] : node.max_z[j]) + plane.distance;
+
+                if (far_dist < 0.0f)
+                    outside_mask |= 1 << j;
+                if (near_dist < 0.0f)
+                    inside_mask &= ~(1 << j);
+            }
+        }
+#endif
+
+        for (uint32_t j = 0; j < SCENE_BVH_WIDTH; j++)
+        {
+            if (node.count[j] == 0 || (outside_mask & (1 << j)))
+                continue;
+
+            if (node.child[j] == -1 || (inside_mask & (1 << j)))
+            {
+                for (uint32_t k = node.first[j]; k < node.first[j] + node.count[j]; k++)
+                    visible[m_items[k]] = 1;
+
+                any_visible = true;
+            }
+            else
+                stack[stack_size++] = node.child[j];
+        }
+    }
+
+    return any_visible;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "scene_cache.h"
+
+#include <vector>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Plane as (normal, distance), with the normal pointing into the culling volume: a point p is inside if
+// dot(normal, p) + distance >= 0.
+struct CullPlane
+{
+    float normal[3];
+    float distance;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Four children in structure-of-arrays layout, so that all of them are tested against a plane at once.
+struct SceneBvhNode
+{
+    float    min_x[4];
+    float    min_y[4];
+    float    min_z[4];
+    float    max_x[4];
+    float    max_y[4];
+    float    max_z[4];
+    int32_t  child[4]; // Index of an inner node, or -1 for a leaf.
+    uint32_t first[4]; // First item of the child's subtree.
+    uint32_t count[4]; // Number of items in the child's subtree, 0 for an unused slot.
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// 4-wide BVH over the submesh bounds of a mesh, with one submesh per leaf. The items of every subtree are contiguous, so
+// a subtree that lies completely inside the culling volume is accepted without visiting it.
+class SceneBvh
+{
+public:
+    void build(const SceneSubMesh* submeshes, uint32_t count);
+
+    // Sets visible[i] to 1 for every submesh whose bounds are not completely outside one of the planes. Entries of culled
+    // submeshes are left unchanged, so calling this once per volume accumulates their union. Returns true if any submesh
+    // was found visible.
+    bool cull(const CullPlane* planes, uint32_t plane_count, uint8_t* visible) const;
+
+    inline uint32_t node_count() const { return uint32_t(m_nodes.size()); }
+
+private:
+    int32_t build_node(const SceneSubMesh* submeshes, uint32_t first, uint32_t count);
+
+private:
+    std::vector<uint32_t>     m_items;
+    std::vector<SceneBvhNode> m_nodes;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
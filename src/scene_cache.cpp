@@ -0,0 +1,837 @@
+#include "scene_cache.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    define NOMINMAX
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+
+#define SCENE_CACHE_MAGIC 0x534D5352 // "RSMS"
+#define SCENE_CACHE_VERSION 1
+#define SCENE_CACHE_ALIGNMENT 16
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// SOURCE FILES ----------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// FNV-1a over 64 bit words, which is fast enough to hash scenes of several hundred megabytes at startup.
+static uint64_t hash_bytes(const uint8_t* data, size_t size)
+{
+    const uint64_t kPrime = 0x100000001B3ull;
+
+    uint64_t hash = 0xCBF29CE484222325ull;
+    size_t   i    = 0;
+
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(uint64_t));
+
+        hash = (hash ^ word) * kPrime;
+    }
+
+    for (; i < size; i++)
+        hash = (hash ^ data[i]) * kPrime;
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool read_file(const std::string& path, std::vector<char>& contents)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+    if (!file.is_open())
+        return false;
+
+    contents.resize(size_t(file.tellg()));
+    file.seekg(0);
+    file.read(contents.data(), contents.size());
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool stat_file(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+    struct stat info;
+
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    size  = uint64_t(info.st_size);
+    mtime = int64_t(info.st_mtime);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool make_source(const std::string& path, const std::vector<char>& contents, SceneSource& source)
+{
+    if (path.size() >= sizeof(source.path))
+        return false;
+
+    memset(&source, 0, sizeof(SceneSource));
+    strcpy(source.path, path.c_str());
+
+    source.hash = hash_bytes((const uint8_t*)contents.data(), contents.size());
+
+    return stat_file(path, source.size, source.mtime);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// OBJ IMPORT ------------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct ObjVertexKey
+{
+    int position;
+    int tex_coord;
+    int normal;
+
+    bool operator==(const ObjVertexKey& other) const { return position == other.position && tex_coord == other.tex_coord && normal == other.normal; }
+};
+
+struct ObjVertexKeyHash
+{
+    size_t operator()(const ObjVertexKey& key) const { return size_t(key.position) * 73856093u ^ size_t(key.tex_coord) * 19349663u ^ size_t(key.normal) * 83492791u; }
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Splits the buffer into NUL terminated lines in place, so that the number parsing can never run into the next line.
+static void split_lines(std::vector<char>& contents, std::vector<char*>& lines)
+{
+    contents.push_back('\0');
+
+    char* line = contents.data();
+
+    for (char& c : contents)
+    {
+        if (c == '\n' || c == '\r' || c == '\0')
+        {
+            c = '\0';
+            lines.push_back(line);
+            line = &c + 1;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static const char* skip_spaces(const char* p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+
+    return p;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the rest of the line after the keyword, or nullptr if the line does not start with it.
+static const char* match_keyword(const char* line, const char* keyword)
+{
+    line = skip_spaces(line);
+
+    size_t length = strlen(keyword);
+
+    if (strncmp(line, keyword, length) != 0 || (line[length] != ' ' && line[length] != '\t' && line[length] != '\0'))
+        return nullptr;
+
+    return skip_spaces(line + length);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static std::string trim_name(const char* p)
+{
+    std::string name = p;
+
+    while (!name.empty() && (name.back() == ' ' || name.back() == '\t'))
+        name.pop_back();
+
+    return name;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Reads the diffuse albedo (Kd) and opacity (d, or Tr) of every material in the library.
+static bool import_mtl(const std::string& path, std::unordered_map<std::string, std::vector<float>>& materials, SceneData& scene)
+{
+    std::vector<char> contents;
+
+    if (!read_file(path, contents))
+        return false;
+
+    SceneSource source;
+
+    if (!make_source(path, contents, source))
+        return false;
+
+    scene.sources.push_back(source);
+
+    std::vector<char*> lines;
+    split_lines(contents, lines);
+
+    std::vector<float>* material = nullptr;
+
+    for (const char* line : lines)
+    {
+        const char* p;
+
+        if ((p = match_keyword(line, "newmtl")))
+        {
+            material  = &materials[trim_name(p)];
+            *material = { 1.0f, 1.0f, 1.0f, 1.0f };
+        }
+        else if (!material)
+            continue;
+        else if ((p = match_keyword(line, "Kd")))
+        {
+            char* end;
+
+            for (int i = 0; i < 3; i++, p = end)
+                (*material)[i] = strtof(p, &end);
+        }
+        else if ((p = match_keyword(line, "d")))
+            (*material)[3] = strtof(p, nullptr);
+        else if ((p = match_keyword(line, "Tr")))
+            (*material)[3] = 1.0f - strtof(p, nullptr);
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Converts a 1-based or negative (relative) OBJ index to a 0-based one. Returns -1 if it is out of range.
+static int resolve_index(long index, size_t count)
+{
+    long resolved = index > 0 ? index - 1 : long(count) + index;
+
+    return (resolved >= 0 && resolved < long(count)) ? int(resolved) : -1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void begin_submesh(SceneData& scene, const float* albedo)
+{
+    SceneSubMesh submesh;
+
+    memset(&submesh, 0, sizeof(SceneSubMesh));
+
+    submesh.base_index  = uint32_t(scene.indices.size());
+    submesh.base_vertex = uint32_t(scene.vertices.size());
+
+    memcpy(submesh.albedo, albedo, sizeof(submesh.albedo));
+
+    for (int i = 0; i < 3; i++)
+    {
+        submesh.min_extents[i] = std::numeric_limits<float>::max();
+        submesh.max_extents[i] = -std::numeric_limits<float>::max();
+    }
+
+    scene.submeshes.push_back(submesh);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void end_submesh(SceneData& scene)
+{
+    SceneSubMesh& submesh = scene.submeshes.back();
+
+    submesh.index_count  = uint32_t(scene.indices.size()) - submesh.base_index;
+    submesh.vertex_count = uint32_t(scene.vertices.size()) - submesh.base_vertex;
+
+    if (submesh.index_count == 0)
+        scene.submeshes.pop_back();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void normalize3(float* v)
+{
+    float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+    if (length > 0.0f)
+    {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool SceneData::import_obj(const std::string& path)
+{
+    vertices.clear();
+    indices.clear();
+    submeshes.clear();
+    sources.clear();
+
+    std::vector<char> contents;
+
+    if (!read_file(path, contents))
+        return false;
+
+    SceneSource source;
+
+    if (!make_source(path, contents, source))
+        return false;
+
+    sources.push_back(source);
+
+    std::vector<char*> lines;
+    split_lines(contents, lines);
+
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+    std::unordered_map<std::string, std::vector<float>> materials;
+    std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> vertex_map;
+
+    std::vector<float> positions;
+    std::vector<float> tex_coords;
+    std::vector<float> normals;
+    std::vector<bool>  generated_normal;
+
+    const float kDefaultAlbedo[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    std::vector<uint32_t> polygon;
+
+    begin_submesh(*this, kDefaultAlbedo);
+
+    for (const char* line : lines)
+    {
+        const char* p;
+        char*       end;
+
+        if ((p = match_keyword(line, "v")))
+        {
+            for (int i = 0; i < 3; i++, p = end)
+                positions.push_back(strtof(p, &end));
+        }
+        else if ((p = match_keyword(line, "vt")))
+        {
+            for (int i = 0; i < 2; i++, p = end)
+                tex_coords.push_back(strtof(p, &end));
+        }
+        else if ((p = match_keyword(line, "vn")))
+        {
+            for (int i = 0; i < 3; i++, p = end)
+                normals.push_back(strtof(p, &end));
+        }
+        else if ((p = match_keyword(line, "f")))
+        {
+            polygon.clear();
+
+            while (*p && *p != '#')
+            {
+                ObjVertexKey key = { resolve_index(strtol(p, &end, 10), positions.size() / 3), -1, -1 };
+
+                if (end == p || key.position < 0)
+                    return false;
+
+                p = end;
+
+                if (*p == '/')
+                {
+                    if (*++p != '/')
+                    {
+                        key.tex_coord = resolve_index(strtol(p, &end, 10), tex_coords.size() / 2);
+                        p             = end;
+                    }
+
+                    if (*p == '/')
+                    {
+                        key.normal = resolve_index(strtol(p + 1, &end, 10), normals.size() / 3);
+                        p          = end;
+                    }
+                }
+
+                auto it = vertex_map.find(key);
+
+                if (it == vertex_map.end())
+                {
+                    SceneVertex vertex;
+
+                    memset(&vertex, 0, sizeof(SceneVertex));
+                    memcpy(vertex.position, &positions[key.position * 3], sizeof(vertex.position));
+
+                    if (key.tex_coord >= 0)
+                        memcpy(vertex.tex_coord, &tex_coords[key.tex_coord * 2], sizeof(vertex.tex_coord));
+
+                    if (key.normal >= 0)
+                        memcpy(vertex.normal, &normals[key.normal * 3], sizeof(vertex.normal));
+
+                    SceneSubMesh& submesh = submeshes.back();
+
+                    for (int i = 0; i < 3; i++)
+                    {
+                        submesh.min_extents[i] = std::min(submesh.min_extents[i], vertex.position[i]);
+                        submesh.max_extents[i] = std::max(submesh.max_extents[i], vertex.position[i]);
+                    }
+
+                    it = vertex_map.insert({ key, uint32_t(vertices.size()) - submesh.base_vertex }).first;
+
+                    vertices.push_back(vertex);
+                    generated_normal.push_back(key.normal < 0);
+                }
+
+                polygon.push_back(it->second);
+                p = skip_spaces(p);
+            }
+
+            uint32_t base_vertex = submeshes.back().base_vertex;
+
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                uint32_t triangle[] = { polygon[0], polygon[i - 1], polygon[i] };
+
+                indices.insert(indices.end(), triangle, triangle + 3);
+
+                const float* a = vertices[base_vertex + triangle[0]].position;
+                const float* b = vertices[base_vertex + triangle[1]].position;
+                const float* c = vertices[base_vertex + triangle[2]].position;
+
+                float e0[] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                float e1[] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+                // Area weighted, normalized once every face has been added.
+                float face_normal[] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+
+                for (uint32_t index : triangle)
+                {
+                    if (!generated_normal[base_vertex + index])
+                        continue;
+
+                    float* normal = vertices[base_vertex + index].normal;
+
+                    for (int j = 0; j < 3; j++)
+                        normal[j] += face_normal[j];
+                }
+            }
+        }
+        else if ((p = match_keyword(line, "usemtl")))
+        {
+            auto material = materials.find(trim_name(p));
+
+            end_submesh(*this);
+            begin_submesh(*this, material != materials.end() ? material->second.data() : kDefaultAlbedo);
+
+            // Indices are relative to the submesh's base vertex, so vertices are not shared across submeshes.
+            vertex_map.clear();
+        }
+        else if ((p = match_keyword(line, "mtllib")))
+        {
+            if (!import_mtl(directory + trim_name(p), materials, *this))
+                return false;
+        }
+    }
+
+    end_submesh(*this);
+
+    // The scene shaders do not use normal maps, so any orthonormal tangent frame will do.
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        SceneVertex& vertex = vertices[i];
+
+        if (generated_normal[i])
+            normalize3(vertex.normal);
+
+        const float* n  = vertex.normal;
+        float        up[] = { 0.0f, 1.0f, 0.0f };
+
+        if (fabsf(n[1]) > 0.999f)
+        {
+            up[0] = 1.0f;
+            up[1] = 0.0f;
+        }
+
+        float* t = vertex.tangent;
+        float* b = vertex.bitangent;
+
+        t[0] = up[1] * n[2] - up[2] * n[1];
+        t[1] = up[2] * n[0] - up[0] * n[2];
+        t[2] = up[0] * n[1] - up[1] * n[0];
+        normalize3(t);
+
+        b[0] = n[1] * t[2] - n[2] * t[1];
+        b[1] = n[2] * t[0] - n[0] * t[2];
+        b[2] = n[0] * t[1] - n[1] * t[0];
+    }
+
+    return !submeshes.empty();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// CACHE FILE ------------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + SCENE_CACHE_ALIGNMENT - 1) & ~uint64_t(SCENE_CACHE_ALIGNMENT - 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void write_section(std::ofstream& file, uint64_t offset, const void* data, size_t size)
+{
+    static const char kPadding[SCENE_CACHE_ALIGNMENT] = {};
+
+    file.write(kPadding, offset - uint64_t(file.tellp()));
+    file.write((const char*)data, size);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool SceneData::save(const std::string& path) const
+{
+    SceneCacheHeader header;
+
+    memset(&header, 0, sizeof(SceneCacheHeader));
+
+    header.magic          = SCENE_CACHE_MAGIC;
+    header.version        = SCENE_CACHE_VERSION;
+    header.vertex_count   = uint32_t(vertices.size());
+    header.index_count    = uint32_t(indices.size());
+    header.submesh_count  = uint32_t(submeshes.size());
+    header.source_count   = uint32_t(sources.size());
+    header.vertex_offset  = align_offset(sizeof(SceneCacheHeader));
+    header.index_offset   = align_offset(header.vertex_offset + vertices.size() * sizeof(SceneVertex));
+    header.submesh_offset = align_offset(header.index_offset + indices.size() * sizeof(uint32_t));
+    header.source_offset  = align_offset(header.submesh_offset + submeshes.size() * sizeof(SceneSubMesh));
+
+    for (int i = 0; i < 3; i++)
+    {
+        header.min_extents[i] = std::numeric_limits<float>::max();
+        header.max_extents[i] = -std::numeric_limits<float>::max();
+
+        for (const SceneSubMesh& submesh : submeshes)
+        {
+            header.min_extents[i] = std::min(header.min_extents[i], submesh.min_extents[i]);
+            header.max_extents[i] = std::max(header.max_extents[i], submesh.max_extents[i]);
+        }
+    }
+
+    // Written to a temporary file first, so that an interrupted write never leaves a truncated cache behind.
+    std::string temp_path = path + ".tmp";
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open())
+            return false;
+
+        file.write((const char*)&header, sizeof(SceneCacheHeader));
+
+        write_section(file, header.vertex_offset, vertices.data(), vertices.size() * sizeof(SceneVertex));
+        write_section(file, header.index_offset, indices.data(), indices.size() * sizeof(uint32_t));
+        write_section(file, header.submesh_offset, submeshes.data(), submeshes.size() * sizeof(SceneSubMesh));
+        write_section(file, header.source_offset, sources.data(), sources.size() * sizeof(SceneSource));
+
+        if (!file.good())
+            return false;
+    }
+
+    std::remove(path.c_str());
+
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// MAPPED FILE -----------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        m_file = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (!m_mapping)
+    {
+        close();
+        return false;
+    }
+
+    m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    m_size = size_t(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps the file referenced.
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    // The whole file is uploaded right after mapping it.
+    madvise(data, size_t(info.st_size), MADV_WILLNEED);
+
+    m_data = (const uint8_t*)data;
+    m_size = size_t(info.st_size);
+#endif
+
+    if (!m_data)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+
+    if (m_mapping)
+        CloseHandle(m_mapping);
+
+    if (m_file)
+        CloseHandle(m_file);
+
+    m_mapping = nullptr;
+    m_file    = nullptr;
+#else
+    if (m_data)
+        munmap((void*)m_data, m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+// SCENE CACHE -----------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool section_fits(uint64_t offset, uint64_t count, size_t element_size, size_t file_size)
+{
+    return offset % SCENE_CACHE_ALIGNMENT == 0 && offset <= file_size && count <= (file_size - offset) / element_size;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool SceneCache::open(const std::string& path)
+{
+    close();
+
+    if (!m_file.open(path) || m_file.size() < sizeof(SceneCacheHeader))
+    {
+        close();
+        return false;
+    }
+
+    m_header = (const SceneCacheHeader*)m_file.data();
+
+    size_t size = m_file.size();
+
+    bool valid = m_header->magic == SCENE_CACHE_MAGIC && m_header->version == SCENE_CACHE_VERSION;
+
+    valid = valid && section_fits(m_header->vertex_offset, m_header->vertex_count, sizeof(SceneVertex), size);
+    valid = valid && section_fits(m_header->index_offset, m_header->index_count, sizeof(uint32_t), size);
+    valid = valid && section_fits(m_header->submesh_offset, m_header->submesh_count, sizeof(SceneSubMesh), size);
+    valid = valid && section_fits(m_header->source_offset, m_header->source_count, sizeof(SceneSource), size);
+
+    for (uint32_t i = 0; valid && i < m_header->submesh_count; i++)
+    {
+        const SceneSubMesh& submesh = submeshes()[i];
+
+        valid = uint64_t(submesh.base_index) + submesh.index_count <= m_header->index_count && uint64_t(submesh.base_vertex) + submesh.vertex_count <= m_header->vertex_count;
+    }
+
+    if (!valid)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SceneCache::close()
+{
+    m_file.close();
+    m_header = nullptr;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SceneCacheStatus SceneCache::status() const
+{
+    SceneCacheStatus status = SCENE_CACHE_CURRENT;
+
+    for (uint32_t i = 0; i < m_header->source_count; i++)
+    {
+        const SceneSource& source = sources()[i];
+
+        uint64_t size;
+        int64_t  mtime;
+
+        if (!stat_file(source.path, size, mtime) || size != source.size)
+            return SCENE_CACHE_STALE;
+
+        if (mtime == source.mtime)
+            continue;
+
+        // Copying or checking out the source changes its timestamp without changing it.
+        std::vector<char> contents;
+
+        if (!read_file(source.path, contents) || hash_bytes((const uint8_t*)contents.data(), contents.size()) != source.hash)
+            return SCENE_CACHE_STALE;
+
+        status = SCENE_CACHE_TOUCHED;
+    }
+
+    return status;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SceneCache::prefetch() const
+{
+    const size_t kPageSize = 4096;
+
+    volatile uint8_t sum = 0;
+
+    for (size_t i = 0; i < m_file.size(); i += kPageSize)
+        sum += m_file.data()[i];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string scene_cache_path(const std::string& obj_path)
+{
+    size_t extension = obj_path.find_last_of('.');
+    size_t separator = obj_path.find_last_of("/\\");
+
+    if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+        return obj_path + ".rsmscene";
+
+    return obj_path.substr(0, extension) + ".rsmscene";
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Records the current size and timestamp of every source in the cache file.
+static bool refresh_sources(const std::string& path, const SceneCacheHeader& header, const SceneSource* sources)
+{
+    std::vector<SceneSource> refreshed(sources, sources + header.source_count);
+
+    for (SceneSource& source : refreshed)
+    {
+        if (!stat_file(source.path, source.size, source.mtime))
+            return false;
+    }
+
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+
+    if (!file.is_open())
+        return false;
+
+    file.seekp(header.source_offset);
+    file.write((const char*)refreshed.data(), refreshed.size() * sizeof(SceneSource));
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool load_scene_cache(const std::string& obj_path, SceneCache& cache)
+{
+    std::string path = scene_cache_path(obj_path);
+
+    if (cache.open(path))
+    {
+        SceneCacheStatus status = cache.status();
+
+        if (status == SCENE_CACHE_CURRENT)
+            return true;
+
+        if (status == SCENE_CACHE_TOUCHED)
+        {
+            SceneCacheHeader         header = cache.header();
+            std::vector<SceneSource> sources(cache.sources(), cache.sources() + header.source_count);
+
+            // The cache stays usable even if it is read-only.
+            cache.close();
+            refresh_sources(path, header, sources.data());
+
+            return cache.open(path);
+        }
+
+        cache.close();
+    }
+
+    SceneData scene;
+
+    if (!scene.import_obj(obj_path) || !scene.save(path))
+        return false;
+
+    return cache.open(path);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
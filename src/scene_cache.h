@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same layout as dw::Vertex, which the vertex attributes of the scene shaders expect.
+struct SceneVertex
+{
+    float position[3];
+    float tex_coord[2];
+    float normal[3];
+    float tangent[3];
+    float bitangent[3];
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Draw range of one material. Indices are relative to base_vertex, as in dw::SubMesh.
+struct SceneSubMesh
+{
+    uint32_t base_index;
+    uint32_t base_vertex;
+    uint32_t index_count;
+    uint32_t vertex_count;
+    float    albedo[4];
+    float    min_extents[3];
+    float    max_extents[3];
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// A file the cache was built from. The cache is stale once any of them changes.
+struct SceneSource
+{
+    char     path[256];
+    uint64_t size;
+    int64_t  mtime;
+    uint64_t hash;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Start of a scene cache file. Every array is stored at a 16 byte aligned offset from the start of the file, in the layout
+// it is used in, so a mapped cache can be handed to the GPU without any conversion.
+struct SceneCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t source_count;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t submesh_offset;
+    uint64_t source_offset;
+    float    min_extents[3];
+    float    max_extents[3];
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+enum SceneCacheStatus
+{
+    SCENE_CACHE_CURRENT, // Every source matches its recorded size and timestamp.
+    SCENE_CACHE_TOUCHED, // Some timestamps changed, but the contents still hash to the recorded values.
+    SCENE_CACHE_STALE    // A source is missing or its contents changed.
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Scene geometry in memory, as produced by the OBJ importer.
+struct SceneData
+{
+    std::vector<SceneVertex>  vertices;
+    std::vector<uint32_t>     indices;
+    std::vector<SceneSubMesh> submeshes;
+    std::vector<SceneSource>  sources;
+
+    // Imports the OBJ file and the material libraries it references. Every 'usemtl' starts a new submesh. Polygons are
+    // triangulated as fans and missing normals are generated by averaging face normals.
+    bool import_obj(const std::string& path);
+    bool save(const std::string& path) const;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    inline const uint8_t* data() const { return m_data; }
+    inline size_t         size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+#ifdef _WIN32
+    void* m_file    = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// A scene cache file mapped into memory. The arrays point straight into the mapping, so opening a cache neither parses
+// nor copies any of the geometry.
+class SceneCache
+{
+public:
+    bool open(const std::string& path);
+    void close();
+
+    SceneCacheStatus status() const;
+
+    // Touches every page of the mapping, so that a later copy out of it does not stall on page faults. Meant to be called
+    // from a loader thread.
+    void prefetch() const;
+
+    inline const SceneCacheHeader& header() const { return *m_header; }
+    inline const SceneVertex*      vertices() const { return (const SceneVertex*)(m_file.data() + m_header->vertex_offset); }
+    inline const uint32_t*         indices() const { return (const uint32_t*)(m_file.data() + m_header->index_offset); }
+    inline const SceneSubMesh*     submeshes() const { return (const SceneSubMesh*)(m_file.data() + m_header->submesh_offset); }
+    inline const SceneSource*      sources() const { return (const SceneSource*)(m_file.data() + m_header->source_offset); }
+
+private:
+    MappedFile              m_file;
+    const SceneCacheHeader* m_header = nullptr;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The cache of an OBJ file lives next to it, with a .rsmscene extension.
+std::string scene_cache_path(const std::string& obj_path);
+
+// Maps the cache of 'obj_path'. If it is missing or stale the OBJ is imported and the cache written first, if only the
+// timestamps of its sources changed they are updated so that the contents are not hashed again on the next start.
+bool load_scene_cache(const std::string& obj_path, SceneCache& cache);
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,82 @@
+#include "scene_cache.h"
+
+#include <iostream>
+#include <string>
+#include <chrono>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void print_usage()
+{
+    std::cout << "usage: RSMSceneCacheTool <scene.obj> [options]" << std::endl;
+    std::cout << "  --out <file>    Output path, defaults to the OBJ path with a .rsmscene extension." << std::endl;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        print_usage();
+        return 1;
+    }
+
+    std::string obj_path = argv[1];
+    std::string out_path = scene_cache_path(obj_path);
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--out" && i + 1 < argc)
+            out_path = argv[++i];
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    SceneData scene;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (!scene.import_obj(obj_path))
+    {
+        std::cerr << "Failed to import OBJ: " << obj_path << std::endl;
+        return 1;
+    }
+
+    double import_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (!scene.save(out_path))
+    {
+        std::cerr << "Failed to write scene cache: " << out_path << std::endl;
+        return 1;
+    }
+
+    // Time the path the app takes on startup.
+    SceneCache cache;
+
+    start = std::chrono::high_resolution_clock::now();
+
+    if (!cache.open(out_path))
+    {
+        std::cerr << "Failed to map scene cache: " << out_path << std::endl;
+        return 1;
+    }
+
+    double map_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "Vertices   : " << scene.vertices.size() << std::endl;
+    std::cout << "Triangles  : " << scene.indices.size() / 3 << std::endl;
+    std::cout << "Submeshes  : " << scene.submeshes.size() << std::endl;
+    std::cout << "Import     : " << import_time << " ms" << std::endl;
+    std::cout << "Map        : " << map_time << " ms" << std::endl;
+    std::cout << "Written to : " << out_path << std::endl;
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -1,3 +1,9 @@
+// ------------------------------------------------------------------
+// DEFINES  ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define MAX_LIGHTS 32
+
 // ------------------------------------------------------------------
 // INPUT VARIABLES  -------------------------------------------------
 // ------------------------------------------------------------------
@@ -10,6 +16,21 @@ in vec2 FS_IN_TexCoord;
 
 out vec4 FS_OUT_Color;
 
+// ------------------------------------------------------------------
+// STRUCTURES  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+struct SpotLight
+{
+    mat4  view_proj;
+    mat4  inv_view_proj;
+    vec4  position;  // xyz: position, w: range
+    vec4  direction; // xyz: direction, w: shadow bias
+    vec4  color;     // rgb: color * intensity
+    vec4  cutoff;    // x: cos(inner cutoff), y: cos(outer cutoff)
+    ivec4 samples;   // x: polar sample count, y: first polar sample, z: importance sample count
+};
+
 // ------------------------------------------------------------------
 // UNIFORMS  --------------------------------------------------------
 // ------------------------------------------------------------------
@@ -19,26 +40,66 @@ layout(std140) uniform GlobalUniforms
     mat4 view_proj;
     mat4 light_view_proj;
     vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
+};
+
+layout(std140) uniform LightUniforms
+{
+    SpotLight lights[MAX_LIGHTS];
+    ivec4     light_count;
 };
 
+#ifdef COMPACT_GBUFFER
+uniform sampler2D s_Depth;
+#else
 uniform sampler2D s_WorldPos;
+#endif
 uniform sampler2D s_Normals;
 uniform sampler2D s_Albedo;
-uniform sampler2D s_ShadowMap;
-
-uniform vec3 u_LightPos;
-uniform vec3 u_LightDirection;
-uniform vec3  u_LightColor;
-uniform float u_LightInnerCutoff;
-uniform float u_LightOuterCutoff;
-uniform float u_LightIntensity;
-uniform float u_LightRange;
-uniform float u_LightBias;
+uniform sampler2DArray s_ShadowMap;
 
 // ------------------------------------------------------------------
 // FUNCTIONS  -------------------------------------------------------
 // ------------------------------------------------------------------
 
+#ifdef COMPACT_GBUFFER
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
+{
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// ------------------------------------------------------------------
+
+vec3 world_position_from_depth(vec2 tex_coord, float depth)
+{
+    vec4 world_pos = inv_view_proj * vec4(tex_coord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return world_pos.xyz / world_pos.w;
+}
+#endif
+
+// ------------------------------------------------------------------
+
+// Fetches the G-buffer position and normal. The normal is zero for background pixels in both layouts.
+void read_gbuffer(vec2 tex_coord, out vec3 P, out vec3 N)
+{
+#ifdef COMPACT_GBUFFER
+    float depth = texture(s_Depth, tex_coord).r;
+
+    P = world_position_from_depth(tex_coord, depth);
+    N = depth < 1.0 ? octahedral_decode(texture(s_Normals, tex_coord).rg) : vec3(0.0);
+#else
+    P = texture(s_WorldPos, tex_coord).rgb;
+    N = texture(s_Normals, tex_coord).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+
 // Convert an exponential depth value from an arbitrary views' projection to linear 0..1 depth
 float exp_01_to_linear_01_depth(float z, float n, float f)
 {
@@ -50,23 +111,23 @@ float exp_01_to_linear_01_depth(float z, float n, float f)
 
 // ------------------------------------------------------------------
 
-float spot_light_shadows(vec3 p)
+float spot_light_shadows(int light, vec3 p)
 {
     // Transform frag position into Light-space.
-    vec4 light_space_pos = light_view_proj * vec4(p, 1.0);
+    vec4 light_space_pos = lights[light].view_proj * vec4(p, 1.0);
 
     vec3 proj_coords = light_space_pos.xyz / light_space_pos.w;
     // transform to [0,1] range
     proj_coords = proj_coords * 0.5 + 0.5;
     // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closest_depth = texture(s_ShadowMap, proj_coords.xy).r;
+    float closest_depth = texture(s_ShadowMap, vec3(proj_coords.xy, float(light))).r;
     // get depth of current fragment from light's perspective
     float current_depth = proj_coords.z;
     // linearize depth values so that the bias can be applied
-    float linear_closest_depth = exp_01_to_linear_01_depth(closest_depth, 1.0, u_LightRange);
-    float linear_current_depth = exp_01_to_linear_01_depth(current_depth, 1.0, u_LightRange);
+    float linear_closest_depth = exp_01_to_linear_01_depth(closest_depth, 1.0, lights[light].position.w);
+    float linear_current_depth = exp_01_to_linear_01_depth(current_depth, 1.0, lights[light].position.w);
     // check whether current frag pos is in shadow
-    float bias   = u_LightBias;
+    float bias   = lights[light].direction.w;
     float shadow = linear_current_depth - bias > linear_closest_depth ? 1.0 : 0.0;
 
     return 1.0 - shadow;
@@ -80,17 +141,27 @@ const float kAmbient = 0.1;
 
 void main(void)
 {
-    vec3 albedo   = texture(s_Albedo, FS_IN_TexCoord).rgb;
-    vec3 frag_pos = texture(s_WorldPos, FS_IN_TexCoord).rgb;
-    vec3 N        = texture(s_Normals, FS_IN_TexCoord).rgb;
-    vec3 L        = normalize(u_LightPos - frag_pos); // FragPos -> LightPos vector
+    vec3 albedo = texture(s_Albedo, FS_IN_TexCoord).rgb;
+    vec3 frag_pos;
+    vec3 N;
+
+    read_gbuffer(FS_IN_TexCoord, frag_pos, N);
+
+    vec3 color = albedo * kAmbient;
+
+    for (int i = 0; i < light_count.x; i++)
+    {
+        vec3 L = normalize(lights[i].position.xyz - frag_pos); // FragPos -> LightPos vector
+
+        float theta       = dot(L, normalize(-lights[i].direction.xyz));
+        float distance    = length(frag_pos - lights[i].position.xyz);
+        float epsilon     = lights[i].cutoff.x - lights[i].cutoff.y;
+        float attenuation = smoothstep(lights[i].position.w, 0, distance) * clamp((theta - lights[i].cutoff.y) / epsilon, 0.0, 1.0) * spot_light_shadows(i, frag_pos);
 
-    float theta       = dot(L, normalize(-u_LightDirection));
-    float distance    = length(frag_pos - u_LightPos);
-    float epsilon     = u_LightInnerCutoff - u_LightOuterCutoff;
-    float attenuation = smoothstep(u_LightRange, 0, distance) * clamp((theta - u_LightOuterCutoff) / epsilon, 0.0, 1.0) * spot_light_shadows(frag_pos);
+        // Clamped so that back facing lights cannot darken the contribution of the others.
+        color += albedo * max(dot(N, L), 0.0) * attenuation * lights[i].color.rgb;
+    }
 
-    vec3 color   = albedo * dot(N, L) * attenuation * u_LightIntensity * u_LightColor + albedo * kAmbient;
     FS_OUT_Color = vec4(color, 1.0);
 }
 
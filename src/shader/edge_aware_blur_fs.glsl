@@ -0,0 +1,138 @@
+// ------------------------------------------------------------------
+// INPUT VARIABLES  -------------------------------------------------
+// ------------------------------------------------------------------
+
+in vec2 FS_IN_TexCoord;
+
+// ------------------------------------------------------------------
+// OUTPUT VARIABLES  ------------------------------------------------
+// ------------------------------------------------------------------
+
+out vec4 FS_OUT_Color;
+
+// ------------------------------------------------------------------
+// UNIFORMS  --------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(std140) uniform GlobalUniforms
+{
+    mat4 view_proj;
+    mat4 light_view_proj;
+    vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
+};
+
+uniform sampler2D s_Indirect;
+uniform sampler2D s_Normals;
+#ifdef COMPACT_GBUFFER
+uniform sampler2D s_Depth;
+#else
+uniform sampler2D s_WorldPos;
+#endif
+
+uniform vec2  u_Direction;
+uniform int   u_Radius;
+uniform float u_NormalPower;
+uniform float u_DepthSigma;
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+#ifdef COMPACT_GBUFFER
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
+{
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// ------------------------------------------------------------------
+
+vec3 world_position_from_depth(vec2 tex_coord, float depth)
+{
+    vec4 world_pos = inv_view_proj * vec4(tex_coord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return world_pos.xyz / world_pos.w;
+}
+#endif
+
+// ------------------------------------------------------------------
+
+// Fetches the G-buffer position and normal. The normal is zero for background pixels in both layouts.
+void read_gbuffer(vec2 tex_coord, out vec3 P, out vec3 N)
+{
+#ifdef COMPACT_GBUFFER
+    float depth = texture(s_Depth, tex_coord).r;
+
+    P = world_position_from_depth(tex_coord, depth);
+    N = depth < 1.0 ? octahedral_decode(texture(s_Normals, tex_coord).rg) : vec3(0.0);
+#else
+    P = texture(s_WorldPos, tex_coord).rgb;
+    N = texture(s_Normals, tex_coord).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+// One direction of a separable Gaussian blur whose weights are scaled by the same geometric similarity as the joint
+// bilateral upsampling, so that the noise is smoothed along surfaces but not across their edges.
+void main(void)
+{
+    vec3 P;
+    vec3 N;
+
+    read_gbuffer(FS_IN_TexCoord, P, N);
+
+    if (dot(N, N) == 0.0)
+    {
+        FS_OUT_Color = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    N = normalize(N);
+
+    float depth_sigma   = u_DepthSigma * length(P - cam_pos.xyz);
+    float spatial_sigma = max(float(u_Radius) * 0.5, 0.5);
+
+    ivec2 size  = textureSize(s_Indirect, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    vec3  indirect   = texelFetch(s_Indirect, pixel, 0).rgb;
+    float weight_sum = 1.0;
+
+    for (int i = -u_Radius; i <= u_Radius; i++)
+    {
+        ivec2 coord = pixel + ivec2(u_Direction) * i;
+
+        if (i == 0 || any(lessThan(coord, ivec2(0))) || any(greaterThanEqual(coord, size)))
+            continue;
+
+        vec3 sample_P;
+        vec3 sample_N;
+
+        read_gbuffer((vec2(coord) + 0.5) / vec2(size), sample_P, sample_N);
+
+        if (dot(sample_N, sample_N) == 0.0)
+            continue;
+
+        float offset         = float(i) / spatial_sigma;
+        float plane_distance = dot(N, sample_P - P) / depth_sigma;
+        float normal_weight  = pow(max(dot(N, normalize(sample_N)), 0.0), u_NormalPower);
+        float weight         = exp(-0.5 * (offset * offset + plane_distance * plane_distance)) * normal_weight;
+
+        indirect += texelFetch(s_Indirect, coord, 0).rgb * weight;
+        weight_sum += weight;
+    }
+
+    FS_OUT_Color = vec4(indirect / weight_sum, 1.0);
+}
+
+// ------------------------------------------------------------------
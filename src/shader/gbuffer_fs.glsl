@@ -2,9 +2,18 @@
 // OUTPUT VARIABLES  ------------------------------------------------
 // ------------------------------------------------------------------
 
+#if defined(PACKED_RSM)
+// Depth, octahedral normal and flux of the VPL, so that the passes reading the RSM need a single fetch.
+layout(location = 0) out uvec4 FS_OUT_RSM;
+#else
 layout(location = 0) out vec3 FS_OUT_Albedo;
+#ifdef COMPACT_GBUFFER
+layout(location = 1) out vec2 FS_OUT_Normal;
+#else
 layout(location = 1) out vec3 FS_OUT_Normal;
 layout(location = 2) out vec3 FS_OUT_WorldPos;
+#endif
+#endif
 
 // ------------------------------------------------------------------
 // INPUT VARIABLES  -------------------------------------------------
@@ -13,12 +22,46 @@ layout(location = 2) out vec3 FS_OUT_WorldPos;
 in vec3 FS_IN_WorldPos;
 in vec3 FS_IN_Normal;
 in vec2 FS_IN_TexCoord;
+#ifdef MULTI_DRAW_INDIRECT
+flat in int FS_IN_MaterialID;
+#endif
+
+// ------------------------------------------------------------------
+// STRUCTURES  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+struct Material
+{
+    vec4 albedo;
+};
 
 // ------------------------------------------------------------------
 // UNIFORMS ---------------------------------------------------------
 // ------------------------------------------------------------------
 
+#ifdef MULTI_DRAW_INDIRECT
+// One entry per draw command of the multi-draw.
+layout(std430, binding = 1) buffer Materials
+{
+    Material materials[];
+};
+#else
 uniform vec4 u_Diffuse;
+#endif
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+#if defined(COMPACT_GBUFFER) || defined(PACKED_RSM)
+// Octahedral normal encoding, maps a unit vector to [-1, 1]^2.
+vec2 octahedral_encode(vec3 n)
+{
+    n /= (abs(n.x) + abs(n.y) + abs(n.z));
+    vec2 sign_not_zero = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * sign_not_zero;
+}
+#endif
 
 // ------------------------------------------------------------------
 // MAIN -------------------------------------------------------------
@@ -26,12 +69,28 @@ uniform vec4 u_Diffuse;
 
 void main()
 {
-    if (u_Diffuse.a < 0.1)
+#ifdef MULTI_DRAW_INDIRECT
+    vec4 diffuse = materials[FS_IN_MaterialID].albedo;
+#else
+    vec4 diffuse = u_Diffuse;
+#endif
+
+    if (diffuse.a < 0.1)
         discard;
 
-    FS_OUT_Albedo   = u_Diffuse.xyz;
+#if defined(PACKED_RSM)
+    // The flux is the 8 bit albedo, so unorm packing keeps it exact. Position is reconstructed from the depth.
+    FS_OUT_RSM = uvec4(floatBitsToUint(gl_FragCoord.z), packSnorm2x16(octahedral_encode(normalize(FS_IN_Normal))), packUnorm4x8(vec4(diffuse.xyz, 0.0)), 0u);
+#else
+    FS_OUT_Albedo = diffuse.xyz;
+#ifdef COMPACT_GBUFFER
+    // World position is reconstructed from the depth buffer.
+    FS_OUT_Normal = octahedral_encode(normalize(FS_IN_Normal));
+#else
     FS_OUT_Normal   = FS_IN_Normal;
     FS_OUT_WorldPos = FS_IN_WorldPos;
+#endif
+#endif
 }
 
 // ------------------------------------------------------------------
@@ -1,3 +1,11 @@
+// ------------------------------------------------------------------
+// EXTENSIONS  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+#ifdef MULTI_DRAW_INDIRECT
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
 // ------------------------------------------------------------------
 // INPUT VARIABLES --------------------------------------------------
 // ------------------------------------------------------------------
@@ -15,6 +23,9 @@ layout(location = 4) in vec3 VS_IN_Bitangent;
 out vec3 FS_IN_WorldPos;
 out vec3 FS_IN_Normal;
 out vec2 FS_IN_TexCoord;
+#ifdef MULTI_DRAW_INDIRECT
+flat out int FS_IN_MaterialID;
+#endif
 
 // ------------------------------------------------------------------
 // UNIFORMS ---------------------------------------------------------
@@ -25,23 +36,31 @@ layout(std140) uniform GlobalUniforms
     mat4 view_proj;
     mat4 light_view_proj;
     vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
 };
 
-layout(std140) uniform ObjectUniforms
+// Transforms of the visible instances of the mesh, compacted by the CPU culling.
+layout(std430, binding = 2) buffer Instances
 {
-    mat4 model;
+    mat4 instance_transforms[];
 };
 
 // ------------------------------------------------------------------
 // MAIN -------------------------------------------------------------
 // ------------------------------------------------------------------
 
+// Drawn with one instance per visible instance of the mesh.
 void main()
 {
+    mat4 model     = instance_transforms[gl_InstanceID];
     vec4 world_pos = model * vec4(VS_IN_Position, 1.0f);
     FS_IN_WorldPos = world_pos.xyz;
     FS_IN_Normal   = normalize(normalize(mat3(model) * VS_IN_Normal));
     FS_IN_TexCoord = VS_IN_Texcoord;
+#ifdef MULTI_DRAW_INDIRECT
+    FS_IN_MaterialID = gl_BaseInstanceARB;
+#endif
 
     gl_Position = view_proj * world_pos;
 }
@@ -0,0 +1,467 @@
+// ------------------------------------------------------------------
+// DEFINES  ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define TILE_SIZE 16
+#define NUM_THREADS (TILE_SIZE * TILE_SIZE)
+#define MAX_LIGHTS 32
+
+// RSM texels a work group can stage for a light. 36 bytes each, which keeps the shared arrays below 32 KB.
+#define STAGE_TEXELS (NUM_THREADS * 3)
+
+// Values of u_Dither.
+#define DITHER_NONE 0
+#define DITHER_BAYER 1
+#define DITHER_BLUE_NOISE 2
+
+// Same dither permutations as indirect_light_fs.glsl.
+#ifndef DITHER_MODE
+#define DITHER_MODE u_Dither
+#define DITHER_SIZE u_DitherSize
+#endif
+
+// ------------------------------------------------------------------
+// INPUTS  ----------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE, local_size_z = 1) in;
+
+// ------------------------------------------------------------------
+// STRUCTURES  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+struct SpotLight
+{
+    mat4  view_proj;
+    mat4  inv_view_proj;
+    vec4  position;  // xyz: position, w: range
+    vec4  direction; // xyz: direction, w: shadow bias
+    vec4  color;     // rgb: color * intensity
+    vec4  cutoff;    // x: cos(inner cutoff), y: cos(outer cutoff)
+    ivec4 samples;   // x: polar sample count, y: first polar sample, z: importance sample count
+};
+
+struct Vpl
+{
+    vec4 position;
+    vec4 normal;
+    vec4 flux;
+};
+
+// ------------------------------------------------------------------
+// UNIFORMS  --------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(std140) uniform GlobalUniforms
+{
+    mat4 view_proj;
+    mat4 light_view_proj;
+    vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
+};
+
+layout(std140) uniform LightUniforms
+{
+    SpotLight lights[MAX_LIGHTS];
+    ivec4     light_count;
+};
+
+#ifdef VPL_CLUSTERS
+layout(std430, binding = 0) buffer VplClusters
+{
+    Vpl vpls[];
+};
+#endif
+
+layout(binding = 0, rgba16f) uniform writeonly image2D i_Indirect;
+
+uniform sampler2D s_Normals;
+#ifdef COMPACT_GBUFFER
+uniform sampler2D s_Depth;
+#else
+uniform sampler2D s_WorldPos;
+#endif
+#ifdef PACKED_RSM
+uniform usampler2DArray s_RSM;
+#else
+uniform sampler2DArray s_RSMFlux;
+uniform sampler2DArray s_RSMNormals;
+uniform sampler2DArray s_RSMWorldPos;
+#endif
+uniform sampler2D      s_Samples;
+uniform sampler2D      s_Dither;
+
+uniform float u_SampleRadius;
+uniform float u_IndirectLightAmount;
+uniform int   u_NumSamples;
+uniform float u_FrameRotation;
+uniform int   u_Dither;
+uniform int   u_DitherSize;
+#ifdef VPL_CLUSTERS
+uniform int   u_VplCount;
+uniform float u_VplFluxScale;
+#endif
+
+// ------------------------------------------------------------------
+// SHARED DATA  -----------------------------------------------------
+// ------------------------------------------------------------------
+
+shared vec3 g_position[STAGE_TEXELS];
+shared vec3 g_normal[STAGE_TEXELS];
+shared vec3 g_flux[STAGE_TEXELS];
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+#if defined(COMPACT_GBUFFER) || defined(PACKED_RSM)
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
+{
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+#endif
+
+// ------------------------------------------------------------------
+
+#ifdef COMPACT_GBUFFER
+vec3 world_position_from_depth(vec2 tex_coord, float depth)
+{
+    vec4 world_pos = inv_view_proj * vec4(tex_coord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return world_pos.xyz / world_pos.w;
+}
+#endif
+
+// ------------------------------------------------------------------
+
+// Fetches the G-buffer position and normal. The normal is zero for background pixels in both layouts.
+void read_gbuffer(vec2 tex_coord, out vec3 P, out vec3 N)
+{
+#ifdef COMPACT_GBUFFER
+    float depth = textureLod(s_Depth, tex_coord, 0.0).r;
+
+    P = world_position_from_depth(tex_coord, depth);
+    N = depth < 1.0 ? octahedral_decode(textureLod(s_Normals, tex_coord, 0.0).rg) : vec3(0.0);
+#else
+    P = textureLod(s_WorldPos, tex_coord, 0.0).rgb;
+    N = textureLod(s_Normals, tex_coord, 0.0).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+float light_attenuation(int light, vec3 frag_pos)
+{
+    vec3  L        = normalize(lights[light].position.xyz - frag_pos); // FragPos -> LightPos vector
+    float theta    = dot(L, normalize(-lights[light].direction.xyz));
+    float distance = length(frag_pos - lights[light].position.xyz);
+    float epsilon  = lights[light].cutoff.x - lights[light].cutoff.y;
+
+    return smoothstep(lights[light].position.w, 0, distance) * clamp((theta - lights[light].cutoff.y) / epsilon, 0.0, 1.0);
+}
+
+// ------------------------------------------------------------------
+
+// Fetches the VPL stored at tex_coord of the light's RSM layer, without the light colour. Coordinates outside the RSM have
+// no flux, like the border colour of the unpacked targets.
+void sample_rsm(vec2 tex_coord, int light, out vec3 position, out vec3 normal, out vec3 flux)
+{
+#ifdef PACKED_RSM
+    // A single fetch per VPL. The position is reconstructed at the texel center, where the rasterizer evaluated the depth.
+    ivec2 size  = textureSize(s_RSM, 0).xy;
+    ivec2 coord = ivec2(floor(tex_coord * vec2(size)));
+
+    if (any(lessThan(coord, ivec2(0))) || any(greaterThanEqual(coord, size)))
+    {
+        position = vec3(0.0);
+        normal   = vec3(0.0);
+        flux     = vec3(0.0);
+        return;
+    }
+
+    uvec4 texel = texelFetch(s_RSM, ivec3(coord, light), 0);
+    vec2  ndc   = (vec2(coord) + 0.5) / vec2(size) * 2.0 - 1.0;
+    vec4  pos   = lights[light].inv_view_proj * vec4(ndc, uintBitsToFloat(texel.x) * 2.0 - 1.0, 1.0);
+
+    position = pos.xyz / pos.w;
+    normal   = octahedral_decode(unpackSnorm2x16(texel.y));
+    flux     = unpackUnorm4x8(texel.z).rgb;
+#else
+    vec3 rsm_coord = vec3(tex_coord, float(light));
+
+    position = textureLod(s_RSMWorldPos, rsm_coord, 0.0).rgb;
+    normal   = textureLod(s_RSMNormals, rsm_coord, 0.0).rgb;
+    flux     = textureLod(s_RSMFlux, rsm_coord, 0.0).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Light bounced from the staged VPL at index i onto P. Any attenuation and sample weight is already part of its flux.
+vec3 staged_vpl_contribution(vec3 P, vec3 N, int i)
+{
+    vec3 d = P - g_position[i];
+
+    return g_flux[i] * ((max(0.0, dot(g_normal[i], d)) * max(0.0, dot(N, -d))) / max(pow(dot(d, d), 2.0), 1e-6));
+}
+
+// ------------------------------------------------------------------
+
+ivec2 rsm_size()
+{
+#ifdef PACKED_RSM
+    return textureSize(s_RSM, 0).xy;
+#else
+    return textureSize(s_RSMFlux, 0).xy;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Fetches the unfiltered VPL of an RSM texel, decoded like sample_rsm() does.
+void fetch_rsm_texel(ivec2 coord, int light, out vec3 position, out vec3 normal, out vec3 flux)
+{
+#ifdef PACKED_RSM
+    sample_rsm((vec2(coord) + 0.5) / vec2(rsm_size()), light, position, normal, flux);
+#else
+    position = texelFetch(s_RSMWorldPos, ivec3(coord, light), 0).rgb;
+    normal   = texelFetch(s_RSMNormals, ivec3(coord, light), 0).rgb;
+    flux     = texelFetch(s_RSMFlux, ivec3(coord, light), 0).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Staged RSM texel, or zero outside the RSM like the border colour of the unpacked targets.
+void staged_texel(ivec2 coord, ivec2 origin, ivec2 extent, ivec2 size, out vec3 position, out vec3 normal, out vec3 flux)
+{
+    if (any(lessThan(coord, ivec2(0))) || any(greaterThanEqual(coord, size)))
+    {
+        position = vec3(0.0);
+        normal   = vec3(0.0);
+        flux     = vec3(0.0);
+        return;
+    }
+
+    int i = (coord.y - origin.y) * extent.x + (coord.x - origin.x);
+
+    position = g_position[i];
+    normal   = g_normal[i];
+    flux     = g_flux[i];
+}
+
+// ------------------------------------------------------------------
+
+// Same result as sample_rsm() from the staged texels. The unpacked targets are filtered bilinearly, the packed one is
+// fetched by texel.
+void sample_staged_rsm(vec2 tex_coord, ivec2 origin, ivec2 extent, out vec3 position, out vec3 normal, out vec3 flux)
+{
+    ivec2 size = rsm_size();
+
+#ifdef PACKED_RSM
+    staged_texel(ivec2(floor(tex_coord * vec2(size))), origin, extent, size, position, normal, flux);
+#else
+    vec2  f = tex_coord * vec2(size) - 0.5;
+    ivec2 c = ivec2(floor(f));
+    vec2  w = fract(f);
+
+    vec3 p00, p10, p01, p11;
+    vec3 n00, n10, n01, n11;
+    vec3 f00, f10, f01, f11;
+
+    staged_texel(c, origin, extent, size, p00, n00, f00);
+    staged_texel(c + ivec2(1, 0), origin, extent, size, p10, n10, f10);
+    staged_texel(c + ivec2(0, 1), origin, extent, size, p01, n01, f01);
+    staged_texel(c + ivec2(1, 1), origin, extent, size, p11, n11, f11);
+
+    position = mix(mix(p00, p10, w.x), mix(p01, p11, w.x), w.y);
+    normal   = mix(mix(n00, n10, w.x), mix(n01, n11, w.x), w.y);
+    flux     = mix(mix(f00, f10, w.x), mix(f01, f11, w.x), w.y);
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Bounds of the tile's projected positions in the shadow map of a light, as (min.xy, max.xy). Empty if no pixel of the
+// tile needs the light. Must be called from uniform control flow.
+vec4 tile_light_coord_bounds(int light, vec2 light_coord, bool valid)
+{
+    uint idx = gl_LocalInvocationIndex;
+
+    g_position[idx] = vec3(valid ? light_coord : vec2(1e30), 0.0);
+    g_normal[idx]   = vec3(valid ? light_coord : vec2(-1e30), 0.0);
+
+    barrier();
+
+    for (uint s = NUM_THREADS / 2; s > 0; s >>= 1)
+    {
+        if (idx < s)
+        {
+            g_position[idx].xy = min(g_position[idx].xy, g_position[idx + s].xy);
+            g_normal[idx].xy   = max(g_normal[idx].xy, g_normal[idx + s].xy);
+        }
+
+        barrier();
+    }
+
+    vec4 bounds = vec4(g_position[0].xy, g_normal[0].xy);
+
+    // The shared arrays are reused for staging right after this.
+    barrier();
+
+    return bounds;
+}
+
+// ------------------------------------------------------------------
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+// One work group per TILE_SIZE x TILE_SIZE tile. Every pixel gathers the same samples as indirect_light_fs.glsl, centred
+// on its own projection into the RSM and with its own dither value. The clustered VPLs are staged in shared memory in
+// batches of NUM_THREADS. For the polar gather the work group stages every RSM texel inside the bounding box of its
+// pixels' sampling disks, so each texel is fetched once per tile instead of once per sample that lands on it. The box
+// only fits into shared memory for small sample radii or RSMs, otherwise every pixel fetches its samples directly.
+void main(void)
+{
+    ivec2 size  = imageSize(i_Indirect);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    uint  idx   = gl_LocalInvocationIndex;
+
+    vec3 P;
+    vec3 N;
+
+    read_gbuffer((vec2(pixel) + 0.5) / vec2(size), P, N);
+
+    // Threads outside the image and on background pixels still take part in staging.
+    bool valid = all(lessThan(pixel, size)) && dot(N, N) > 0.0;
+
+    N = valid ? normalize(N) : vec3(0.0);
+
+    vec3 indirect = vec3(0.0);
+
+#if defined(VPL_CLUSTERS)
+    for (int batch = 0; batch < u_VplCount; batch += NUM_THREADS)
+    {
+        int i = batch + int(idx);
+
+        if (i < u_VplCount)
+        {
+            g_position[idx] = vpls[i].position.xyz;
+            g_normal[idx]   = vpls[i].normal.xyz;
+            g_flux[idx]     = vpls[i].flux.rgb;
+        }
+
+        barrier();
+
+        if (valid)
+        {
+            int count = min(NUM_THREADS, u_VplCount - batch);
+
+            for (int j = 0; j < count; j++)
+                indirect += staged_vpl_contribution(P, N, j);
+        }
+
+        barrier();
+    }
+
+    indirect *= u_VplFluxScale;
+#else
+    ivec2 dither_pos      = pixel % DITHER_SIZE;
+    float dither_offset   = DITHER_MODE != DITHER_NONE ? texelFetch(s_Dither, dither_pos, 0).r : 0.0;
+    float dither_scale    = DITHER_MODE == DITHER_BAYER ? dither_offset : 0.0;
+    float dither_rotation = DITHER_MODE == DITHER_BLUE_NOISE ? dither_offset : 0.0;
+
+    // With temporal accumulation every frame uses a rotated pattern.
+    float angle    = 2.0 * 3.14159265359 * (u_FrameRotation + dither_rotation);
+    mat2  rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+    // The offsets lie inside the unit disk, and the Bayer matrix scales them by up to 1.5.
+    float reach = u_SampleRadius * (DITHER_MODE == DITHER_BAYER ? 1.5 : 1.0);
+
+    for (int light = 0; light < light_count.x; light++)
+    {
+        vec4 light_coord = lights[light].view_proj * vec4(P, 1.0);
+        vec2 center      = (light_coord.xy / light_coord.w) * 0.5 + 0.5;
+        vec4 bounds      = tile_light_coord_bounds(light, center, valid);
+
+        // No pixel of the tile needs this light.
+        if (bounds.x > bounds.z)
+            continue;
+
+        // Texels under the bilinear footprints of all samples of the tile plus a texel for rounding, limited to the RSM
+        // since everything outside it is black. Tiles with pixels projecting far outside the light's frustum never fit.
+        ivec2 rsm    = rsm_size();
+        ivec2 origin = clamp(ivec2(floor((bounds.xy - reach) * vec2(rsm) - 0.5)) - 1, ivec2(0), rsm - 1);
+        ivec2 last   = clamp(ivec2(floor((bounds.zw + reach) * vec2(rsm) - 0.5)) + 2, ivec2(0), rsm - 1);
+        ivec2 extent = last - origin + 1;
+        bool  staged = all(lessThan(abs(bounds), vec4(2.0))) && extent.x * extent.y <= STAGE_TEXELS;
+
+        if (staged)
+        {
+            for (int i = int(idx); i < extent.x * extent.y; i += NUM_THREADS)
+            {
+                vec3 vpl_pos;
+                vec3 normal;
+                vec3 flux;
+
+                fetch_rsm_texel(origin + ivec2(i % extent.x, i / extent.x), light, vpl_pos, normal, flux);
+
+                g_position[i] = vpl_pos;
+                g_normal[i]   = normal;
+                g_flux[i]     = flux;
+            }
+        }
+
+        barrier();
+
+        // Each light gathers its share of the sample budget from a window of the sample set, like the fragment path.
+        int  num_samples    = lights[light].samples.x;
+        int  first_sample   = lights[light].samples.y;
+        vec3 light_indirect = vec3(0.0);
+
+        if (valid)
+        {
+            for (int i = 0; i < num_samples; i++)
+            {
+                vec3 offset = texelFetch(s_Samples, ivec2((first_sample + i) % u_NumSamples, 0), 0).rgb;
+
+                offset.xy = rotation * offset.xy;
+
+                vec2 tex_coord = center + offset.xy * u_SampleRadius + (((offset.xy * u_SampleRadius) / 2.0) * dither_scale);
+
+                vec3 vpl_pos;
+                vec3 normal;
+                vec3 flux;
+
+                if (staged)
+                    sample_staged_rsm(tex_coord, origin, extent, vpl_pos, normal, flux);
+                else
+                    sample_rsm(tex_coord, light, vpl_pos, normal, flux);
+
+                normal = dot(normal, normal) > 0.0 ? normalize(normal) : vec3(0.0);
+
+                vec3 d = P - vpl_pos;
+
+                light_indirect += light_attenuation(light, vpl_pos) * flux * lights[light].color.rgb * ((max(0.0, dot(normal, d)) * max(0.0, dot(N, -d))) / max(pow(dot(d, d), 2.0), 1e-6)) * offset.z * offset.z;
+            }
+        }
+
+        if (num_samples > 0)
+            indirect += light_indirect * (float(u_NumSamples) / float(num_samples));
+
+        // The staged texels are overwritten by the bounds of the next light.
+        barrier();
+    }
+#endif
+
+    if (all(lessThan(pixel, size)))
+        imageStore(i_Indirect, pixel, vec4(clamp(indirect * u_IndirectLightAmount, 0.0, 1.0), 1.0));
+}
+
+// ------------------------------------------------------------------
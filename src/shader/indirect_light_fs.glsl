@@ -1,3 +1,21 @@
+// ------------------------------------------------------------------
+// DEFINES  ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define MAX_LIGHTS 32
+
+// Values of u_Dither.
+#define DITHER_NONE 0
+#define DITHER_BAYER 1
+#define DITHER_BLUE_NOISE 2
+
+// Permutations compiled for one dither mode get it and the dither texture size as constants, the generic program reads
+// them from uniforms.
+#ifndef DITHER_MODE
+#define DITHER_MODE u_Dither
+#define DITHER_SIZE u_DitherSize
+#endif
+
 // ------------------------------------------------------------------
 // INPUT VARIABLES  -------------------------------------------------
 // ------------------------------------------------------------------
@@ -10,6 +28,30 @@ in vec2 FS_IN_TexCoord;
 
 out vec4 FS_OUT_Color;
 
+// ------------------------------------------------------------------
+// STRUCTURES  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+struct SpotLight
+{
+    mat4  view_proj;
+    mat4  inv_view_proj;
+    vec4  position;  // xyz: position, w: range
+    vec4  direction; // xyz: direction, w: shadow bias
+    vec4  color;     // rgb: color * intensity
+    vec4  cutoff;    // x: cos(inner cutoff), y: cos(outer cutoff)
+    ivec4 samples;   // x: polar sample count, y: first polar sample, z: importance sample count
+};
+
+#ifdef VPL_CLUSTERS
+struct Vpl
+{
+    vec4 position;
+    vec4 normal;
+    vec4 flux;
+};
+#endif
+
 // ------------------------------------------------------------------
 // UNIFORMS  --------------------------------------------------------
 // ------------------------------------------------------------------
@@ -19,86 +61,414 @@ layout(std140) uniform GlobalUniforms
     mat4 view_proj;
     mat4 light_view_proj;
     vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
+};
+
+layout(std140) uniform LightUniforms
+{
+    SpotLight lights[MAX_LIGHTS];
+    ivec4     light_count;
 };
 
 uniform sampler2D s_Normals;
+#ifdef COMPACT_GBUFFER
+uniform sampler2D s_Depth;
+#else
 uniform sampler2D s_WorldPos;
-uniform sampler2D s_RSMFlux;
-uniform sampler2D s_RSMNormals;
-uniform sampler2D s_RSMWorldPos;
-uniform sampler2D s_Samples;
-uniform sampler2D s_Dither;
+#endif
+#ifdef PACKED_RSM
+uniform usampler2DArray s_RSM;
+#else
+uniform sampler2DArray s_RSMFlux;
+uniform sampler2DArray s_RSMNormals;
+uniform sampler2DArray s_RSMWorldPos;
+#endif
+uniform sampler2D      s_Samples;
+uniform sampler2D      s_Dither;
+#ifdef IMPORTANCE_SAMPLING
+uniform sampler2DArray s_RSMLuminance;
+#endif
+
+#ifdef VPL_CLUSTERS
+layout(std430, binding = 0) buffer VplClusters
+{
+    Vpl vpls[];
+};
+#endif
 
 uniform float u_SampleRadius;
 uniform float u_IndirectLightAmount;
 uniform int   u_NumSamples;
+uniform float u_FrameRotation;
 uniform int   u_Dither;
-uniform vec3 u_LightPos;
-uniform vec3  u_LightDirection;
-uniform float u_LightInnerCutoff;
-uniform float u_LightOuterCutoff;
-uniform float u_LightRange;
+uniform int   u_DitherSize;
+#ifdef IMPORTANCE_SAMPLING
+uniform int   u_ImportanceLevel;
+#endif
+#ifdef VPL_CLUSTERS
+uniform int   u_VplCount;
+uniform float u_VplFluxScale;
+#endif
+
+#ifdef NUM_SAMPLES
+// The whole sample set, baked in by the app as a list of vec3 constructors.
+const vec3 kSampleOffsets[NUM_SAMPLES] = vec3[NUM_SAMPLES](SAMPLE_OFFSETS);
+#endif
 
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
 // ------------------------------------------------------------------
 
-float light_attenuation(vec3 frag_pos)
+#if defined(COMPACT_GBUFFER) || defined(PACKED_RSM)
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
 {
-    vec3  L        = normalize(u_LightPos - frag_pos); // FragPos -> LightPos vector
-    float theta    = dot(L, normalize(-u_LightDirection));
-    float distance = length(frag_pos - u_LightPos);
-    float epsilon  = u_LightInnerCutoff - u_LightOuterCutoff;
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+#endif
 
-    return smoothstep(u_LightRange, 0, distance) * clamp((theta - u_LightOuterCutoff) / epsilon, 0.0, 1.0);
+// ------------------------------------------------------------------
+
+#ifdef COMPACT_GBUFFER
+vec3 world_position_from_depth(vec2 tex_coord, float depth)
+{
+    vec4 world_pos = inv_view_proj * vec4(tex_coord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return world_pos.xyz / world_pos.w;
 }
+#endif
 
 // ------------------------------------------------------------------
-// MAIN  ------------------------------------------------------------
+
+// Fetches the G-buffer position and normal. The normal is zero for background pixels in both layouts.
+void read_gbuffer(vec2 tex_coord, out vec3 P, out vec3 N)
+{
+#ifdef COMPACT_GBUFFER
+    float depth = texture(s_Depth, tex_coord).r;
+
+    P = world_position_from_depth(tex_coord, depth);
+    N = depth < 1.0 ? octahedral_decode(texture(s_Normals, tex_coord).rg) : vec3(0.0);
+#else
+    P = texture(s_WorldPos, tex_coord).rgb;
+    N = texture(s_Normals, tex_coord).rgb;
+#endif
+}
+
 // ------------------------------------------------------------------
 
-void main(void)
+float light_attenuation(int light, vec3 frag_pos)
 {
-    vec3 P = texture(s_WorldPos, FS_IN_TexCoord).rgb;
-    vec3 N = normalize(texture(s_Normals, FS_IN_TexCoord).rgb);
+    vec3  L        = normalize(lights[light].position.xyz - frag_pos); // FragPos -> LightPos vector
+    float theta    = dot(L, normalize(-lights[light].direction.xyz));
+    float distance = length(frag_pos - lights[light].position.xyz);
+    float epsilon  = lights[light].cutoff.x - lights[light].cutoff.y;
 
-    // Project fragment position into light's coordinate space.
-    vec4 light_coord = light_view_proj * vec4(P, 1.0);
+    return smoothstep(lights[light].position.w, 0, distance) * clamp((theta - lights[light].cutoff.y) / epsilon, 0.0, 1.0);
+}
 
-    // Perspective divide.
-    light_coord.xyz /= light_coord.w;
+// ------------------------------------------------------------------
 
-    // Remap to [0.0 - 1.0] range.
-    light_coord = light_coord * 0.5 + 0.5;
+// Fetches the VPL stored at tex_coord of the light's RSM layer, without the light colour. Coordinates outside the RSM have
+// no flux, like the border colour of the unpacked targets.
+void sample_rsm(vec2 tex_coord, int light, out vec3 position, out vec3 normal, out vec3 flux)
+{
+#ifdef PACKED_RSM
+    // A single fetch per VPL. The position is reconstructed at the texel center, where the rasterizer evaluated the depth.
+    ivec2 size  = textureSize(s_RSM, 0).xy;
+    ivec2 coord = ivec2(floor(tex_coord * vec2(size)));
 
-    vec3 indirect = vec3(0.0);
+    if (any(lessThan(coord, ivec2(0))) || any(greaterThanEqual(coord, size)))
+    {
+        position = vec3(0.0);
+        normal   = vec3(0.0);
+        flux     = vec3(0.0);
+        return;
+    }
 
-#ifdef DITHER_8_8
-    vec2  interleaved_pos = (mod(floor(gl_FragCoord.xy), 8.0));
-    float dither_offset   = texture(s_Dither, interleaved_pos / 8.0 + vec2(0.5 / 8.0, 0.5 / 8.0)).r;
+    uvec4 texel = texelFetch(s_RSM, ivec3(coord, light), 0);
+    vec2  ndc   = (vec2(coord) + 0.5) / vec2(size) * 2.0 - 1.0;
+    vec4  pos   = lights[light].inv_view_proj * vec4(ndc, uintBitsToFloat(texel.x) * 2.0 - 1.0, 1.0);
+
+    position = pos.xyz / pos.w;
+    normal   = octahedral_decode(unpackSnorm2x16(texel.y));
+    flux     = unpackUnorm4x8(texel.z).rgb;
 #else
-    vec2  interleaved_pos = (mod(floor(gl_FragCoord.xy), 4.0));
-    float dither_offset   = texture(s_Dither, interleaved_pos / 4.0 + vec2(0.5 / 4.0, 0.5 / 4.0)).r;
+    vec3 rsm_coord = vec3(tex_coord, float(light));
+
+    position = texture(s_RSMWorldPos, rsm_coord).rgb;
+    normal   = texture(s_RSMNormals, rsm_coord).rgb;
+    flux     = texture(s_RSMFlux, rsm_coord).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Light bounced from the VPL stored at tex_coord of the light's RSM layer onto P, without any sample weight.
+vec3 vpl_contribution(vec3 P, vec3 N, vec2 tex_coord, int light)
+{
+    vec3 vpl_pos;
+    vec3 vpl_normal;
+    vec3 vpl_flux;
+
+    sample_rsm(tex_coord, light, vpl_pos, vpl_normal, vpl_flux);
+
+    vpl_normal = normalize(vpl_normal);
+    vpl_flux *= lights[light].color.rgb;
+
+    return light_attenuation(light, vpl_pos) * vpl_flux * ((max(0.0, dot(vpl_normal, (P - vpl_pos))) * max(0.0, dot(N, (vpl_pos - P)))) / pow(length(P - vpl_pos), 4.0));
+}
+
+// ------------------------------------------------------------------
+
+// Contribution of one offset of the polar sample set, weighted by the squared radius of the offset.
+vec3 polar_sample(vec3 P, vec3 N, vec2 center, vec3 offset, mat2 rotation, float dither_scale, int light)
+{
+    offset.xy = rotation * offset.xy;
+
+    vec2 tex_coord = center + offset.xy * u_SampleRadius + (((offset.xy * u_SampleRadius) / 2.0) * dither_scale);
+
+    return vpl_contribution(P, N, tex_coord, light) * offset.z * offset.z;
+}
+
+// ------------------------------------------------------------------
+
+#ifdef VPL_CLUSTERS
+// Same as vpl_contribution() for a clustered VPL. The cone attenuation is already part of the cluster flux, and empty
+// clusters have a zero normal.
+vec3 cluster_contribution(vec3 P, vec3 N, Vpl vpl)
+{
+    vec3 d = P - vpl.position.xyz;
+
+    return vpl.flux.rgb * ((max(0.0, dot(vpl.normal.xyz, d)) * max(0.0, dot(N, -d))) / max(pow(dot(d, d), 2.0), 1e-6));
+}
 #endif
 
-    if (u_Dither == 0)
+// ------------------------------------------------------------------
+
+#ifdef IMPORTANCE_SAMPLING
+float radical_inverse(uint bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10;
+}
+
+// ------------------------------------------------------------------
+
+// Estimates the same integral as the polar sample loop below, but draws the samples from the RSM luminance pyramid.
+// A 4x4 block of texels covering the sampling disk is picked at the coarsest level where that is possible, and each
+// sample then descends the pyramid choosing between 4 children in proportion to their luminance until it reaches
+// u_ImportanceLevel, where it is placed uniformly inside the cell. Texels outside the disk get no samples.
+vec3 importance_gather(vec3 P, vec3 N, vec2 center, float rotation, int light, int num_samples)
+{
+    int   rsm_size    = textureSize(s_RSMLuminance, 0).x;
+    int   max_level   = int(log2(float(rsm_size)));
+    int   start_level = clamp(int(ceil(log2(2.0 * u_SampleRadius * float(rsm_size) / 3.0))), 0, max_level);
+    int   end_level   = min(u_ImportanceLevel, start_level);
+    ivec2 level_size  = textureSize(s_RSMLuminance, start_level).xy;
+    float texel_size  = 1.0 / float(level_size.x);
+    ivec2 origin      = ivec2(floor((center - u_SampleRadius) / texel_size));
+
+    float weights[16];
+    float column_sums[4] = float[4](0.0, 0.0, 0.0, 0.0);
+    float total          = 0.0;
+
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            ivec2 coord  = origin + ivec2(x, y);
+            vec2  corner = vec2(coord) * texel_size;
+            float weight = 0.0;
+
+            if (all(greaterThanEqual(coord, ivec2(0))) && all(lessThan(coord, level_size)) && distance(clamp(center, corner, corner + texel_size), center) < u_SampleRadius)
+                weight = texelFetch(s_RSMLuminance, ivec3(coord, light), start_level).r;
+
+            weights[y * 4 + x] = weight;
+            column_sums[x] += weight;
+            total += weight;
+        }
+    }
+
+    if (total <= 0.0)
+        return vec3(0.0);
+
+    // Density of the polar sample set, which the estimate is normalized to.
+    float density   = float(u_NumSamples) / (2.0 * 3.14159265359 * u_SampleRadius * u_SampleRadius * u_SampleRadius);
+    float cell_size = exp2(float(end_level)) / float(rsm_size);
+    vec3  indirect  = vec3(0.0);
+
+    for (int i = 0; i < num_samples; i++)
+    {
+        vec2 u = fract(vec2((float(i) + 0.5) / float(num_samples), radical_inverse(uint(i))) + rotation);
+
+        // Pick a column of the block, then a row inside it.
+        float target = u.x * total;
+        int   column = 0;
+
+        for (; column < 3 && target >= column_sums[column]; column++)
+            target -= column_sums[column];
+
+        u.x = min(target / column_sums[column], 0.99999);
+
+        float column_weight = column_sums[column];
+        int   row           = 0;
+
+        target = u.y * column_weight;
+
+        for (; row < 3 && target >= weights[row * 4 + column]; row++)
+            target -= weights[row * 4 + column];
+
+        float weight = weights[row * 4 + column];
+
+        if (weight <= 0.0)
+            continue;
+
+        u.y = min(target / weight, 0.99999);
+
+        ivec2 coord       = origin + ivec2(column, row);
+        float probability = weight / total;
+
+        for (int level = start_level; level > end_level; level--)
+        {
+            ivec2 child = coord * 2;
+
+            float c00 = texelFetch(s_RSMLuminance, ivec3(child, light), level - 1).r;
+            float c10 = texelFetch(s_RSMLuminance, ivec3(child + ivec2(1, 0), light), level - 1).r;
+            float c01 = texelFetch(s_RSMLuminance, ivec3(child + ivec2(0, 1), light), level - 1).r;
+            float c11 = texelFetch(s_RSMLuminance, ivec3(child + ivec2(1, 1), light), level - 1).r;
+
+            float sum    = c00 + c10 + c01 + c11;
+            float p_left = (c00 + c01) / sum;
+            float bottom = c00;
+            float top    = c01;
+
+            if (u.x < p_left)
+                u.x = u.x / p_left;
+            else
+            {
+                u.x = (u.x - p_left) / (1.0 - p_left);
+                child.x += 1;
+                bottom = c10;
+                top    = c11;
+            }
+
+            float p_bottom = bottom / (bottom + top);
+
+            if (u.y < p_bottom)
+            {
+                u.y = u.y / p_bottom;
+                probability *= bottom / sum;
+            }
+            else
+            {
+                u.y = (u.y - p_bottom) / (1.0 - p_bottom);
+                child.y += 1;
+                probability *= top / sum;
+            }
+
+            u     = min(u, vec2(0.99999));
+            coord = child;
+        }
+
+        vec2  tex_coord = (vec2(coord) + u) * cell_size;
+        float r         = distance(tex_coord, center);
+
+        if (r >= u_SampleRadius)
+            continue;
+
+        float pdf = probability / (cell_size * cell_size);
+
+        indirect += vpl_contribution(P, N, tex_coord, light) * (r * density / pdf);
+    }
+
+    return indirect / float(num_samples);
+}
+#endif
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+void main(void)
+{
+    vec3 P;
+    vec3 N;
+
+    read_gbuffer(FS_IN_TexCoord, P, N);
+
+    N = normalize(N);
+
+    vec3 indirect = vec3(0.0);
+
+    vec2  interleaved_pos = mod(floor(gl_FragCoord.xy), float(DITHER_SIZE));
+    float dither_offset   = texture(s_Dither, (interleaved_pos + 0.5) / float(DITHER_SIZE)).r;
+
+    if (DITHER_MODE == DITHER_NONE)
         dither_offset = 0.0;
 
-    for (int i = 0; i < u_NumSamples; i++)
+    // The Bayer matrix scales the sample offsets per pixel, blue noise rotates the pattern.
+    float dither_scale    = DITHER_MODE == DITHER_BAYER ? dither_offset : 0.0;
+    float dither_rotation = DITHER_MODE == DITHER_BLUE_NOISE ? dither_offset : 0.0;
+
+#if defined(VPL_CLUSTERS)
+    // Every cluster is a VPL, so the cost only depends on u_VplCount and not on the RSM resolution.
+    for (int i = 0; i < u_VplCount; i++)
+        indirect += cluster_contribution(P, N, vpls[i]);
+
+    indirect *= u_VplFluxScale;
+#else
+    // With temporal accumulation every frame uses a rotated pattern.
+    float angle    = 2.0 * 3.14159265359 * (u_FrameRotation + dither_rotation);
+    mat2  rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+    for (int light = 0; light < light_count.x; light++)
     {
-        vec3 offset    = texelFetch(s_Samples, ivec2(i, 0), 0).rgb;
-        vec2 tex_coord = light_coord.xy + offset.xy * u_SampleRadius + (((offset.xy * u_SampleRadius) / 2.0) * dither_offset);
+        // Project fragment position into light's coordinate space.
+        vec4 light_coord = lights[light].view_proj * vec4(P, 1.0);
 
-        vec3 vpl_pos    = texture(s_RSMWorldPos, tex_coord).rgb;
-        vec3 vpl_normal = normalize(texture(s_RSMNormals, tex_coord).rgb);
-        vec3 vpl_flux   = texture(s_RSMFlux, tex_coord).rgb;
+        // Perspective divide.
+        light_coord.xyz /= light_coord.w;
 
-        vec3 result = light_attenuation(vpl_pos) * vpl_flux * ((max(0.0, dot(vpl_normal, (P - vpl_pos))) * max(0.0, dot(N, (vpl_pos - P)))) / pow(length(P - vpl_pos), 4.0));
+        // Remap to [0.0 - 1.0] range.
+        light_coord = light_coord * 0.5 + 0.5;
 
-        result *= offset.z * offset.z;
+#if defined(IMPORTANCE_SAMPLING)
+        int num_samples = lights[light].samples.z;
+
+        // The dither value rotates the sample set per pixel instead of scaling the offsets.
+        if (num_samples > 0)
+            indirect += importance_gather(P, N, light_coord.xy, fract(dither_offset + u_FrameRotation), light, num_samples);
+#elif defined(NUM_SAMPLES)
+        // Permutation for a single light without temporal accumulation, which always gathers the whole set from its start.
+        // The fixed trip count and constant offsets let the compiler unroll the loop and fold the offsets.
+        for (int i = 0; i < NUM_SAMPLES; i++)
+            indirect += polar_sample(P, N, light_coord.xy, kSampleOffsets[i], rotation, dither_scale, light);
+#else
+        // Each light gathers its share of the sample budget from a window of the sample set. The result is scaled up to
+        // the full set so that the budget split does not change the brightness.
+        int  num_samples    = lights[light].samples.x;
+        int  first_sample   = lights[light].samples.y;
+        vec3 light_indirect = vec3(0.0);
 
-        // Uncomment following line for debugging.
-        // indirect += vec3(((max(0.0, dot(vpl_normal, normalize(P - vpl_pos))) * max(0.0, dot(N, normalize(vpl_pos - P))))));
-        indirect += result;
+        for (int i = 0; i < num_samples; i++)
+        {
+            vec3 offset = texelFetch(s_Samples, ivec2((first_sample + i) % u_NumSamples, 0), 0).rgb;
+
+            light_indirect += polar_sample(P, N, light_coord.xy, offset, rotation, dither_scale, light);
+        }
+
+        if (num_samples > 0)
+            indirect += light_indirect * (float(u_NumSamples) / float(num_samples));
+#endif
     }
+#endif
 
     FS_OUT_Color = vec4(clamp(indirect * u_IndirectLightAmount, 0.0, 1.0), 1.0);
 }
@@ -0,0 +1,132 @@
+// ------------------------------------------------------------------
+// INPUT VARIABLES  -------------------------------------------------
+// ------------------------------------------------------------------
+
+in vec2 FS_IN_TexCoord;
+
+// ------------------------------------------------------------------
+// OUTPUT VARIABLES  ------------------------------------------------
+// ------------------------------------------------------------------
+
+out vec4 FS_OUT_Color;
+
+// ------------------------------------------------------------------
+// UNIFORMS  --------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(std140) uniform GlobalUniforms
+{
+    mat4 view_proj;
+    mat4 light_view_proj;
+    vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
+};
+
+uniform sampler2D s_Indirect;
+uniform sampler2D s_Normals;
+#ifdef COMPACT_GBUFFER
+uniform sampler2D s_Depth;
+#else
+uniform sampler2D s_WorldPos;
+#endif
+
+uniform vec2  u_IndirectSize;
+uniform float u_NormalThreshold;
+uniform float u_DistanceThreshold;
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+#ifdef COMPACT_GBUFFER
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
+{
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// ------------------------------------------------------------------
+
+vec3 world_position_from_depth(vec2 tex_coord, float depth)
+{
+    vec4 world_pos = inv_view_proj * vec4(tex_coord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return world_pos.xyz / world_pos.w;
+}
+#endif
+
+// ------------------------------------------------------------------
+
+// Fetches the G-buffer position and normal. The normal is zero for background pixels in both layouts.
+void read_gbuffer(vec2 tex_coord, out vec3 P, out vec3 N)
+{
+#ifdef COMPACT_GBUFFER
+    float depth = texture(s_Depth, tex_coord).r;
+
+    P = world_position_from_depth(tex_coord, depth);
+    N = depth < 1.0 ? octahedral_decode(texture(s_Normals, tex_coord).rg) : vec3(0.0);
+#else
+    P = texture(s_WorldPos, tex_coord).rgb;
+    N = texture(s_Normals, tex_coord).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+void main(void)
+{
+    vec3 P;
+    vec3 N;
+
+    read_gbuffer(FS_IN_TexCoord, P, N);
+
+    // Background pixels receive no indirect light and never need refinement.
+    if (dot(N, N) == 0.0)
+    {
+        FS_OUT_Color = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    N = normalize(N);
+
+    // Allowed distance from the pixel's tangent plane, relative to the view distance so it holds at any depth.
+    float max_plane_distance = u_DistanceThreshold * length(P - cam_pos.xyz);
+
+    vec2 low_res_pos = FS_IN_TexCoord * u_IndirectSize - 0.5;
+    vec2 base        = floor(low_res_pos);
+    vec2 f           = low_res_pos - base;
+
+    vec3 indirect = vec3(0.0);
+
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 coord  = clamp(ivec2(base) + offset, ivec2(0), ivec2(u_IndirectSize) - 1);
+
+        // Fetch the G-buffer exactly where the low resolution indirect pass sampled it.
+        vec2 tex_coord = (vec2(coord) + 0.5) / u_IndirectSize;
+        vec3 sample_P;
+        vec3 sample_N;
+
+        read_gbuffer(tex_coord, sample_P, sample_N);
+
+        sample_N = normalize(sample_N);
+
+        // Leave the pixel to the full resolution refinement pass if any of the neighbours lies across a discontinuity.
+        // Written as a negated test so that background neighbours (NaN normals) are rejected as well.
+        if (!(dot(N, sample_N) >= u_NormalThreshold && abs(dot(N, sample_P - P)) <= max_plane_distance))
+            discard;
+
+        vec2 w = mix(1.0 - f, f, vec2(offset));
+        indirect += texelFetch(s_Indirect, coord, 0).rgb * w.x * w.y;
+    }
+
+    FS_OUT_Color = vec4(indirect, 1.0);
+}
+
+// ------------------------------------------------------------------
@@ -0,0 +1,52 @@
+// ------------------------------------------------------------------
+// INPUTS VARIABLES -------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(triangles) in;
+
+in vec3     GS_IN_WorldPos[];
+in vec3     GS_IN_Normal[];
+in vec2     GS_IN_TexCoord[];
+flat in int GS_IN_Layer[];
+#ifdef MULTI_DRAW_INDIRECT
+flat in int GS_IN_MaterialID[];
+#endif
+
+// ------------------------------------------------------------------
+// OUTPUT VARIABLES  ------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(triangle_strip, max_vertices = 3) out;
+
+out vec3 FS_IN_WorldPos;
+out vec3 FS_IN_Normal;
+out vec2 FS_IN_TexCoord;
+#ifdef MULTI_DRAW_INDIRECT
+flat out int FS_IN_MaterialID;
+#endif
+
+// ------------------------------------------------------------------
+// MAIN -------------------------------------------------------------
+// ------------------------------------------------------------------
+
+// Routes each instanced triangle to the RSM array layer of the light it was transformed for.
+void main()
+{
+    for (int i = 0; i < 3; i++)
+    {
+        gl_Layer       = GS_IN_Layer[0];
+        gl_Position    = gl_in[i].gl_Position;
+        FS_IN_WorldPos = GS_IN_WorldPos[i];
+        FS_IN_Normal   = GS_IN_Normal[i];
+        FS_IN_TexCoord = GS_IN_TexCoord[i];
+#ifdef MULTI_DRAW_INDIRECT
+        FS_IN_MaterialID = GS_IN_MaterialID[0];
+#endif
+
+        EmitVertex();
+    }
+
+    EndPrimitive();
+}
+
+// ------------------------------------------------------------------
@@ -0,0 +1,114 @@
+// ------------------------------------------------------------------
+// DEFINES  ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define MAX_LIGHTS 32
+
+// ------------------------------------------------------------------
+// INPUTS  ----------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// ------------------------------------------------------------------
+// STRUCTURES  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+struct SpotLight
+{
+    mat4  view_proj;
+    mat4  inv_view_proj;
+    vec4  position;  // xyz: position, w: range
+    vec4  direction; // xyz: direction, w: shadow bias
+    vec4  color;     // rgb: color * intensity
+    vec4  cutoff;    // x: cos(inner cutoff), y: cos(outer cutoff)
+    ivec4 samples;   // x: polar sample count, y: first polar sample, z: importance sample count
+};
+
+// ------------------------------------------------------------------
+// UNIFORMS  --------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(std140) uniform LightUniforms
+{
+    SpotLight lights[MAX_LIGHTS];
+    ivec4     light_count;
+};
+
+layout(binding = 0, r32f) uniform writeonly image2DArray i_Luminance;
+
+#ifdef PACKED_RSM
+uniform usampler2DArray s_RSM;
+#else
+uniform sampler2DArray s_RSMFlux;
+uniform sampler2DArray s_RSMWorldPos;
+#endif
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+float light_attenuation(int light, vec3 frag_pos)
+{
+    vec3  L        = normalize(lights[light].position.xyz - frag_pos); // FragPos -> LightPos vector
+    float theta    = dot(L, normalize(-lights[light].direction.xyz));
+    float distance = length(frag_pos - lights[light].position.xyz);
+    float epsilon  = lights[light].cutoff.x - lights[light].cutoff.y;
+
+    return smoothstep(lights[light].position.w, 0, distance) * clamp((theta - lights[light].cutoff.y) / epsilon, 0.0, 1.0);
+}
+
+// ------------------------------------------------------------------
+
+ivec2 rsm_size()
+{
+#ifdef PACKED_RSM
+    return textureSize(s_RSM, 0).xy;
+#else
+    return textureSize(s_RSMFlux, 0).xy;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Fetches the position and flux of the VPL at an RSM texel, without the light colour. In the packed layout the position is
+// reconstructed at the texel center, where the rasterizer evaluated the depth.
+void read_rsm(ivec3 coord, out vec3 position, out vec3 flux)
+{
+#ifdef PACKED_RSM
+    uvec4 texel = texelFetch(s_RSM, coord, 0);
+    vec2  ndc   = (vec2(coord.xy) + 0.5) / vec2(rsm_size()) * 2.0 - 1.0;
+    vec4  pos   = lights[coord.z].inv_view_proj * vec4(ndc, uintBitsToFloat(texel.x) * 2.0 - 1.0, 1.0);
+
+    position = pos.xyz / pos.w;
+    flux     = unpackUnorm4x8(texel.z).rgb;
+#else
+    position = texelFetch(s_RSMWorldPos, coord, 0).rgb;
+    flux     = texelFetch(s_RSMFlux, coord, 0).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+// One invocation per RSM texel, the z dimension of the dispatch selects the light.
+void main(void)
+{
+    ivec3 coord = ivec3(gl_GlobalInvocationID);
+
+    if (any(greaterThanEqual(coord.xy, rsm_size())))
+        return;
+
+    vec3 vpl_pos;
+    vec3 vpl_flux;
+
+    read_rsm(coord, vpl_pos, vpl_flux);
+
+    vpl_flux *= lights[coord.z].color.rgb;
+
+    // Same attenuated flux the gather uses, so texels outside the spot cone get no samples.
+    imageStore(i_Luminance, coord, vec4(dot(vpl_flux, vec3(0.2126, 0.7152, 0.0722)) * light_attenuation(coord.z, vpl_pos)));
+}
+
+// ------------------------------------------------------------------
@@ -1,3 +1,17 @@
+// ------------------------------------------------------------------
+// EXTENSIONS  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+#ifdef MULTI_DRAW_INDIRECT
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
+// ------------------------------------------------------------------
+// DEFINES  ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define MAX_LIGHTS 32
+
 // ------------------------------------------------------------------
 // INPUTS VARIABLES -------------------------------------------------
 // ------------------------------------------------------------------
@@ -12,9 +26,28 @@ layout(location = 4) in vec3 VS_IN_Bitangent;
 // OUTPUT VARIABLES  ------------------------------------------------
 // ------------------------------------------------------------------
 
-out vec3 FS_IN_WorldPos;
-out vec3 FS_IN_Normal;
-out vec2 FS_IN_TexCoord;
+out vec3     GS_IN_WorldPos;
+out vec3     GS_IN_Normal;
+out vec2     GS_IN_TexCoord;
+flat out int GS_IN_Layer;
+#ifdef MULTI_DRAW_INDIRECT
+flat out int GS_IN_MaterialID;
+#endif
+
+// ------------------------------------------------------------------
+// STRUCTURES  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+struct SpotLight
+{
+    mat4  view_proj;
+    mat4  inv_view_proj;
+    vec4  position;  // xyz: position, w: range
+    vec4  direction; // xyz: direction, w: shadow bias
+    vec4  color;     // rgb: color * intensity
+    vec4  cutoff;    // x: cos(inner cutoff), y: cos(outer cutoff)
+    ivec4 samples;   // x: polar sample count, y: first polar sample, z: importance sample count
+};
 
 // ------------------------------------------------------------------
 // UNIFORMS ---------------------------------------------------------
@@ -25,24 +58,40 @@ layout(std140) uniform GlobalUniforms
     mat4 view_proj;
     mat4 light_view_proj;
     vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
+};
+
+layout(std140) uniform LightUniforms
+{
+    SpotLight lights[MAX_LIGHTS];
+    ivec4     light_count;
 };
 
-layout(std140) uniform ObjectUniforms
+// Transforms of the visible instances of the mesh, compacted by the CPU culling.
+layout(std430, binding = 2) buffer Instances
 {
-    mat4 model;
+    mat4 instance_transforms[];
 };
 
 // ------------------------------------------------------------------
 // MAIN -------------------------------------------------------------
 // ------------------------------------------------------------------
 
+// Drawn with one instance per light and visible instance of the mesh, each goes to the RSM layer of its light.
 void main()
 {
+    int  layer     = gl_InstanceID % light_count.x;
+    mat4 model     = instance_transforms[gl_InstanceID / light_count.x];
     vec4 world_pos = model * vec4(VS_IN_Position, 1.0);
-    FS_IN_WorldPos = world_pos.xyz;
-    FS_IN_Normal   = normalize(mat3(model) * VS_IN_Normal);
-    FS_IN_TexCoord = VS_IN_TexCoord;
-    gl_Position    = light_view_proj * world_pos;
+    GS_IN_WorldPos = world_pos.xyz;
+    GS_IN_Normal   = normalize(mat3(model) * VS_IN_Normal);
+    GS_IN_TexCoord = VS_IN_TexCoord;
+    GS_IN_Layer    = layer;
+#ifdef MULTI_DRAW_INDIRECT
+    GS_IN_MaterialID = gl_BaseInstanceARB;
+#endif
+    gl_Position    = lights[layer].view_proj * world_pos;
 }
 
 // ------------------------------------------------------------------
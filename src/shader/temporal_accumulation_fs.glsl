@@ -0,0 +1,137 @@
+// ------------------------------------------------------------------
+// INPUT VARIABLES  -------------------------------------------------
+// ------------------------------------------------------------------
+
+in vec2 FS_IN_TexCoord;
+
+// ------------------------------------------------------------------
+// OUTPUT VARIABLES  ------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(location = 0) out vec4 FS_OUT_Color;
+layout(location = 1) out vec4 FS_OUT_Geometry;
+
+// ------------------------------------------------------------------
+// UNIFORMS  --------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(std140) uniform GlobalUniforms
+{
+    mat4 view_proj;
+    mat4 light_view_proj;
+    vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
+};
+
+uniform sampler2D s_Indirect;
+uniform sampler2D s_History;
+uniform sampler2D s_HistoryGeometry;
+uniform sampler2D s_Normals;
+#ifdef COMPACT_GBUFFER
+uniform sampler2D s_Depth;
+#else
+uniform sampler2D s_WorldPos;
+#endif
+
+uniform int   u_HistoryValid;
+uniform float u_MinBlendFactor;
+uniform float u_NormalThreshold;
+uniform float u_DepthThreshold;
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+#ifdef COMPACT_GBUFFER
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
+{
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// ------------------------------------------------------------------
+
+vec3 world_position_from_depth(vec2 tex_coord, float depth)
+{
+    vec4 world_pos = inv_view_proj * vec4(tex_coord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return world_pos.xyz / world_pos.w;
+}
+#endif
+
+// ------------------------------------------------------------------
+
+// Fetches the G-buffer position and normal. The normal is zero for background pixels in both layouts.
+void read_gbuffer(vec2 tex_coord, out vec3 P, out vec3 N)
+{
+#ifdef COMPACT_GBUFFER
+    float depth = texture(s_Depth, tex_coord).r;
+
+    P = world_position_from_depth(tex_coord, depth);
+    N = depth < 1.0 ? octahedral_decode(texture(s_Normals, tex_coord).rg) : vec3(0.0);
+#else
+    P = texture(s_WorldPos, tex_coord).rgb;
+    N = texture(s_Normals, tex_coord).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+void main(void)
+{
+    vec3 P;
+    vec3 N;
+
+    read_gbuffer(FS_IN_TexCoord, P, N);
+
+    vec3 current = texture(s_Indirect, FS_IN_TexCoord).rgb;
+
+    if (dot(N, N) == 0.0)
+    {
+        FS_OUT_Color    = vec4(current, 0.0);
+        FS_OUT_Geometry = vec4(0.0);
+        return;
+    }
+
+    N = normalize(N);
+
+    // The view depth is stored alongside the normal so that next frame can validate its reprojection.
+    float view_depth = (view_proj * vec4(P, 1.0)).w;
+
+    // Where this surface was on screen last frame, and how far away it was from the previous camera.
+    vec4  prev_clip      = prev_view_proj * vec4(P, 1.0);
+    vec2  prev_tex_coord = (prev_clip.xy / prev_clip.w) * 0.5 + 0.5;
+    float history_length = 0.0;
+    vec3  history        = vec3(0.0);
+
+    if (u_HistoryValid == 1 && prev_clip.w > 0.0 && all(greaterThanEqual(prev_tex_coord, vec2(0.0))) && all(lessThanEqual(prev_tex_coord, vec2(1.0))))
+    {
+        ivec2 prev_coord    = ivec2(prev_tex_coord * vec2(textureSize(s_HistoryGeometry, 0)));
+        vec4  prev_geometry = texelFetch(s_HistoryGeometry, prev_coord, 0);
+
+        // Reject the history if a different surface was visible there last frame.
+        bool same_normal = dot(N, prev_geometry.xyz) >= u_NormalThreshold;
+        bool same_depth  = abs(prev_geometry.w - prev_clip.w) <= u_DepthThreshold * prev_clip.w;
+
+        if (same_normal && same_depth)
+        {
+            vec4 prev = texture(s_History, prev_tex_coord);
+
+            history        = prev.rgb;
+            history_length = prev.a;
+        }
+    }
+
+    // Exponential moving average. Fresh history is averaged uniformly until it is long enough for the fixed blend factor.
+    history_length = min(history_length + 1.0, 1.0 / u_MinBlendFactor);
+
+    FS_OUT_Color    = vec4(mix(history, current, 1.0 / history_length), history_length);
+    FS_OUT_Geometry = vec4(N, view_depth);
+}
+
+// ------------------------------------------------------------------
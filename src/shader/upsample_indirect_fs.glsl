@@ -0,0 +1,150 @@
+// ------------------------------------------------------------------
+// INPUT VARIABLES  -------------------------------------------------
+// ------------------------------------------------------------------
+
+in vec2 FS_IN_TexCoord;
+
+// ------------------------------------------------------------------
+// OUTPUT VARIABLES  ------------------------------------------------
+// ------------------------------------------------------------------
+
+out vec4 FS_OUT_Color;
+
+// ------------------------------------------------------------------
+// UNIFORMS  --------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(std140) uniform GlobalUniforms
+{
+    mat4 view_proj;
+    mat4 light_view_proj;
+    vec4 cam_pos;
+    mat4 inv_view_proj;
+    mat4 prev_view_proj;
+};
+
+uniform sampler2D s_Indirect;
+uniform sampler2D s_Normals;
+#ifdef COMPACT_GBUFFER
+uniform sampler2D s_Depth;
+#else
+uniform sampler2D s_WorldPos;
+#endif
+
+uniform vec2  u_IndirectSize;
+uniform int   u_Radius;
+uniform float u_NormalPower;
+uniform float u_DepthSigma;
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+#ifdef COMPACT_GBUFFER
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
+{
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// ------------------------------------------------------------------
+
+vec3 world_position_from_depth(vec2 tex_coord, float depth)
+{
+    vec4 world_pos = inv_view_proj * vec4(tex_coord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return world_pos.xyz / world_pos.w;
+}
+#endif
+
+// ------------------------------------------------------------------
+
+// Fetches the G-buffer position and normal. The normal is zero for background pixels in both layouts.
+void read_gbuffer(vec2 tex_coord, out vec3 P, out vec3 N)
+{
+#ifdef COMPACT_GBUFFER
+    float depth = texture(s_Depth, tex_coord).r;
+
+    P = world_position_from_depth(tex_coord, depth);
+    N = depth < 1.0 ? octahedral_decode(texture(s_Normals, tex_coord).rg) : vec3(0.0);
+#else
+    P = texture(s_WorldPos, tex_coord).rgb;
+    N = texture(s_Normals, tex_coord).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+// Joint bilateral upsampling: a tent filter over the (2 * u_Radius)^2 nearest low resolution texels, where every texel is
+// also weighted by how well the G-buffer sample it was gathered for matches the pixel's surface. With a radius of 1 the
+// spatial weights are the bilinear ones.
+void main(void)
+{
+    vec3 P;
+    vec3 N;
+
+    read_gbuffer(FS_IN_TexCoord, P, N);
+
+    // Background pixels receive no indirect light and never need refinement.
+    if (dot(N, N) == 0.0)
+    {
+        FS_OUT_Color = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    N = normalize(N);
+
+    // Distance from the pixel's tangent plane is measured relative to the view distance so the filter holds at any depth.
+    float depth_sigma = u_DepthSigma * length(P - cam_pos.xyz);
+
+    vec2  low_res_pos = FS_IN_TexCoord * u_IndirectSize - 0.5;
+    ivec2 base        = ivec2(floor(low_res_pos));
+    ivec2 size        = ivec2(u_IndirectSize);
+
+    vec3  indirect   = vec3(0.0);
+    float weight_sum = 0.0;
+
+    for (int y = 1 - u_Radius; y <= u_Radius; y++)
+    {
+        for (int x = 1 - u_Radius; x <= u_Radius; x++)
+        {
+            ivec2 coord = base + ivec2(x, y);
+
+            if (any(lessThan(coord, ivec2(0))) || any(greaterThanEqual(coord, size)))
+                continue;
+
+            // Fetch the G-buffer exactly where the low resolution indirect pass sampled it.
+            vec2 tex_coord = (vec2(coord) + 0.5) / u_IndirectSize;
+            vec3 sample_P;
+            vec3 sample_N;
+
+            read_gbuffer(tex_coord, sample_P, sample_N);
+
+            if (dot(sample_N, sample_N) == 0.0)
+                continue;
+
+            vec2  spatial        = max(1.0 - abs(vec2(coord) - low_res_pos) / float(u_Radius), 0.0);
+            float plane_distance = dot(N, sample_P - P) / depth_sigma;
+            float normal_weight  = pow(max(dot(N, normalize(sample_N)), 0.0), u_NormalPower);
+            float weight         = spatial.x * spatial.y * normal_weight * exp(-0.5 * plane_distance * plane_distance);
+
+            indirect += texelFetch(s_Indirect, coord, 0).rgb * weight;
+            weight_sum += weight;
+        }
+    }
+
+    // No low resolution texel lies on the pixel's surface, leave it to the full resolution refinement pass.
+    if (weight_sum < 1e-4)
+        discard;
+
+    FS_OUT_Color = vec4(indirect / weight_sum, 1.0);
+}
+
+// ------------------------------------------------------------------
@@ -0,0 +1,191 @@
+// ------------------------------------------------------------------
+// DEFINES  ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define MAX_LIGHTS 32
+
+// ------------------------------------------------------------------
+// INPUTS  ----------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// ------------------------------------------------------------------
+// STRUCTURES  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+struct SpotLight
+{
+    mat4  view_proj;
+    mat4  inv_view_proj;
+    vec4  position;  // xyz: position, w: range
+    vec4  direction; // xyz: direction, w: shadow bias
+    vec4  color;     // rgb: color * intensity
+    vec4  cutoff;    // x: cos(inner cutoff), y: cos(outer cutoff)
+    ivec4 samples;   // x: polar sample count, y: first polar sample, z: importance sample count
+};
+
+struct Vpl
+{
+    vec4 position;
+    vec4 normal;
+    vec4 flux;
+};
+
+// ------------------------------------------------------------------
+// UNIFORMS  --------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(std140) uniform LightUniforms
+{
+    SpotLight lights[MAX_LIGHTS];
+    ivec4     light_count;
+};
+
+layout(std430, binding = 0) buffer VplClusters
+{
+    Vpl vpls[];
+};
+
+layout(binding = 0, r32ui) uniform writeonly uimage2DArray i_Labels;
+
+#ifdef PACKED_RSM
+uniform usampler2DArray s_RSM;
+#else
+uniform sampler2DArray s_RSMFlux;
+uniform sampler2DArray s_RSMNormals;
+uniform sampler2DArray s_RSMWorldPos;
+#endif
+
+uniform int   u_GridSize;
+uniform int   u_CellSize;
+uniform float u_NormalWeight;
+uniform float u_FluxWeight;
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+#ifdef PACKED_RSM
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
+{
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+#endif
+
+// ------------------------------------------------------------------
+
+float light_attenuation(int light, vec3 frag_pos)
+{
+    vec3  L        = normalize(lights[light].position.xyz - frag_pos); // FragPos -> LightPos vector
+    float theta    = dot(L, normalize(-lights[light].direction.xyz));
+    float distance = length(frag_pos - lights[light].position.xyz);
+    float epsilon  = lights[light].cutoff.x - lights[light].cutoff.y;
+
+    return smoothstep(lights[light].position.w, 0, distance) * clamp((theta - lights[light].cutoff.y) / epsilon, 0.0, 1.0);
+}
+
+// ------------------------------------------------------------------
+
+ivec2 rsm_size()
+{
+#ifdef PACKED_RSM
+    return textureSize(s_RSM, 0).xy;
+#else
+    return textureSize(s_RSMFlux, 0).xy;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Fetches the position, normal and flux of the VPL at an RSM texel, without the light colour. In the packed layout the position is
+// reconstructed at the texel center, where the rasterizer evaluated the depth.
+void read_rsm(ivec3 coord, out vec3 position, out vec3 normal, out vec3 flux)
+{
+#ifdef PACKED_RSM
+    uvec4 texel = texelFetch(s_RSM, coord, 0);
+    vec2  ndc   = (vec2(coord.xy) + 0.5) / vec2(rsm_size()) * 2.0 - 1.0;
+    vec4  pos   = lights[coord.z].inv_view_proj * vec4(ndc, uintBitsToFloat(texel.x) * 2.0 - 1.0, 1.0);
+
+    position = pos.xyz / pos.w;
+    normal   = octahedral_decode(unpackSnorm2x16(texel.y));
+    flux     = unpackUnorm4x8(texel.z).rgb;
+#else
+    position = texelFetch(s_RSMWorldPos, coord, 0).rgb;
+    normal   = texelFetch(s_RSMNormals, coord, 0).rgb;
+    flux     = texelFetch(s_RSMFlux, coord, 0).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+vec3 chromaticity(vec3 flux)
+{
+    return flux / max(flux.r + flux.g + flux.b, 1e-6);
+}
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+// k-means assignment step. Each lit RSM texel picks the closest of the clusters seeded in the 3x3 grid cells around it.
+// The distance is the squared world space distance, scaled up by normal and flux colour differences. The z dimension of
+// the dispatch selects the light.
+void main(void)
+{
+    ivec3 coord = ivec3(gl_GlobalInvocationID);
+
+    if (any(greaterThanEqual(coord.xy, rsm_size())))
+        return;
+
+    vec3 vpl_pos;
+    vec3 vpl_normal;
+    vec3 vpl_flux;
+
+    read_rsm(coord, vpl_pos, vpl_normal, vpl_flux);
+
+    vpl_flux *= lights[coord.z].color.rgb * light_attenuation(coord.z, vpl_pos);
+
+    uint best_cluster = 0xFFFFFFFFu;
+
+    if (dot(vpl_flux, vec3(0.2126, 0.7152, 0.0722)) > 0.0)
+    {
+        vec3  vpl_chroma    = chromaticity(vpl_flux);
+        ivec2 cell          = coord.xy / u_CellSize;
+        float best_distance = 1e30;
+
+        for (int y = -1; y <= 1; y++)
+        {
+            for (int x = -1; x <= 1; x++)
+            {
+                ivec2 neighbour = cell + ivec2(x, y);
+
+                if (any(lessThan(neighbour, ivec2(0))) || any(greaterThanEqual(neighbour, ivec2(u_GridSize))))
+                    continue;
+
+                uint id  = uint((coord.z * u_GridSize + neighbour.y) * u_GridSize + neighbour.x);
+                Vpl  vpl = vpls[id];
+
+                if (vpl.flux.r + vpl.flux.g + vpl.flux.b <= 0.0)
+                    continue;
+
+                vec3  d        = vpl_pos - vpl.position.xyz;
+                float distance = dot(d, d) * (1.0 + u_NormalWeight * (1.0 - dot(vpl_normal, vpl.normal.xyz)) + u_FluxWeight * length(vpl_chroma - chromaticity(vpl.flux.rgb)));
+
+                if (distance < best_distance)
+                {
+                    best_distance = distance;
+                    best_cluster  = id;
+                }
+            }
+        }
+    }
+
+    imageStore(i_Labels, coord, uvec4(best_cluster));
+}
+
+// ------------------------------------------------------------------
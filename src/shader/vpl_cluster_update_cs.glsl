@@ -0,0 +1,237 @@
+// ------------------------------------------------------------------
+// DEFINES  ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define NUM_THREADS 256
+#define MAX_LIGHTS 32
+
+// ------------------------------------------------------------------
+// INPUTS  ----------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(local_size_x = NUM_THREADS, local_size_y = 1, local_size_z = 1) in;
+
+// ------------------------------------------------------------------
+// STRUCTURES  ------------------------------------------------------
+// ------------------------------------------------------------------
+
+struct SpotLight
+{
+    mat4  view_proj;
+    mat4  inv_view_proj;
+    vec4  position;  // xyz: position, w: range
+    vec4  direction; // xyz: direction, w: shadow bias
+    vec4  color;     // rgb: color * intensity
+    vec4  cutoff;    // x: cos(inner cutoff), y: cos(outer cutoff)
+    ivec4 samples;   // x: polar sample count, y: first polar sample, z: importance sample count
+};
+
+struct Vpl
+{
+    vec4 position;
+    vec4 normal;
+    vec4 flux;
+};
+
+// ------------------------------------------------------------------
+// UNIFORMS  --------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(std140) uniform LightUniforms
+{
+    SpotLight lights[MAX_LIGHTS];
+    ivec4     light_count;
+};
+
+layout(std430, binding = 0) buffer VplClusters
+{
+    Vpl vpls[];
+};
+
+#ifndef CLUSTER_INIT
+layout(binding = 0, r32ui) uniform readonly uimage2DArray i_Labels;
+#endif
+
+#ifdef PACKED_RSM
+uniform usampler2DArray s_RSM;
+#else
+uniform sampler2DArray s_RSMFlux;
+uniform sampler2DArray s_RSMNormals;
+uniform sampler2DArray s_RSMWorldPos;
+#endif
+
+uniform int   u_GridSize;
+uniform int   u_CellSize;
+
+// ------------------------------------------------------------------
+// SHARED DATA  -----------------------------------------------------
+// ------------------------------------------------------------------
+
+shared vec3  g_flux[NUM_THREADS];
+shared vec3  g_position[NUM_THREADS];
+shared vec3  g_normal[NUM_THREADS];
+shared float g_weight[NUM_THREADS];
+
+// ------------------------------------------------------------------
+// FUNCTIONS  -------------------------------------------------------
+// ------------------------------------------------------------------
+
+#ifdef PACKED_RSM
+// Inverse of the octahedral encoding in gbuffer_fs.glsl.
+vec3 octahedral_decode(vec2 e)
+{
+    vec3  n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+#endif
+
+// ------------------------------------------------------------------
+
+float light_attenuation(int light, vec3 frag_pos)
+{
+    vec3  L        = normalize(lights[light].position.xyz - frag_pos); // FragPos -> LightPos vector
+    float theta    = dot(L, normalize(-lights[light].direction.xyz));
+    float distance = length(frag_pos - lights[light].position.xyz);
+    float epsilon  = lights[light].cutoff.x - lights[light].cutoff.y;
+
+    return smoothstep(lights[light].position.w, 0, distance) * clamp((theta - lights[light].cutoff.y) / epsilon, 0.0, 1.0);
+}
+
+// ------------------------------------------------------------------
+
+ivec2 rsm_size()
+{
+#ifdef PACKED_RSM
+    return textureSize(s_RSM, 0).xy;
+#else
+    return textureSize(s_RSMFlux, 0).xy;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+// Fetches the position, normal and flux of the VPL at an RSM texel, without the light colour. In the packed layout the position is
+// reconstructed at the texel center, where the rasterizer evaluated the depth.
+void read_rsm(ivec3 coord, out vec3 position, out vec3 normal, out vec3 flux)
+{
+#ifdef PACKED_RSM
+    uvec4 texel = texelFetch(s_RSM, coord, 0);
+    vec2  ndc   = (vec2(coord.xy) + 0.5) / vec2(rsm_size()) * 2.0 - 1.0;
+    vec4  pos   = lights[coord.z].inv_view_proj * vec4(ndc, uintBitsToFloat(texel.x) * 2.0 - 1.0, 1.0);
+
+    position = pos.xyz / pos.w;
+    normal   = octahedral_decode(unpackSnorm2x16(texel.y));
+    flux     = unpackUnorm4x8(texel.z).rgb;
+#else
+    position = texelFetch(s_RSMWorldPos, coord, 0).rgb;
+    normal   = texelFetch(s_RSMNormals, coord, 0).rgb;
+    flux     = texelFetch(s_RSMFlux, coord, 0).rgb;
+#endif
+}
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+// One work group per cluster. Sums the flux of its member texels and computes their luminance weighted position and
+// normal. With CLUSTER_INIT the members are the lit texels of the cluster's grid cell, otherwise the texels that the
+// assignment pass labelled with this cluster. Every light has its own u_GridSize x u_GridSize block of clusters.
+void main(void)
+{
+    uint  cluster  = gl_WorkGroupID.x;
+    uint  idx      = gl_LocalInvocationIndex;
+    int   light    = int(cluster) / (u_GridSize * u_GridSize);
+    int   local_id = int(cluster) % (u_GridSize * u_GridSize);
+    ivec2 cell     = ivec2(local_id % u_GridSize, local_id / u_GridSize);
+    ivec2 size     = rsm_size();
+
+#ifdef CLUSTER_INIT
+    ivec2 region_min = cell * u_CellSize;
+    ivec2 region_max = region_min + u_CellSize;
+#else
+    // A texel can only be assigned to a cluster seeded in one of the 3x3 cells around it.
+    ivec2 region_min = (cell - 1) * u_CellSize;
+    ivec2 region_max = (cell + 2) * u_CellSize;
+#endif
+
+    region_min = max(region_min, ivec2(0));
+    region_max = min(region_max, size);
+
+    ivec2 region_size = max(region_max - region_min, ivec2(0));
+    int   count       = region_size.x * region_size.y;
+
+    vec3  flux     = vec3(0.0);
+    vec3  position = vec3(0.0);
+    vec3  normal   = vec3(0.0);
+    float weight   = 0.0;
+
+    for (int i = int(idx); i < count; i += NUM_THREADS)
+    {
+        ivec3 coord = ivec3(region_min + ivec2(i % region_size.x, i / region_size.x), light);
+
+#ifndef CLUSTER_INIT
+        if (imageLoad(i_Labels, coord).r != cluster)
+            continue;
+#endif
+
+        vec3 vpl_pos;
+        vec3 vpl_normal;
+        vec3 vpl_flux;
+
+        read_rsm(coord, vpl_pos, vpl_normal, vpl_flux);
+
+        vpl_flux *= lights[light].color.rgb * light_attenuation(light, vpl_pos);
+
+        float w = dot(vpl_flux, vec3(0.2126, 0.7152, 0.0722));
+
+        // Background and texels outside the spot cone.
+        if (w <= 0.0)
+            continue;
+
+        flux += vpl_flux;
+        position += vpl_pos * w;
+        normal += vpl_normal * w;
+        weight += w;
+    }
+
+    g_flux[idx]     = flux;
+    g_position[idx] = position;
+    g_normal[idx]   = normal;
+    g_weight[idx]   = weight;
+
+    barrier();
+
+    for (uint s = NUM_THREADS / 2; s > 0; s >>= 1)
+    {
+        if (idx < s)
+        {
+            g_flux[idx] += g_flux[idx + s];
+            g_position[idx] += g_position[idx + s];
+            g_normal[idx] += g_normal[idx + s];
+            g_weight[idx] += g_weight[idx + s];
+        }
+
+        barrier();
+    }
+
+    if (idx == 0)
+    {
+        // Empty clusters keep a zero normal and flux so that they add nothing in the gather.
+        if (g_weight[0] > 0.0 && length(g_normal[0]) > 0.0)
+        {
+            vpls[cluster].position = vec4(g_position[0] / g_weight[0], 1.0);
+            vpls[cluster].normal   = vec4(normalize(g_normal[0]), 0.0);
+            vpls[cluster].flux     = vec4(g_flux[0], 0.0);
+        }
+        else
+        {
+            vpls[cluster].position = vec4(0.0);
+            vpls[cluster].normal   = vec4(0.0);
+            vpls[cluster].flux     = vec4(0.0);
+        }
+    }
+}
+
+// ------------------------------------------------------------------
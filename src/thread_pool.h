@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Fixed set of worker threads that execute queued tasks in FIFO order.
+class ThreadPool
+{
+public:
+    // A thread count of zero uses one worker per hardware thread.
+    explicit ThreadPool(uint32_t num_threads = 0)
+    {
+        if (num_threads == 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (uint32_t i = 0; i < num_threads; i++)
+            m_workers.emplace_back([this]() { worker(); });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_all();
+
+        for (auto& thread : m_workers)
+            thread.join();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+
+        m_condition.notify_one();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Calls func(i) for every i in [0, count) and blocks until all of them have returned. The calling thread takes part in
+    // the work, so this makes progress even when every worker is busy with long-running tasks.
+    void parallel_for(uint32_t count, const std::function<void(uint32_t)>& func)
+    {
+        if (count == 0)
+            return;
+
+        auto state   = std::make_shared<ParallelFor>();
+        state->count = count;
+        state->func  = func;
+
+        uint32_t helpers = std::min(uint32_t(m_workers.size()), count - 1);
+
+        for (uint32_t i = 0; i < helpers; i++)
+            submit([state]() { state->run(); });
+
+        state->run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->condition.wait(lock, [&state]() { return state->completed == state->count; });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline uint32_t num_threads() const { return uint32_t(m_workers.size()); }
+
+private:
+    struct ParallelFor
+    {
+        std::atomic<uint32_t>         next { 0 };
+        uint32_t                      count     = 0;
+        uint32_t                      completed = 0;
+        std::function<void(uint32_t)> func;
+        std::mutex                    mutex;
+        std::condition_variable       condition;
+
+        void run()
+        {
+            uint32_t finished = 0;
+            uint32_t i;
+
+            while ((i = next++) < count)
+            {
+                func(i);
+                finished++;
+            }
+
+            if (finished > 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                completed += finished;
+
+                if (completed == count)
+                    condition.notify_all();
+            }
+        }
+    };
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void worker()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+
+                if (m_stop && m_tasks.empty())
+                    return;
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+private:
+    bool                              m_stop = false;
+    std::vector<std::thread>          m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_condition;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <ogl.h>
+#include <logger.h>
+#include <algorithm>
+#include <cstring>
+
+#define UNIFORM_RING_FRAMES_IN_FLIGHT 3
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Range of the ring holding one block of uniforms for the current frame.
+struct UniformRange
+{
+    GLintptr   offset = 0;
+    GLsizeiptr size   = 0;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Uniform buffer split into one region per frame in flight. Every frame writes its uniforms into the next region and binds
+// them with glBindBufferRange, and a fence at the end of the frame tells when the GPU is done reading the region, so the
+// CPU only ever waits if it gets UNIFORM_RING_FRAMES_IN_FLIGHT frames ahead.
+//
+// The buffer is mapped once, persistently and coherently, when GL_ARB_buffer_storage is available. Otherwise each block is
+// written through an unsynchronized mapping, which the fences make just as safe.
+class UniformRing
+{
+public:
+    bool create(GLsizeiptr frame_size, bool persistent)
+    {
+        // Blocks may also be bound as shader storage, so both offset alignments apply.
+        GLint uniform_alignment = 256;
+        GLint storage_alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+
+        m_alignment  = std::max(uniform_alignment, storage_alignment);
+        m_frame_size = align(frame_size);
+        m_persistent = persistent;
+
+        GLsizeiptr size = m_frame_size * UNIFORM_RING_FRAMES_IN_FLIGHT;
+
+        glGenBuffers(1, &m_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+
+        if (m_persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+            glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+            m_ptr = (uint8_t*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+
+            if (!m_ptr)
+            {
+                DW_LOG_ERROR("Failed to map uniform ring");
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                return false;
+            }
+        }
+        else
+            glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void destroy()
+    {
+        for (GLsync& fence : m_fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+
+            fence = nullptr;
+        }
+
+        if (m_persistent && m_ptr)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+
+        glDeleteBuffers(1, &m_buffer);
+
+        m_buffer = 0;
+        m_ptr    = nullptr;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Moves on to the region of the next frame, waiting for the GPU to finish the frame that last used it.
+    void begin_frame()
+    {
+        m_frame = (m_frame + 1) % UNIFORM_RING_FRAMES_IN_FLIGHT;
+        m_used  = 0;
+
+        GLsync& fence = m_fences[m_frame];
+
+        if (fence)
+        {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+
+            if (status == GL_TIMEOUT_EXPIRED)
+            {
+                m_stalls++;
+
+                while (status == GL_TIMEOUT_EXPIRED)
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Fences the region of the current frame. Call after the last command that reads from it.
+    void end_frame()
+    {
+        m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Copies a block of uniforms into the region of the current frame. Returns an empty range if the region is full.
+    UniformRange push(const void* data, GLsizeiptr size)
+    {
+        UniformRange range;
+
+        if (m_used + size > m_frame_size)
+        {
+            DW_LOG_ERROR("Uniform ring frame size exceeded");
+            return range;
+        }
+
+        range.offset = m_frame * m_frame_size + m_used;
+        range.size   = size;
+
+        if (m_persistent)
+            memcpy(m_ptr + range.offset, data, size);
+        else
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+
+            void* ptr = glMapBufferRange(GL_UNIFORM_BUFFER, range.offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            memcpy(ptr, data, size);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+
+        m_used += align(size);
+
+        return range;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void bind(GLuint index, const UniformRange& range) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, index, m_buffer, range.offset, range.size);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // For per-frame arrays that are too large for a uniform block, such as instance transforms.
+    void bind_storage(GLuint index, const UniformRange& range) const
+    {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, index, m_buffer, range.offset, range.size);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // For per-frame indirect draw commands. Draws take the offset of their range as the indirect pointer.
+    void bind_draw_indirect() const
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_buffer);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline bool     persistent() const { return m_persistent; }
+    inline uint32_t stalls() const { return m_stalls; }
+
+private:
+    inline GLsizeiptr align(GLsizeiptr size) const { return ((size + m_alignment - 1) / m_alignment) * m_alignment; }
+
+private:
+    GLuint     m_buffer                                = 0;
+    uint8_t*   m_ptr                                   = nullptr;
+    GLsizeiptr m_alignment                             = 256;
+    GLsizeiptr m_frame_size                            = 0;
+    GLsizeiptr m_used                                  = 0;
+    uint32_t   m_frame                                 = 0;
+    uint32_t   m_stalls                                = 0;
+    bool       m_persistent                            = false;
+    GLsync     m_fences[UNIFORM_RING_FRAMES_IN_FLIGHT] = { nullptr, nullptr, nullptr };
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------